@@ -0,0 +1,98 @@
+#pragma once
+#include <string>
+#include <cstdio>
+#include <algorithm>
+#include <mutex>
+#include <string_view>
+#include <vector>
+#include <sys/socket.h>
+#include "../TradeCoreExport/tcp_server_socket.h"
+#include "log.h"
+#include "line_framing.h"
+#include "subscriber_output.h"
+
+// Admin Server Socket: commands that change the engine's state, one per line.
+// The server listens on the loopback interface only, so a session is an operator
+// on the engine's host; the public ports stay read-only.
+template<typename server_t>
+class admin_socket_t : public tcp_server_socket_t {
+public:
+    server_t* parent_server;
+    std::string session_id;
+    std::vector<uint8_t> rxbuf;
+    // Replies not yet accepted by the socket; guarded by the server's sessions_mutex
+    SubscriberOutput output;
+    
+    // Constructor
+    admin_socket_t(int fd, sockaddr_in clientaddr, socklen_t clientlen,
+                   sockaddr_in local_addr, uint16_t local_port_, tcp_server_t* parent)
+        : tcp_server_socket_t(fd, clientaddr, clientlen, local_addr, local_port_, parent),
+          parent_server(nullptr), session_id("admin_" + std::to_string(fd)),
+          output(fd, "admin", session_id) {}
+    
+    size_t handle_packet(const uint8_t* buf, const size_t len, uint64_t ts, void* sock, bool& should_disconnect) override;
+    void gen_shm_name(const int fd, char* buf) override;
+    void on_add() override;
+    void on_remove() override;
+    
+    // Queues msg and sends what the socket takes now; the rest goes out on later flushes
+    void send_message(const std::string& msg);
+    
+private:
+    void handle_request(const std::string& request);
+};
+
+// Implementation
+template<typename server_t>
+size_t admin_socket_t<server_t>::handle_packet(const uint8_t* buf, const size_t len, uint64_t, void*, bool& should_disconnect) {
+    bool framed = frame_lines(rxbuf, buf, len, kMaxRequestLineLength, [this](std::string_view line) {
+        if (!line.empty()) {
+            handle_request(std::string(line));
+        }
+    });
+    if (!framed) {
+        LOG_WARN("[admin] Session %s sent an unterminated line, disconnecting\n", session_id.c_str());
+        should_disconnect = true;
+    }
+    return len;
+}
+
+template<typename server_t>
+void admin_socket_t<server_t>::handle_request(const std::string& request) {
+    if (request.length() > 6 && request.substr(0, 6) == "PHASE:" && parent_server) {
+        // PHASE:<symbol>:<state>, * for every symbol; RESUME returns to the schedule
+        size_t colon = request.find(':', 6);
+        if (colon != std::string::npos) {
+            parent_server->change_phase(this, request.substr(6, colon - 6), request.substr(colon + 1));
+        }
+    } else {
+        LOG_WARN("[admin] %s: unknown request %s\n", session_id.c_str(), request.c_str());
+    }
+}
+
+template<typename server_t>
+void admin_socket_t<server_t>::gen_shm_name(const int fd, char* buf) {
+    snprintf(buf, 256, "admin_%d_%d", getpid(), fd);
+}
+
+template<typename server_t>
+void admin_socket_t<server_t>::on_add() {
+    LOG_INFO("[admin] Session %s connected (fd=%d)\n", session_id.c_str(), get_fd());
+}
+
+template<typename server_t>
+void admin_socket_t<server_t>::on_remove() {
+    LOG_INFO("[admin] Session %s disconnected (fd=%d)\n", session_id.c_str(), get_fd());
+    if (parent_server) {
+        std::lock_guard<std::mutex> lock(parent_server->sessions_mutex);
+        auto& sessions = parent_server->sessions;
+        sessions.erase(std::remove(sessions.begin(), sessions.end(), this), sessions.end());
+    }
+}
+
+template<typename server_t>
+void admin_socket_t<server_t>::send_message(const std::string& msg) {
+    std::lock_guard<std::mutex> lock(parent_server->sessions_mutex);
+    output.push(msg.data(), msg.size());
+    output.flush();
+}
@@ -0,0 +1,251 @@
+#include "async_logger.h"
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+
+namespace {
+    // Appends one printf-style conversion of the record's next argument(s) to out.
+    // spec is the conversion without length modifiers; integers are widened to 64 bits.
+    size_t format_arg(char* out, size_t space, std::string spec, char conversion,
+                      const LogRecord& record, uint8_t& next, int star_args) {
+        int stars[2] = {0, 0};
+        for (int i = 0; i < star_args && next < record.arg_count; ++i) {
+            stars[i] = static_cast<int>(record.args[next++]);
+        }
+        if (next >= record.arg_count) {
+            return 0;
+        }
+        
+        uint8_t index = next++;
+        uint64_t bits = record.args[index];
+        int written = 0;
+        switch (record.arg_types[index]) {
+            case LogRecord::TEXT: {
+                const char* text = conversion == 's' ? record.text + bits : "?";
+                spec += 's';
+                if (star_args == 2) written = snprintf(out, space, spec.c_str(), stars[0], stars[1], text);
+                else if (star_args == 1) written = snprintf(out, space, spec.c_str(), stars[0], text);
+                else written = snprintf(out, space, spec.c_str(), text);
+                break;
+            }
+            case LogRecord::DOUBLE: {
+                double value;
+                memcpy(&value, &bits, sizeof(value));
+                spec += conversion;
+                if (star_args == 2) written = snprintf(out, space, spec.c_str(), stars[0], stars[1], value);
+                else if (star_args == 1) written = snprintf(out, space, spec.c_str(), stars[0], value);
+                else written = snprintf(out, space, spec.c_str(), value);
+                break;
+            }
+            default: {
+                if (conversion == 'c') {
+                    spec += 'c';
+                    written = snprintf(out, space, spec.c_str(), static_cast<int>(bits));
+                    break;
+                }
+                spec += "ll";
+                spec += conversion;
+                long long value = static_cast<long long>(bits);
+                if (star_args == 2) written = snprintf(out, space, spec.c_str(), stars[0], stars[1], value);
+                else if (star_args == 1) written = snprintf(out, space, spec.c_str(), stars[0], value);
+                else written = snprintf(out, space, spec.c_str(), value);
+                break;
+            }
+        }
+        if (written < 0) {
+            return 0;
+        }
+        return static_cast<size_t>(written) < space ? static_cast<size_t>(written) : space - 1;
+    }
+    
+    // Renders a record into out; returns the length
+    size_t format_record(const LogRecord& record, char* out, size_t space) {
+        size_t length = 0;
+        uint8_t next = 0;
+        for (const char* p = record.format; *p && length + 1 < space; ++p) {
+            if (*p != '%') {
+                out[length++] = *p;
+                continue;
+            }
+            if (p[1] == '%') {
+                out[length++] = '%';
+                ++p;
+                continue;
+            }
+            
+            std::string spec = "%";
+            int star_args = 0;
+            ++p;
+            while (*p && std::strchr("-+ #0123456789.*", *p)) {
+                if (*p == '*') star_args++;
+                spec += *p++;
+            }
+            while (*p && std::strchr("hljztL", *p)) {
+                ++p;
+            }
+            if (!*p) {
+                break;
+            }
+            length += format_arg(out + length, space - length, spec, *p, record, next, star_args);
+        }
+        out[length] = '\0';
+        return length;
+    }
+}
+
+AsyncLogger::AsyncLogger() : slots(kRingCapacity) {
+    static_assert((kRingCapacity & (kRingCapacity - 1)) == 0, "ring capacity must be a power of two");
+    for (size_t i = 0; i < kRingCapacity; ++i) {
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+AsyncLogger::~AsyncLogger() {
+    stop();
+}
+
+bool AsyncLogger::start(const std::string& file_path, uint64_t file_max_bytes) {
+    std::lock_guard<std::mutex> lock(inline_mutex);
+    if (running.load()) {
+        return true;
+    }
+    
+    path = file_path;
+    max_bytes = file_max_bytes;
+    if (!path.empty()) {
+        out = fopen(path.c_str(), "a");
+        if (!out) {
+            out = stdout;
+            printf("[logger] Cannot open %s, logging to stdout\n", path.c_str());
+            path.clear();
+        } else {
+            fseek(out, 0, SEEK_END);
+            bytes_written = static_cast<uint64_t>(ftell(out));
+        }
+    }
+    
+    running.store(true, std::memory_order_release);
+    writer = std::thread([this]() { run(); });
+    return true;
+}
+
+// Inline writers wait on the mutex until the writer thread is joined and the
+// ring drained, so nothing else touches the file meanwhile
+void AsyncLogger::stop() {
+    std::lock_guard<std::mutex> lock(inline_mutex);
+    if (!running.exchange(false)) {
+        return;
+    }
+    writer.join();
+    
+    // Producers that saw running before it was cleared may still be finishing a slot
+    while (producers.load(std::memory_order_acquire) != 0) {
+        std::this_thread::yield();
+    }
+    while (drain()) {
+    }
+    fflush(out);
+    if (out != stdout) {
+        fclose(out);
+        out = stdout;
+    }
+}
+
+void AsyncLogger::encode_text(LogRecord& record, uint8_t index, const char* value) {
+    record.arg_types[index] = LogRecord::TEXT;
+    if (record.text_used >= LogRecord::kTextBytes) {
+        record.args[index] = LogRecord::kTextBytes - 1;     // points at the final NUL
+        record.text[LogRecord::kTextBytes - 1] = '\0';
+        return;
+    }
+    
+    const char* source = value ? value : "(null)";
+    size_t space = LogRecord::kTextBytes - record.text_used - 1;
+    size_t length = strnlen(source, space);
+    record.args[index] = record.text_used;
+    memcpy(record.text + record.text_used, source, length);
+    record.text[record.text_used + length] = '\0';
+    record.text_used += static_cast<uint16_t>(length + 1);
+}
+
+void AsyncLogger::run() {
+    while (running.load(std::memory_order_acquire)) {
+        if (!drain()) {
+            fflush(out);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+}
+
+// Writes every record that is ready; returns false if there was none
+bool AsyncLogger::drain() {
+    bool any = false;
+    while (true) {
+        Slot& slot = slots[dequeue_pos & (kRingCapacity - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != dequeue_pos + 1) {
+            break;
+        }
+        write_record(slot.record);
+        slot.sequence.store(dequeue_pos + kRingCapacity, std::memory_order_release);
+        dequeue_pos++;
+        any = true;
+    }
+    
+    uint64_t drops = dropped.load(std::memory_order_relaxed);
+    if (drops != reported_drops) {
+        char line[96];
+        int length = snprintf(line, sizeof(line), "[logger] Dropped %llu messages (ring full)\n",
+                              static_cast<unsigned long long>(drops - reported_drops));
+        write(line, static_cast<size_t>(length));
+        reported_drops = drops;
+    }
+    return any;
+}
+
+void AsyncLogger::write_record(const LogRecord& record) {
+    char line[1024];
+    size_t length = 0;
+    if (out != stdout) {
+        // Files get a timestamp prefix, taken at the log call
+        time_t seconds = static_cast<time_t>(record.timestamp / 1000000000);
+        long nanos = static_cast<long>(record.timestamp % 1000000000);
+        struct tm parts;
+        localtime_r(&seconds, &parts);
+        length = strftime(line, sizeof(line), "%Y-%m-%d %H:%M:%S", &parts);
+        length += snprintf(line + length, sizeof(line) - length, ".%09ld ", nanos);
+    }
+    length += format_record(record, line + length, sizeof(line) - length);
+    write(line, length);
+}
+
+void AsyncLogger::write(const char* data, size_t length) {
+    if (max_bytes > 0 && out != stdout && bytes_written + length > max_bytes && bytes_written > 0) {
+        rotate();
+    }
+    fwrite(data, 1, length, out);
+    if (out != stdout) {
+        bytes_written += length;
+    }
+}
+
+// path -> path.1 -> path.2 ... -> path.kRotatedFiles (oldest is overwritten)
+void AsyncLogger::rotate() {
+    fclose(out);
+    for (int i = kRotatedFiles - 1; i >= 1; --i) {
+        std::string from = path + "." + std::to_string(i);
+        std::string to = path + "." + std::to_string(i + 1);
+        std::rename(from.c_str(), to.c_str());
+    }
+    std::rename(path.c_str(), (path + ".1").c_str());
+    
+    out = fopen(path.c_str(), "w");
+    if (!out) {
+        out = stdout;
+    }
+    bytes_written = 0;
+}
+
+AsyncLogger& async_logger() {
+    static AsyncLogger logger;
+    return logger;
+}
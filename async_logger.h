@@ -0,0 +1,164 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Captured log statement: the format string pointer (format strings are literals,
+// so the pointer identifies them) plus raw argument bits and copied strings.
+// Formatting happens later on the logger thread.
+struct LogRecord {
+    static constexpr size_t kMaxArgs = 12;
+    static constexpr size_t kTextBytes = 200;
+    
+    enum ArgType : uint8_t {
+        SIGNED = 1,
+        UNSIGNED = 2,
+        DOUBLE = 3,
+        TEXT = 4            // args[i] is an offset into text
+    };
+    
+    const char* format;
+    uint64_t timestamp;         // wall clock nanos at the log call
+    uint8_t arg_count;
+    uint8_t arg_types[kMaxArgs];
+    uint16_t text_used;
+    uint64_t args[kMaxArgs];
+    char text[kTextBytes];
+};
+
+// Background logger. Producers on any thread claim a slot in a bounded lock-free
+// MPSC ring and copy their arguments into it; one thread formats and writes.
+// When the ring is full the message is dropped and counted, never waited for.
+// Without the writer thread, records are formatted inline under a mutex.
+class AsyncLogger {
+public:
+    static constexpr size_t kRingCapacity = 8192;
+    static constexpr int kRotatedFiles = 5;
+    
+    AsyncLogger();
+    ~AsyncLogger();
+    AsyncLogger(const AsyncLogger&) = delete;
+    AsyncLogger& operator=(const AsyncLogger&) = delete;
+    
+    // Starts the writer thread. An empty path logs to stdout; otherwise the file is
+    // rotated to path.1 .. path.N once it reaches max_bytes (0 = never).
+    bool start(const std::string& path, uint64_t max_bytes);
+    // Drains the ring and joins the writer thread
+    void stop();
+    
+    // Arguments are numbers and C strings, taken by value so that a field of a
+    // packed wire message is copied out rather than bound where it lies
+    template<typename... Args>
+    void log(const char* format, Args... args) {
+        static_assert(sizeof...(Args) <= LogRecord::kMaxArgs, "too many log arguments");
+        // Announced before running is read, so stop() either sees this producer
+        // or this producer sees running cleared
+        producers.fetch_add(1, std::memory_order_seq_cst);
+        if (!running.load(std::memory_order_seq_cst)) {
+            producers.fetch_sub(1, std::memory_order_release);
+            // No writer thread (startup, tools, shutdown): format inline
+            LogRecord record;
+            fill(record, format, args...);
+            std::lock_guard<std::mutex> lock(inline_mutex);
+            write_record(record);
+            return;
+        }
+        
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        Slot* slot;
+        while (true) {
+            slot = &slots[pos & (kRingCapacity - 1)];
+            size_t seq = slot->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                producers.fetch_sub(1, std::memory_order_release);
+                return;
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        
+        fill(slot->record, format, args...);
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        producers.fetch_sub(1, std::memory_order_release);
+    }
+    
+    uint64_t get_dropped() const { return dropped.load(std::memory_order_relaxed); }
+    
+private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        LogRecord record;
+    };
+    
+    std::vector<Slot> slots;
+    alignas(64) std::atomic<size_t> enqueue_pos{0};
+    alignas(64) size_t dequeue_pos = 0;
+    std::atomic<uint64_t> dropped{0};
+    uint64_t reported_drops = 0;
+    // Producers between reading running and publishing their slot
+    alignas(64) std::atomic<uint32_t> producers{0};
+    
+    std::thread writer;
+    std::atomic<bool> running{false};
+    // Serializes inline writes with each other, start() and the final drain in stop()
+    std::mutex inline_mutex;
+    std::string path;
+    FILE* out = stdout;
+    uint64_t max_bytes = 0;
+    uint64_t bytes_written = 0;
+    
+    template<typename... Args>
+    static void fill(LogRecord& record, const char* format, const Args&... args) {
+        record.format = format;
+        record.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        record.arg_count = 0;
+        record.text_used = 0;
+        (encode(record, args), ...);
+    }
+    
+    template<typename T>
+    static void encode(LogRecord& record, const T& value) {
+        uint8_t index = record.arg_count++;
+        if constexpr (std::is_floating_point_v<T>) {
+            double d = value;
+            record.arg_types[index] = LogRecord::DOUBLE;
+            memcpy(&record.args[index], &d, sizeof(d));
+        } else if constexpr (std::is_integral_v<T> || std::is_enum_v<T>) {
+            if constexpr (std::is_signed_v<T>) {
+                record.arg_types[index] = LogRecord::SIGNED;
+                record.args[index] = static_cast<uint64_t>(static_cast<int64_t>(value));
+            } else {
+                record.arg_types[index] = LogRecord::UNSIGNED;
+                record.args[index] = static_cast<uint64_t>(value);
+            }
+        } else {
+            static_assert(std::is_convertible_v<T, const char*>, "log arguments must be numbers or C strings");
+            encode_text(record, index, value);
+        }
+    }
+    
+    static void encode_text(LogRecord& record, uint8_t index, const char* value);
+    
+    void run();
+    bool drain();
+    void write_record(const LogRecord& record);
+    void write(const char* data, size_t length);
+    void rotate();
+};
+
+AsyncLogger& async_logger();
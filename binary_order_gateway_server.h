@@ -0,0 +1,99 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdio>
+#include "../TradeCoreExport/tcp_server_socket.h"
+#include "matching_engine_types.h"
+#include "order_entry_protocol.h"
+
+// Binary Order Gateway Server Socket
+template<typename server_t>
+class binary_order_gateway_socket_t : public tcp_server_socket_t {
+public:
+    std::vector<uint8_t> rxbuf;
+    std::vector<OrderRequest> batch;
+    server_t* parent_server;
+    std::string client_id;
+    ClientId client = 0;
+    
+    // Constructor
+    binary_order_gateway_socket_t(int fd, sockaddr_in clientaddr, socklen_t clientlen,
+                                  sockaddr_in local_addr, uint16_t local_port_, tcp_server_t* parent)
+        : tcp_server_socket_t(fd, clientaddr, clientlen, local_addr, local_port_, parent),
+          parent_server(nullptr), client_id("client_" + std::to_string(fd)) {}
+    
+    size_t handle_packet(const uint8_t* buf, const size_t len, uint64_t ts, void* sock, bool& should_disconnect) override;
+    void gen_shm_name(const int fd, char* buf) override;
+    void on_add() override;
+    void on_remove() override;
+};
+
+// Implementation
+template<typename server_t>
+size_t binary_order_gateway_socket_t<server_t>::handle_packet(const uint8_t* buf, const size_t len, uint64_t ts, void*,
+                                                              bool& should_disconnect) {
+    if (ts) {
+        record_stage_ns(Stage::RECEIVE, get_current_timestamp() - ts);
+    }
+    
+    // Decode straight from the receive buffer; only a partial trailing message is carried in rxbuf
+    const uint8_t* data = buf;
+    size_t available = len;
+    if (!rxbuf.empty()) {
+        rxbuf.insert(rxbuf.end(), buf, buf + len);
+        data = rxbuf.data();
+        available = rxbuf.size();
+    }
+    
+    batch.clear();
+    size_t offset = 0;
+    while (available - offset >= sizeof(MsgHeader)) {
+        const MsgHeader* header = reinterpret_cast<const MsgHeader*>(data + offset);
+        if (header->length < sizeof(MsgHeader)) {
+            LOG_WARN("[binary_gateway] Bad message length %u from %s\n", header->length, client_id.c_str());
+            if (!batch.empty() && parent_server) {
+                parent_server->on_order_batch(batch);
+            }
+            rxbuf.clear();
+            should_disconnect = true;
+            return len;
+        }
+        if (available - offset < header->length) {
+            break;
+        }
+        OrderRequest request;
+        uint64_t parse_start = read_tsc();
+        if (parent_server && parent_server->decode(client, header, request)) {
+            batch.push_back(request);
+        }
+        record_stage_ticks(Stage::PARSE, parse_start, read_tsc());
+        offset += header->length;
+    }
+    
+    if (!batch.empty() && parent_server) {
+        parent_server->on_order_batch(batch);
+    }
+    
+    if (data == buf) {
+        rxbuf.assign(data + offset, data + available);
+    } else {
+        rxbuf.erase(rxbuf.begin(), rxbuf.begin() + offset);
+    }
+    
+    return len;
+}
+
+template<typename server_t>
+void binary_order_gateway_socket_t<server_t>::gen_shm_name(const int fd, char* buf) {
+    snprintf(buf, 256, "binary_gateway_%d_%d", getpid(), fd);
+}
+
+template<typename server_t>
+void binary_order_gateway_socket_t<server_t>::on_add() {
+    LOG_INFO("[binary_gateway] Client %s connected (fd=%d)\n", client_id.c_str(), get_fd());
+}
+
+template<typename server_t>
+void binary_order_gateway_socket_t<server_t>::on_remove() {
+    LOG_INFO("[binary_gateway] Client %s disconnected (fd=%d)\n", client_id.c_str(), get_fd());
+}
@@ -0,0 +1,306 @@
+#include "book_checkpoint.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "log.h"
+#include "order_entry_protocol.h"
+#include "order_journal.h"
+
+namespace {
+    constexpr char kCheckpointMagic[8] = {'S', 'M', 'E', 'C', 'K', 'P', 'T', '1'};
+
+#pragma pack(push, 1)
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t checksum;              // over every byte after the header
+        uint64_t length;                // of the whole file
+        uint64_t journal_sequence;
+        uint64_t next_order_id;
+        uint32_t symbol_count;
+        uint32_t client_count;
+        uint64_t order_count;
+        uint64_t position_count;
+    };
+    
+    // Followed by its order_count OrderRecords
+    struct SymbolRecord {
+        char symbol[kSymbolLength];
+        uint8_t backend;                // BookBackend
+        uint8_t self_trade_prevention;  // SelfTradePrevention
+        uint8_t phase;                  // TradingState
+        uint8_t reserved[5];
+        uint64_t tick_size;
+        uint64_t min_price;
+        uint64_t max_price;
+        uint64_t order_capacity;
+        uint64_t next_fill_id;
+        uint64_t last_trade_price;
+        uint64_t last_trade_quantity;
+        uint64_t order_count;
+    };
+    
+    struct ClientRecord {
+        char client[OrderJournal::kClientLength];
+    };
+    
+    struct OrderRecord {
+        uint64_t order_id;
+        uint64_t quantity;
+        uint64_t remaining_quantity;
+        uint64_t price;
+        uint64_t timestamp;
+        uint32_t client;
+        uint8_t side;                   // OrderSide
+        uint8_t type;                   // OrderType
+        uint8_t status;                 // OrderStatus
+        uint8_t reserved;
+    };
+    
+    struct PositionRecord {
+        uint32_t client;
+        uint32_t symbol;
+        int64_t position;
+    };
+#pragma pack(pop)
+
+    // FNV-1a taken eight bytes at a time, folded to 32 bits, as in the journal
+    uint32_t checksum(const uint8_t* bytes, size_t length) {
+        uint64_t hash = 14695981039346656037ull;
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+            uint64_t word;
+            memcpy(&word, bytes + i, sizeof(word));
+            hash = (hash ^ word) * 1099511628211ull;
+        }
+        for (; i < length; ++i) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+        return static_cast<uint32_t>(hash ^ (hash >> 32));
+    }
+}
+
+size_t BookCheckpoint::State::order_count() const {
+    size_t count = 0;
+    for (const auto& symbol : symbols) {
+        count += symbol.orders.size();
+    }
+    return count;
+}
+
+size_t BookCheckpoint::write(const std::string& path, const State& state) {
+    size_t order_count = state.order_count();
+    size_t length = sizeof(FileHeader) + state.symbols.size() * sizeof(SymbolRecord) +
+                    state.clients.size() * sizeof(ClientRecord) + order_count * sizeof(OrderRecord) +
+                    state.positions.size() * sizeof(PositionRecord);
+    
+    std::string temp_path = path + ".tmp";
+    int fd = ::open(temp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        LOG_ERROR("[checkpoint] Cannot open %s\n", temp_path.c_str());
+        return 0;
+    }
+    if (posix_fallocate(fd, 0, length) != 0) {
+        LOG_ERROR("[checkpoint] Cannot preallocate %zu bytes for %s\n", length, temp_path.c_str());
+        ::close(fd);
+        return 0;
+    }
+    void* mapping = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        LOG_ERROR("[checkpoint] Cannot map %s\n", temp_path.c_str());
+        ::close(fd);
+        return 0;
+    }
+    uint8_t* base = static_cast<uint8_t*>(mapping);
+    uint8_t* out = base + sizeof(FileHeader);
+    
+    for (const auto& symbol : state.symbols) {
+        SymbolRecord record;
+        memset(&record, 0, sizeof(record));
+        copy_symbol(record.symbol, symbol.name);
+        record.backend = static_cast<uint8_t>(symbol.config.backend);
+        record.self_trade_prevention = static_cast<uint8_t>(symbol.config.self_trade_prevention);
+        record.phase = static_cast<uint8_t>(symbol.phase);
+        record.tick_size = symbol.config.tick_size;
+        record.min_price = symbol.config.min_price;
+        record.max_price = symbol.config.max_price;
+        record.order_capacity = symbol.config.order_capacity;
+        record.next_fill_id = symbol.next_fill_id;
+        record.last_trade_price = symbol.last_trade_price;
+        record.last_trade_quantity = symbol.last_trade_quantity;
+        record.order_count = symbol.orders.size();
+        memcpy(out, &record, sizeof(record));
+        out += sizeof(record);
+        
+        for (const auto& order : symbol.orders) {
+            OrderRecord entry;
+            memset(&entry, 0, sizeof(entry));
+            entry.order_id = order.order_id;
+            entry.quantity = order.quantity;
+            entry.remaining_quantity = order.remaining_quantity;
+            entry.price = order.price;
+            entry.timestamp = order.timestamp;
+            entry.client = order.client_id;
+            entry.side = static_cast<uint8_t>(order.side);
+            entry.type = static_cast<uint8_t>(order.type);
+            entry.status = static_cast<uint8_t>(order.status);
+            memcpy(out, &entry, sizeof(entry));
+            out += sizeof(entry);
+        }
+    }
+    for (const auto& client : state.clients) {
+        ClientRecord record;
+        memset(&record, 0, sizeof(record));
+        memcpy(record.client, client.data(), std::min(client.size(), sizeof(record.client)));
+        memcpy(out, &record, sizeof(record));
+        out += sizeof(record);
+    }
+    for (const auto& position : state.positions) {
+        PositionRecord record{position.client, position.symbol, position.position};
+        memcpy(out, &record, sizeof(record));
+        out += sizeof(record);
+    }
+    
+    FileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kCheckpointMagic, sizeof(kCheckpointMagic));
+    header.version = kVersion;
+    header.length = length;
+    header.journal_sequence = state.journal_sequence;
+    header.next_order_id = state.next_order_id;
+    header.symbol_count = static_cast<uint32_t>(state.symbols.size());
+    header.client_count = static_cast<uint32_t>(state.clients.size());
+    header.order_count = order_count;
+    header.position_count = state.positions.size();
+    header.checksum = checksum(base + sizeof(FileHeader), length - sizeof(FileHeader));
+    memcpy(base, &header, sizeof(header));
+    
+    bool synced = msync(base, length, MS_SYNC) == 0;
+    munmap(base, length);
+    ::close(fd);
+    if (!synced || rename(temp_path.c_str(), path.c_str()) != 0) {
+        LOG_ERROR("[checkpoint] Cannot replace %s\n", path.c_str());
+        return 0;
+    }
+    return length;
+}
+
+bool BookCheckpoint::read(const std::string& path, State& state) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(FileHeader)) {
+        LOG_ERROR("[checkpoint] %s is too short to be a checkpoint\n", path.c_str());
+        ::close(fd);
+        return false;
+    }
+    size_t length = static_cast<size_t>(st.st_size);
+    void* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        LOG_ERROR("[checkpoint] Cannot map %s\n", path.c_str());
+        return false;
+    }
+    const uint8_t* base = static_cast<const uint8_t*>(mapping);
+    
+    FileHeader header;
+    memcpy(&header, base, sizeof(header));
+    size_t expected = sizeof(FileHeader) + header.symbol_count * sizeof(SymbolRecord) +
+                      header.client_count * sizeof(ClientRecord) + header.order_count * sizeof(OrderRecord) +
+                      header.position_count * sizeof(PositionRecord);
+    bool valid = false;
+    if (memcmp(header.magic, kCheckpointMagic, sizeof(kCheckpointMagic)) != 0) {
+        LOG_ERROR("[checkpoint] %s is not a checkpoint\n", path.c_str());
+    } else if (header.version != kVersion) {
+        LOG_ERROR("[checkpoint] %s is version %u, expected %u\n", path.c_str(), header.version, kVersion);
+    } else if (header.length != length || expected != length ||
+               header.checksum != checksum(base + sizeof(FileHeader), length - sizeof(FileHeader))) {
+        LOG_ERROR("[checkpoint] %s is damaged\n", path.c_str());
+    } else {
+        valid = true;
+    }
+    
+    // Counts were checked against the length above; per-symbol order counts are
+    // checked against the header's total as they are read
+    const uint8_t* in = base + sizeof(FileHeader);
+    uint64_t orders_left = header.order_count;
+    state = State();
+    state.journal_sequence = header.journal_sequence;
+    state.next_order_id = header.next_order_id;
+    for (uint32_t i = 0; valid && i < header.symbol_count; ++i) {
+        SymbolRecord record;
+        memcpy(&record, in, sizeof(record));
+        in += sizeof(record);
+        if (record.order_count > orders_left) {
+            LOG_ERROR("[checkpoint] %s is damaged\n", path.c_str());
+            valid = false;
+            break;
+        }
+        orders_left -= record.order_count;
+        
+        SymbolState symbol;
+        symbol.name = std::string(symbol_view(record.symbol));
+        symbol.config.backend = static_cast<BookBackend>(record.backend);
+        symbol.config.self_trade_prevention = static_cast<SelfTradePrevention>(record.self_trade_prevention);
+        symbol.phase = static_cast<TradingState>(record.phase);
+        symbol.config.tick_size = record.tick_size;
+        symbol.config.min_price = record.min_price;
+        symbol.config.max_price = record.max_price;
+        symbol.config.order_capacity = record.order_capacity;
+        symbol.next_fill_id = record.next_fill_id;
+        symbol.last_trade_price = record.last_trade_price;
+        symbol.last_trade_quantity = record.last_trade_quantity;
+        symbol.orders.reserve(record.order_count);
+        for (uint64_t j = 0; j < record.order_count; ++j) {
+            OrderRecord entry;
+            memcpy(&entry, in, sizeof(entry));
+            in += sizeof(entry);
+            Order order(entry.order_id, i, static_cast<OrderSide>(entry.side), static_cast<OrderType>(entry.type),
+                        entry.quantity, entry.price, entry.client);
+            order.remaining_quantity = entry.remaining_quantity;
+            order.timestamp = entry.timestamp;
+            order.status = static_cast<OrderStatus>(entry.status);
+            symbol.orders.push_back(order);
+        }
+        state.symbols.push_back(std::move(symbol));
+    }
+    for (uint32_t i = 0; valid && i < header.client_count; ++i) {
+        ClientRecord record;
+        memcpy(&record, in, sizeof(record));
+        in += sizeof(record);
+        state.clients.emplace_back(OrderJournal::client_view(record.client));
+    }
+    for (uint64_t i = 0; valid && i < header.position_count; ++i) {
+        PositionRecord record;
+        memcpy(&record, in, sizeof(record));
+        in += sizeof(record);
+        if (record.client >= header.client_count || record.symbol >= header.symbol_count) {
+            LOG_ERROR("[checkpoint] %s is damaged\n", path.c_str());
+            valid = false;
+            break;
+        }
+        state.positions.push_back(Position{record.client, record.symbol, record.position});
+    }
+    munmap(mapping, length);
+    
+    if (!valid) {
+        state = State();
+        return false;
+    }
+    // Orders must name a client in the image
+    for (const auto& symbol : state.symbols) {
+        for (const auto& order : symbol.orders) {
+            if (order.client_id >= state.clients.size()) {
+                LOG_ERROR("[checkpoint] %s is damaged\n", path.c_str());
+                state = State();
+                return false;
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "matching_engine_types.h"
+#include "price_levels.h"
+
+// Versioned file image of every book at one journal sequence: symbols with their
+// book configuration and trading phase, resting orders in priority order, id counters, last trades
+// and net positions. Starting from it and replaying only the journal records
+// after journal_sequence gives the same state as replaying the whole journal.
+//
+// The file is written into a memory mapping of a temporary file that is renamed
+// over the last checkpoint, so a crash mid-write leaves the previous one intact.
+// Like the journal it carries names rather than interned ids: orders and
+// positions refer to clients and symbols by their index in the image.
+class BookCheckpoint {
+public:
+    static constexpr uint32_t kVersion = 1;
+    
+    struct SymbolState {
+        std::string name;
+        BookConfig config;
+        TradingState phase = TradingState::TRADING;
+        uint64_t next_fill_id = 1;
+        uint64_t last_trade_price = 0;
+        uint64_t last_trade_quantity = 0;
+        // symbol_id is this symbol's index and client_id an index into clients
+        std::vector<Order> orders;
+    };
+    
+    struct Position {
+        uint32_t client;
+        uint32_t symbol;
+        int64_t position;
+    };
+    
+    struct State {
+        uint64_t journal_sequence = 0;
+        uint64_t next_order_id = 1;
+        std::vector<SymbolState> symbols;
+        std::vector<std::string> clients;
+        std::vector<Position> positions;
+        
+        size_t order_count() const;
+    };
+    
+    // Returns the bytes written, 0 on failure
+    static size_t write(const std::string& path, const State& state);
+    // False if there is no checkpoint or it is not intact and of this version
+    static bool read(const std::string& path, State& state);
+};
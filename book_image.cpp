@@ -0,0 +1,149 @@
+#include "book_image.h"
+#include <memory>
+#include <string>
+
+namespace {
+    size_t side_index(uint8_t side) {
+        return side == static_cast<uint8_t>(OrderSide::BUY) ? 0 : 1;
+    }
+}
+
+// Resting orders arrive NEW or PARTIALLY_FILLED, both when they first rest and on a
+// modify; CANCELLED takes one out. Fills reduce resting orders through apply_fill,
+// and rejections never touch the book.
+void BookImage::apply_order(const Order& order) {
+    bool rests = order.status == OrderStatus::NEW || order.status == OrderStatus::PARTIALLY_FILLED;
+    if (!rests && order.status != OrderStatus::CANCELLED) {
+        return;
+    }
+    
+    auto it = order_slots.find(order.order_id);
+    if (it == order_slots.end()) {
+        if (!rests || order.remaining_quantity == 0) {
+            return;
+        }
+        OrderEntryMsg entry;
+        entry.header.length = sizeof(entry);
+        entry.header.msg_type = static_cast<uint8_t>(MdMsgType::ORDER_ENTRY);
+        entry.side = static_cast<uint8_t>(order.side);
+        entry.order_id = order.order_id;
+        entry.price = order.price;
+        entry.quantity = order.remaining_quantity;
+        order_slots.emplace(order.order_id, static_cast<uint32_t>(orders.size()));
+        orders.push_back(entry);
+        adjust_level(entry.side, entry.price, entry.quantity, 0, 1);
+    } else if (rests) {
+        OrderEntryMsg& entry = orders[it->second];
+        adjust_level(entry.side, entry.price, order.remaining_quantity, entry.quantity, 0);
+        entry.quantity = order.remaining_quantity;
+    } else {
+        remove_order(it->second);
+    }
+    touch();
+}
+
+// An uncross fill trades two resting orders; otherwise the aggressor's own update
+// already carries what it has left
+void BookImage::apply_fill(const Fill& fill) {
+    if (fill.auction) {
+        reduce_order(fill.buy_order_id, fill.quantity);
+        reduce_order(fill.sell_order_id, fill.quantity);
+    } else {
+        reduce_order((fill.aggressor_side == OrderSide::BUY) ? fill.sell_order_id : fill.buy_order_id, fill.quantity);
+    }
+}
+
+void BookImage::reduce_order(uint64_t order_id, uint64_t quantity) {
+    auto it = order_slots.find(order_id);
+    if (it == order_slots.end()) {
+        return;
+    }
+    OrderEntryMsg& entry = orders[it->second];
+    if (quantity >= entry.quantity) {
+        remove_order(it->second);
+    } else {
+        adjust_level(entry.side, entry.price, 0, quantity, 0);
+        entry.quantity -= quantity;
+    }
+    touch();
+}
+
+void BookImage::remove_order(uint32_t slot) {
+    // Entries are packed, so their fields are copied out before use as map keys
+    OrderEntryMsg& entry = orders[slot];
+    uint64_t order_id = entry.order_id;
+    adjust_level(entry.side, entry.price, 0, entry.quantity, -1);
+    order_slots.erase(order_id);
+    if (slot + 1 != orders.size()) {
+        entry = orders.back();
+        order_id = entry.order_id;
+        order_slots[order_id] = slot;
+    }
+    orders.pop_back();
+}
+
+// Creates the level on its first order and drops it with its last
+void BookImage::adjust_level(uint8_t side, uint64_t price, uint64_t add, uint64_t remove, int count_delta) {
+    auto& slots = level_slots[side_index(side)];
+    auto it = slots.find(price);
+    if (it == slots.end()) {
+        DepthLevelMsg level;
+        level.header.length = sizeof(level);
+        level.header.msg_type = static_cast<uint8_t>(MdMsgType::DEPTH_LEVEL);
+        level.side = side;
+        level.price = price;
+        level.quantity = 0;
+        level.order_count = 0;
+        it = slots.emplace(price, static_cast<uint32_t>(levels.size())).first;
+        levels.push_back(level);
+    }
+    
+    uint32_t slot = it->second;
+    DepthLevelMsg& level = levels[slot];
+    level.quantity = level.quantity + add - remove;
+    level.order_count += count_delta;
+    if (level.order_count == 0) {
+        slots.erase(it);
+        if (slot + 1 != levels.size()) {
+            level = levels.back();
+            uint64_t moved_price = level.price;
+            level_slots[side_index(level.side)][moved_price] = slot;
+        }
+        levels.pop_back();
+    }
+}
+
+SharedBuffer BookImage::encode(Depth depth, std::string_view symbol, uint64_t sequence, const MarketDataSnapshot& top) {
+    if (cached[depth] && (!settled || !changed[depth])) {
+        return cached[depth];
+    }
+    // Unsettled and never served: nothing to fall back on, so the requester gets an
+    // empty image at sequence 0, which is not cached
+    bool placeholder = !settled;
+    
+    const char* entries = (depth == LEVELS) ? reinterpret_cast<const char*>(levels.data())
+                                            : reinterpret_cast<const char*>(orders.data());
+    size_t count = placeholder ? 0 : (depth == LEVELS) ? levels.size() : orders.size();
+    size_t entry_size = (depth == LEVELS) ? sizeof(DepthLevelMsg) : sizeof(OrderEntryMsg);
+    
+    BookImageMsg header;
+    header.header.length = sizeof(header);
+    header.header.msg_type = static_cast<uint8_t>(MdMsgType::BOOK_IMAGE);
+    copy_symbol(header.symbol, symbol);
+    header.sequence = placeholder ? 0 : sequence;
+    header.depth = (depth == LEVELS) ? 2 : 3;
+    header.entry_count = static_cast<uint32_t>(count);
+    header.last_trade_price = placeholder ? 0 : top.last_trade_price;
+    header.last_trade_quantity = placeholder ? 0 : top.last_trade_quantity;
+    
+    auto buffer = std::make_shared<std::string>();
+    buffer->reserve(sizeof(header) + count * entry_size);
+    buffer->append(reinterpret_cast<const char*>(&header), sizeof(header));
+    buffer->append(entries, count * entry_size);
+    if (placeholder) {
+        return buffer;
+    }
+    cached[depth] = std::move(buffer);
+    changed[depth] = false;
+    return cached[depth];
+}
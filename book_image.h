@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "matching_engine_types.h"
+#include "market_data_protocol.h"
+#include "output_queue.h"
+
+// Full-depth book of one symbol kept as encoded recovery messages (see
+// market_data_protocol.h): a dense array of DepthLevelMsg, one per price level,
+// and one of OrderEntryMsg, one per resting order. Published order updates and
+// fills rewrite the affected entries in place and a removed entry is replaced by
+// the last one, so every change is O(1). Serving copies an array into a buffer
+// that is shared by every request until the image changes again.
+//
+// Between a symbol's first order event of a batch and the BOOK_UPDATE that closes
+// the batch, the image is ahead of the feed; it is unsettled then, and requests
+// get the image as it stood at the last settled point, or an empty one at
+// sequence 0 if it has not been served since it was created.
+class BookImage {
+public:
+    enum Depth { LEVELS = 0, ORDERS = 1 };
+    
+    void apply_order(const Order& order);
+    void apply_fill(const Fill& fill);
+    void settle() { settled = true; }
+    
+    // BookImageMsg and entries; rebuilt only if settled and changed since the
+    // last call. Never null
+    SharedBuffer encode(Depth depth, std::string_view symbol, uint64_t sequence, const MarketDataSnapshot& top);
+    
+private:
+    std::vector<DepthLevelMsg> levels;
+    std::vector<OrderEntryMsg> orders;
+    std::unordered_map<uint64_t, uint32_t> level_slots[2];     // price -> slot, bids then asks
+    std::unordered_map<uint64_t, uint32_t> order_slots;
+    SharedBuffer cached[2];
+    bool changed[2] = {true, true};
+    bool settled = true;
+    
+    void touch() {
+        settled = false;
+        changed[LEVELS] = changed[ORDERS] = true;
+    }
+    void adjust_level(uint8_t side, uint64_t price, uint64_t add, uint64_t remove, int count_delta);
+    void reduce_order(uint64_t order_id, uint64_t quantity);
+    void remove_order(uint32_t slot);
+};
@@ -0,0 +1,203 @@
+#include "checkpoint_writer.h"
+#include <algorithm>
+#include <chrono>
+#include "log.h"
+#include "order_entry_protocol.h"
+
+namespace {
+    constexpr uint64_t kCatchUpIntervalMs = 10;
+    
+    uint64_t position_key(ClientId client, SymbolId symbol) {
+        return (static_cast<uint64_t>(client) << 32) | symbol;
+    }
+}
+
+CheckpointWriter::CheckpointWriter(const OrderJournal& journal_ref, const std::string& checkpoint_path, uint64_t interval)
+    : journal(journal_ref), path(checkpoint_path), interval_ms(interval), shard(0, symbols, 1) {
+    shard.set_logging(false);
+}
+
+CheckpointWriter::~CheckpointWriter() {
+    stop();
+}
+
+void CheckpointWriter::add_symbol(const std::string& symbol, const BookConfig& config) {
+    std::lock_guard<std::mutex> lock(pending_mutex);
+    pending_symbols.emplace_back(symbol, config);
+}
+
+void CheckpointWriter::start(BookCheckpoint::State initial) {
+    running.store(true, std::memory_order_release);
+    thread = std::thread(&CheckpointWriter::run, this, std::move(initial));
+}
+
+void CheckpointWriter::stop() {
+    if (!thread.joinable()) {
+        return;
+    }
+    running.store(false, std::memory_order_release);
+    thread.join();
+}
+
+// Catches up continuously, so a checkpoint is never far behind the journal, and
+// writes on the interval; an interval of 0 writes only at stop
+void CheckpointWriter::run(BookCheckpoint::State initial) {
+    seed(initial);
+    initial = BookCheckpoint::State();
+    
+    uint64_t last_write_ts = get_current_timestamp();
+    while (running.load(std::memory_order_acquire)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(kCatchUpIntervalMs));
+        catch_up();
+        uint64_t now = get_current_timestamp();
+        if (interval_ms > 0 && now - last_write_ts >= interval_ms * 1000000 && applied_sequence != written_sequence) {
+            write();
+            last_write_ts = now;
+        }
+    }
+    catch_up();
+    if (applied_sequence != written_sequence) {
+        write();
+    }
+}
+
+// The seed is the checkpoint on disk, so nothing is written until the journal moves past it
+void CheckpointWriter::seed(const BookCheckpoint::State& initial) {
+    shard.materialize();
+    // The engine has registered every symbol it kept from the checkpoint, with the
+    // configuration it uses; the rest were dropped from its books too
+    add_pending_symbols();
+    std::vector<SymbolId> symbol_ids;
+    for (const auto& symbol : initial.symbols) {
+        SymbolId id = symbols.find(symbol.name);
+        if (id != StringInterner::kInvalidId) {
+            last_trades[id] = std::make_pair(symbol.last_trade_price, symbol.last_trade_quantity);
+        }
+        symbol_ids.push_back(id);
+    }
+    std::vector<ClientId> client_ids;
+    for (const auto& client : initial.clients) {
+        client_ids.push_back(clients.intern(client));
+    }
+    
+    std::vector<Order> orders;
+    for (size_t i = 0; i < initial.symbols.size(); ++i) {
+        if (symbol_ids[i] == StringInterner::kInvalidId) {
+            continue;
+        }
+        orders = initial.symbols[i].orders;
+        for (auto& order : orders) {
+            order.symbol_id = symbol_ids[i];
+            order.client_id = client_ids[order.client_id];
+        }
+        shard.restore_book(symbol_ids[i], initial.symbols[i].next_fill_id, initial.symbols[i].phase, orders);
+    }
+    for (const auto& position : initial.positions) {
+        if (symbol_ids[position.symbol] == StringInterner::kInvalidId) {
+            continue;
+        }
+        positions[position_key(client_ids[position.client], symbol_ids[position.symbol])] = position.position;
+    }
+    shard.end_batch();
+    shard.pending_events().clear();
+    
+    applied_sequence = initial.journal_sequence;
+    written_sequence = initial.journal_sequence;
+    next_order_id = initial.next_order_id;
+}
+
+void CheckpointWriter::add_pending_symbols() {
+    std::vector<std::pair<std::string, BookConfig>> added;
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        added.swap(pending_symbols);
+    }
+    for (const auto& entry : added) {
+        add_book(entry.first, entry.second);
+    }
+}
+
+SymbolId CheckpointWriter::add_book(std::string_view symbol, const BookConfig& config) {
+    SymbolId id = symbols.intern(symbol);
+    if (id == configs.size()) {
+        configs.push_back(config);
+        last_trades.emplace_back(0, 0);
+        shard.add_book(id, config);
+    }
+    return id;
+}
+
+SymbolId CheckpointWriter::shadow_symbol(std::string_view symbol) {
+    SymbolId id = symbols.find(symbol);
+    if (id == StringInterner::kInvalidId) {
+        add_pending_symbols();
+        id = symbols.find(symbol);
+    }
+    if (id == StringInterner::kInvalidId) {
+        LOG_WARN("[checkpoint] %.*s was never registered; shadowing it with a default book\n",
+                 static_cast<int>(symbol.size()), symbol.data());
+        id = add_book(symbol, BookConfig{});
+    }
+    return id;
+}
+
+// Same steps as the engine's journal replay, minus market data and pre-trade risk
+void CheckpointWriter::catch_up() {
+    add_pending_symbols();
+    applied_sequence = journal.replay_durable(applied_sequence, [this](const OrderJournal::Record& record) {
+        OrderRequest request = OrderJournal::to_request(record);
+        request.symbol_id = shadow_symbol(symbol_view(record.symbol));
+        request.client_id = clients.intern(OrderJournal::client_view(record.client));
+        if (request.symbol_id == StringInterner::kInvalidId || request.client_id == StringInterner::kInvalidId) {
+            return;
+        }
+        
+        shard.execute(request);
+        for (const auto& event : shard.pending_events()) {
+            if (event.type == EventType::FILL) {
+                const Fill& fill = event.fill;
+                last_trades[fill.symbol_id] = std::make_pair(fill.price, fill.quantity);
+                positions[position_key(fill.buy_client_id, fill.symbol_id)] += static_cast<int64_t>(fill.quantity);
+                positions[position_key(fill.sell_client_id, fill.symbol_id)] -= static_cast<int64_t>(fill.quantity);
+            }
+        }
+        shard.pending_events().clear();
+        next_order_id = std::max(next_order_id, request.order_id + 1);
+    });
+    shard.end_batch();
+    shard.pending_events().clear();
+}
+
+void CheckpointWriter::write() {
+    uint64_t start_ts = get_current_timestamp();
+    BookCheckpoint::State state;
+    state.journal_sequence = applied_sequence;
+    state.next_order_id = next_order_id;
+    state.symbols.resize(configs.size());
+    for (SymbolId id = 0; id < configs.size(); ++id) {
+        BookCheckpoint::SymbolState& symbol = state.symbols[id];
+        symbol.name = symbols.name(id);
+        symbol.config = configs[id];
+        symbol.last_trade_price = last_trades[id].first;
+        symbol.last_trade_quantity = last_trades[id].second;
+        shard.capture_book(id, symbol.next_fill_id, symbol.phase, symbol.orders);
+    }
+    for (ClientId id = 0; id < clients.size(); ++id) {
+        state.clients.push_back(clients.name(id));
+    }
+    for (const auto& entry : positions) {
+        if (entry.second != 0) {
+            state.positions.push_back(BookCheckpoint::Position{static_cast<uint32_t>(entry.first >> 32),
+                                                               static_cast<uint32_t>(entry.first), entry.second});
+        }
+    }
+    
+    size_t bytes = BookCheckpoint::write(path, state);
+    if (bytes == 0) {
+        return;
+    }
+    written_sequence = applied_sequence;
+    uint64_t elapsed_ns = get_current_timestamp() - start_ts;
+    LOG_INFO("[checkpoint] Wrote %s at journal sequence %lu: %zu symbols, %zu orders, %zu bytes in %.3f ms\n",
+             path.c_str(), state.journal_sequence, state.symbols.size(), state.order_count(), bytes, elapsed_ns / 1e6);
+}
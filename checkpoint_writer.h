@@ -0,0 +1,69 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "book_checkpoint.h"
+#include "matching_shard.h"
+#include "order_journal.h"
+#include "string_interner.h"
+
+// Takes periodic checkpoints without stopping the live books. A background
+// thread feeds the durable part of the journal through a shadow shard of its own,
+// the same way startup replays it, so between catch-ups the shadow is a frozen
+// image of every book at one journal sequence and is serialized at leisure.
+// Matching never pauses; the cost is the shadow's memory and a second pass of
+// the matching work, off the hot path. Checkpoints only ever cover records that
+// are already on disk, so the journal always holds everything after them.
+class CheckpointWriter {
+public:
+    CheckpointWriter(const OrderJournal& journal, const std::string& path, uint64_t interval_ms);
+    ~CheckpointWriter();
+    CheckpointWriter(const CheckpointWriter&) = delete;
+    CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+    
+    // Any thread. Symbols the journal refers to are registered before their first
+    // record; the first configuration seen for a name is kept
+    void add_symbol(const std::string& symbol, const BookConfig& config);
+    
+    // Seeds the shadow with the checkpoint startup restored from, if any
+    void start(BookCheckpoint::State initial);
+    // Catches up with the durable journal and writes a last checkpoint; call
+    // before the journal is closed
+    void stop();
+    
+private:
+    const OrderJournal& journal;
+    std::string path;
+    uint64_t interval_ms;
+    
+    std::mutex pending_mutex;
+    std::vector<std::pair<std::string, BookConfig>> pending_symbols;
+    
+    // Shadow state, owned by the writer thread
+    StringInterner symbols;
+    StringInterner clients;
+    MatchingShard shard;
+    std::vector<BookConfig> configs;
+    std::vector<std::pair<uint64_t, uint64_t>> last_trades;     // price, quantity per symbol
+    std::unordered_map<uint64_t, int64_t> positions;            // client << 32 | symbol
+    uint64_t applied_sequence = 0;
+    uint64_t written_sequence = 0;
+    uint64_t next_order_id = 1;
+    
+    std::thread thread;
+    std::atomic<bool> running{false};
+    
+    void run(BookCheckpoint::State initial);
+    void seed(const BookCheckpoint::State& initial);
+    void add_pending_symbols();
+    // Keeps the first configuration of a name
+    SymbolId add_book(std::string_view symbol, const BookConfig& config);
+    SymbolId shadow_symbol(std::string_view symbol);
+    void catch_up();
+    void write();
+};
@@ -0,0 +1,144 @@
+#include "drop_copy_history.h"
+#include <atomic>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "log.h"
+
+namespace {
+    // Version 2 added the slot checksum
+    constexpr char kHistoryMagic[8] = {'S', 'M', 'E', 'D', 'C', 'P', 'Y', '2'};
+    
+    struct HistoryHeader {
+        char magic[8];
+        uint32_t slot_size;
+        uint64_t slot_count;
+    };
+}
+
+DropCopyHistory::~DropCopyHistory() {
+    close();
+}
+
+bool DropCopyHistory::open(const std::string& path, size_t capacity) {
+    slot_count = capacity > 0 ? capacity : 1;
+    if (path.empty()) {
+        mapping_size = slot_count * kSlotSize;
+        void* memory = mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            LOG_ERROR("[drop_copy] Cannot allocate %zu bytes of history\n", mapping_size);
+            return false;
+        }
+        mapping = static_cast<uint8_t*>(memory);
+        base = reinterpret_cast<Slot*>(mapping);
+        return true;
+    }
+    
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        LOG_ERROR("[drop_copy] Cannot open %s\n", path.c_str());
+        return false;
+    }
+    
+    // An existing file keeps the capacity it was created with
+    HistoryHeader header;
+    memset(&header, 0, sizeof(header));
+    if (pread(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header)) && header.slot_count > 0) {
+        if (memcmp(header.magic, kHistoryMagic, sizeof(kHistoryMagic)) != 0 || header.slot_size != kSlotSize) {
+            LOG_ERROR("[drop_copy] %s is not a drop copy history of this format\n", path.c_str());
+            close();
+            return false;
+        }
+        slot_count = header.slot_count;
+    }
+    
+    mapping_size = kHeaderSize + slot_count * kSlotSize;
+    if (posix_fallocate(fd, 0, mapping_size) != 0) {
+        LOG_ERROR("[drop_copy] Cannot preallocate %zu bytes for %s\n", mapping_size, path.c_str());
+        close();
+        return false;
+    }
+    void* memory = mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED) {
+        LOG_ERROR("[drop_copy] Cannot map %s\n", path.c_str());
+        close();
+        return false;
+    }
+    mapping = static_cast<uint8_t*>(memory);
+    base = reinterpret_cast<Slot*>(mapping + kHeaderSize);
+    
+    if (header.slot_count == 0) {
+        memcpy(header.magic, kHistoryMagic, sizeof(kHistoryMagic));
+        header.slot_size = kSlotSize;
+        header.slot_count = slot_count;
+        memcpy(mapping, &header, sizeof(header));
+    }
+    recover();
+    LOG_INFO("[drop_copy] Opened history %s: sequences %lu-%lu, %zu slots\n",
+             path.c_str(), first_sequence(), newest, slot_count);
+    return true;
+}
+
+// The newest message is the highest sequence whose slot matches its position and
+// is intact
+void DropCopyHistory::recover() {
+    newest = 0;
+    for (size_t i = 0; i < slot_count; ++i) {
+        const Slot& slot = base[i];
+        if (slot.sequence > newest && (slot.sequence - 1) % slot_count == i && slot.length <= kMaxMessageSize &&
+            slot.checksum == checksum(slot.sequence, slot)) {
+            newest = slot.sequence;
+        }
+    }
+    // The append after newest went to the oldest message's slot
+    recovered_first = 1;
+    if (newest >= slot_count) {
+        uint64_t oldest = newest - slot_count + 1;
+        const Slot& slot = *slot_at(oldest);
+        if (slot.sequence != oldest || slot.checksum != checksum(oldest, slot)) {
+            recovered_first = oldest + 1;
+        }
+    }
+}
+
+// FNV-1a over the sequence, the length and the message bytes
+uint32_t DropCopyHistory::checksum(uint64_t sequence, const Slot& slot) {
+    uint64_t hash = 14695981039346656037ull;
+    hash = (hash ^ sequence) * 1099511628211ull;
+    hash = (hash ^ slot.length) * 1099511628211ull;
+    for (size_t i = 0; i < slot.length; ++i) {
+        hash = (hash ^ slot.data[i]) * 1099511628211ull;
+    }
+    return static_cast<uint32_t>(hash ^ (hash >> 32));
+}
+
+void DropCopyHistory::close() {
+    if (mapping) {
+        if (fd >= 0) {
+            msync(mapping, mapping_size, MS_SYNC);
+        }
+        munmap(mapping, mapping_size);
+        mapping = nullptr;
+        base = nullptr;
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+// Without storage (open failed) sequences are still counted, but nothing is kept
+void DropCopyHistory::append(uint64_t sequence, const void* msg, size_t length) {
+    if (base) {
+        Slot* slot = slot_at(sequence);
+        slot->length = static_cast<uint16_t>(length < kMaxMessageSize ? length : kMaxMessageSize);
+        memcpy(slot->data, msg, slot->length);
+        slot->checksum = checksum(sequence, *slot);
+        // The slot only claims the new sequence once its contents are in place
+        std::atomic_signal_fence(std::memory_order_release);
+        slot->sequence = sequence;
+    }
+    newest = sequence;
+}
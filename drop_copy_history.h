@@ -0,0 +1,71 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Sequenced drop copy messages kept for replay to reconnecting subscribers.
+// Messages sit in fixed-size slots of a ring, sequence n in slot (n - 1) % capacity.
+// With a path the ring is a preallocated memory-mapped file sized for the trading
+// day, so the stream and its sequence numbers survive a restart; without one it
+// is anonymous memory and holds only the most recent capacity messages.
+class DropCopyHistory {
+public:
+    static constexpr size_t kSlotSize = 128;
+    static constexpr size_t kMaxMessageSize = kSlotSize - 16;
+    
+    DropCopyHistory() = default;
+    ~DropCopyHistory();
+    DropCopyHistory(const DropCopyHistory&) = delete;
+    DropCopyHistory& operator=(const DropCopyHistory&) = delete;
+    
+    bool open(const std::string& path, size_t capacity);
+    void close();
+    bool is_open() const { return base != nullptr; }
+    
+    // Sequences must be appended in order, starting at last_sequence() + 1
+    void append(uint64_t sequence, const void* msg, size_t length);
+    
+    uint64_t last_sequence() const { return newest; }
+    // Oldest sequence still held, or last_sequence() + 1 when empty
+    uint64_t first_sequence() const {
+        if (!base) {
+            return newest + 1;
+        }
+        uint64_t oldest = newest >= slot_count ? newest - slot_count + 1 : 1;
+        return oldest > recovered_first ? oldest : recovered_first;
+    }
+    
+    // Message bytes of a held sequence; length is set to its size
+    const uint8_t* message(uint64_t sequence, size_t& length) const {
+        const Slot* slot = slot_at(sequence);
+        length = slot->length;
+        return slot->data;
+    }
+    
+private:
+    // sequence is written last and the checksum covers it, the length and the
+    // message, so a slot torn by a crash mid-append is never taken for a message
+    struct Slot {
+        uint64_t sequence;
+        uint16_t length;
+        uint8_t reserved[2];
+        uint32_t checksum;
+        uint8_t data[kMaxMessageSize];
+    };
+    static_assert(sizeof(Slot) == kSlotSize, "slot layout");
+    
+    static constexpr size_t kHeaderSize = 64;
+    
+    int fd = -1;
+    uint8_t* mapping = nullptr;
+    size_t mapping_size = 0;
+    Slot* base = nullptr;
+    size_t slot_count = 0;
+    uint64_t newest = 0;
+    // A crash mid-append can leave the oldest slot torn; nothing before this is held
+    uint64_t recovered_first = 1;
+    
+    Slot* slot_at(uint64_t sequence) const { return base + (sequence - 1) % slot_count; }
+    static uint32_t checksum(uint64_t sequence, const Slot& slot);
+    void recover();
+};
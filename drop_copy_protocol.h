@@ -0,0 +1,74 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include "order_entry_protocol.h"
+
+// Drop copy stream: fixed-layout, packed, little-endian messages, each starting
+// with a MsgHeader whose length covers the whole message. Every event is encoded
+// once and the same bytes go to every subscriber that wants it.
+//
+// Each event carries a sequence number, contiguous across all events of the day.
+// Subscribers may send newline-terminated requests:
+//   FILTER:SYMBOL:<symbol>    only events for the listed symbols
+//   FILTER:CLIENT:<client>    only orders and fills of the listed clients
+//   FILTER:CLEAR              everything again
+//   REPLAY:<sequence>         resend the retained events from sequence on, then
+//                             continue live with no gap or overlap
+// Repeated FILTER requests of one kind add to its list; the kinds combine with AND.
+// A reconnecting subscriber should send REPLAY with its last sequence + 1 first;
+// events delivered before the request are sent again by the replay. If the
+// history no longer holds the requested sequence the replay starts at the oldest
+// event it has, and the jump in sequence shows what was lost.
+//
+// Sequence numbers only ever rise on a connection, but a filtered subscriber skips
+// the events it filtered out, and one on a conflating server (--slow-consumer
+// conflate) skips order updates a newer update of the same order superseded while
+// it was behind. Such a subscriber should only REPLAY after a reconnect.
+enum class DropCopyMsgType : uint8_t {
+    FILL = 'F',
+    ORDER_UPDATE = 'O'
+};
+
+constexpr size_t kClientNameLength = 16;
+
+#pragma pack(push, 1)
+struct DropCopyFillMsg {
+    MsgHeader header;
+    uint64_t sequence;
+    char symbol[kSymbolLength];         // NUL padded
+    char buy_client[kClientNameLength];
+    char sell_client[kClientNameLength];
+    uint64_t fill_id;
+    uint64_t buy_order_id;
+    uint64_t sell_order_id;
+    uint64_t quantity;
+    uint64_t price;                     // nanos
+    uint64_t timestamp;
+};
+
+struct DropCopyOrderMsg {
+    MsgHeader header;
+    uint64_t sequence;
+    char symbol[kSymbolLength];
+    char client[kClientNameLength];
+    uint64_t order_id;
+    uint8_t side;                       // OrderSide
+    uint8_t status;                     // OrderStatus
+    uint64_t quantity;
+    uint64_t remaining_quantity;
+    uint64_t price;
+    uint64_t timestamp;
+};
+#pragma pack(pop)
+
+// Both messages lead with the sequence and symbol, at the same offsets
+static_assert(offsetof(DropCopyFillMsg, symbol) == offsetof(DropCopyOrderMsg, symbol), "symbol offset");
+
+// Writes client into a fixed field, NUL padded and truncated to kClientNameLength
+inline void copy_client(char (&out)[kClientNameLength], std::string_view client) {
+    size_t len = client.size() < kClientNameLength ? client.size() : kClientNameLength;
+    memcpy(out, client.data(), len);
+    memset(out + len, 0, kClientNameLength - len);
+}
@@ -2,10 +2,70 @@
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <mutex>
+#include <cstddef>
 #include <cstdio>
+#include <cstring>
+#include <string_view>
 #include <sys/socket.h>
 #include "../TradeCoreExport/tcp_server_socket.h"
+#include "log.h"
+#include "line_framing.h"
 #include "matching_engine_types.h"
+#include "string_interner.h"
+#include "subscriber_output.h"
+#include "drop_copy_protocol.h"
+
+// Drop copy subscription (see drop_copy_protocol.h); an empty list matches everything.
+// Live events are matched by interned id; replayed messages by their padded name
+// fields, which need no interner lookup on the publishing thread. Every listed
+// client has a field, but only those already connected have an id: filters never
+// intern, so subscribers cannot fill the client interner.
+struct DropCopyFilter {
+    std::vector<SymbolId> symbols;
+    std::vector<ClientId> clients;
+    std::vector<std::string> symbol_fields;
+    std::vector<std::string> client_fields;
+    
+    // msg is the event's encoding, for clients listed before they had an id
+    bool matches(const uint8_t* msg, SymbolId symbol, ClientId client,
+                 ClientId other_client = StringInterner::kInvalidId) const {
+        if (!symbols.empty() && std::find(symbols.begin(), symbols.end(), symbol) == symbols.end()) {
+            return false;
+        }
+        if (client_fields.empty() || std::find(clients.begin(), clients.end(), client) != clients.end() ||
+            std::find(clients.begin(), clients.end(), other_client) != clients.end()) {
+            return true;
+        }
+        return clients.size() < client_fields.size() && matches_clients(msg);
+    }
+    
+    // msg is an encoded DropCopyFillMsg or DropCopyOrderMsg
+    bool matches_message(const uint8_t* msg) const {
+        if (!symbol_fields.empty() && !contains(symbol_fields, msg + offsetof(DropCopyFillMsg, symbol), kSymbolLength)) {
+            return false;
+        }
+        return client_fields.empty() || matches_clients(msg);
+    }
+    
+private:
+    bool matches_clients(const uint8_t* msg) const {
+        if (msg[offsetof(MsgHeader, msg_type)] == static_cast<uint8_t>(DropCopyMsgType::FILL)) {
+            return contains(client_fields, msg + offsetof(DropCopyFillMsg, buy_client), kClientNameLength) ||
+                   contains(client_fields, msg + offsetof(DropCopyFillMsg, sell_client), kClientNameLength);
+        }
+        return contains(client_fields, msg + offsetof(DropCopyOrderMsg, client), kClientNameLength);
+    }
+    
+    static bool contains(const std::vector<std::string>& fields, const uint8_t* field, size_t length) {
+        for (const auto& f : fields) {
+            if (memcmp(f.data(), field, length) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
 
 // Drop Copy Server Socket
 template<typename server_t>
@@ -13,24 +73,40 @@ class drop_copy_socket_t : public tcp_server_socket_t {
 public:
     server_t* parent_server;
     std::string subscriber_id;
+    std::vector<uint8_t> rxbuf;
+    // Backlog not yet accepted by the socket and the subscription;
+    // guarded by the server's subscribers_mutex
+    SubscriberOutput output;
+    DropCopyFilter filter;
+    // Next sequence to replay from the history; 0 once the subscriber is live
+    uint64_t replay_next = 0;
     
     // Constructor
     drop_copy_socket_t(int fd, sockaddr_in clientaddr, socklen_t clientlen,
                       sockaddr_in local_addr, uint16_t local_port_, tcp_server_t* parent)
         : tcp_server_socket_t(fd, clientaddr, clientlen, local_addr, local_port_, parent),
-          parent_server(nullptr), subscriber_id("dropcopy_" + std::to_string(fd)) {}
+          parent_server(nullptr), subscriber_id("dropcopy_" + std::to_string(fd)),
+          output(fd, "drop_copy", subscriber_id) {}
     
     size_t handle_packet(const uint8_t* buf, const size_t len, uint64_t ts, void* sock, bool& should_disconnect) override;
     void gen_shm_name(const int fd, char* buf) override;
     void on_add() override;
     void on_remove() override;
-    
-    void send_message(const std::string& msg);
 };
 
 // Implementation
+// Subscribers send FILTER and REPLAY requests, one per line
 template<typename server_t>
-size_t drop_copy_socket_t<server_t>::handle_packet(const uint8_t*, const size_t len, uint64_t, void*, bool&) {
+size_t drop_copy_socket_t<server_t>::handle_packet(const uint8_t* buf, const size_t len, uint64_t, void*, bool& should_disconnect) {
+    bool framed = frame_lines(rxbuf, buf, len, kMaxRequestLineLength, [this](std::string_view line) {
+        if (!line.empty() && parent_server) {
+            parent_server->handle_request(this, line);
+        }
+    });
+    if (!framed) {
+        LOG_WARN("[drop_copy] Subscriber %s sent an unterminated line, disconnecting\n", subscriber_id.c_str());
+        should_disconnect = true;
+    }
     return len;
 }
 
@@ -41,20 +117,17 @@ void drop_copy_socket_t<server_t>::gen_shm_name(const int fd, char* buf) {
 
 template<typename server_t>
 void drop_copy_socket_t<server_t>::on_add() {
-    printf("[drop_copy] Subscriber %s connected (fd=%d)\n", subscriber_id.c_str(), get_fd());
+    LOG_INFO("[drop_copy] Subscriber %s connected (fd=%d)\n", subscriber_id.c_str(), get_fd());
 }
 
 template<typename server_t>
 void drop_copy_socket_t<server_t>::on_remove() {
-    printf("[drop_copy] Subscriber %s disconnected (fd=%d)\n", subscriber_id.c_str(), get_fd());
+    LOG_INFO("[drop_copy] Subscriber %s disconnected (fd=%d)\n", subscriber_id.c_str(), get_fd());
     // Remove from subscribers list
     if (parent_server) {
+        std::lock_guard<std::mutex> lock(parent_server->subscribers_mutex);
         auto& subs = parent_server->subscribers;
         subs.erase(std::remove(subs.begin(), subs.end(), this), subs.end());
+        parent_server->subscriber_count.store(subs.size(), std::memory_order_relaxed);
     }
 }
-
-template<typename server_t>
-void drop_copy_socket_t<server_t>::send_message(const std::string& msg) {
-    ::send(get_fd(), msg.c_str(), msg.length(), 0);
-}
\ No newline at end of file
@@ -0,0 +1,115 @@
+#include "instrument_directory.h"
+#include <charconv>
+#include <fstream>
+#include <unordered_set>
+#include "log.h"
+#include "order_entry_protocol.h"
+
+namespace {
+    bool parse_field(std::string_view field, uint64_t& value) {
+        if (field.empty()) {
+            return false;
+        }
+        auto result = std::from_chars(field.data(), field.data() + field.size(), value);
+        return result.ec == std::errc() && result.ptr == field.data() + field.size();
+    }
+    
+    std::string_view trim(std::string_view text) {
+        while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) {
+            text.remove_prefix(1);
+        }
+        while (!text.empty() && (text.back() == ' ' || text.back() == '\t' || text.back() == '\r')) {
+            text.remove_suffix(1);
+        }
+        return text;
+    }
+}
+
+bool InstrumentDirectory::load(const std::string& path, std::vector<Instrument>& instruments) {
+    std::ifstream in(path);
+    if (!in) {
+        LOG_ERROR("[instruments] Cannot open %s\n", path.c_str());
+        return false;
+    }
+    
+    instruments.clear();
+    std::unordered_set<std::string> seen;
+    std::string text;
+    size_t line_number = 0;
+    while (std::getline(in, text)) {
+        line_number++;
+        std::string_view line(text);
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty()) {
+            continue;
+        }
+        Instrument instrument;
+        if (!parse_line(line, instrument)) {
+            LOG_ERROR("[instruments] %s:%zu: invalid instrument '%s'\n", path.c_str(), line_number, text.c_str());
+            return false;
+        }
+        if (!seen.insert(instrument.symbol).second) {
+            LOG_ERROR("[instruments] %s:%zu: %s is listed twice\n", path.c_str(), line_number, instrument.symbol.c_str());
+            return false;
+        }
+        instruments.push_back(std::move(instrument));
+    }
+    return true;
+}
+
+bool InstrumentDirectory::parse_line(std::string_view line, Instrument& instrument) {
+    constexpr size_t kMaxFields = 7;
+    std::string_view fields[kMaxFields];
+    size_t count = 0;
+    size_t start = 0;
+    while (true) {
+        size_t end = line.find(':', start);
+        if (count == kMaxFields) {
+            return false;
+        }
+        fields[count++] = trim(line.substr(start, end - start));
+        if (end == std::string_view::npos) {
+            break;
+        }
+        start = end + 1;
+    }
+    
+    // Journal records and binary messages hold at most kSymbolLength characters
+    if (count < 5 || fields[0].empty() || fields[0].size() > kSymbolLength ||
+        fields[0].find(' ') != std::string_view::npos) {
+        return false;
+    }
+    instrument.symbol = std::string(fields[0]);
+    BookConfig& book = instrument.book;
+    if (!parse_field(fields[1], book.tick_size) || !parse_field(fields[2], instrument.lot_size) ||
+        !parse_field(fields[3], book.min_price) || !parse_field(fields[4], book.max_price)) {
+        return false;
+    }
+    if (count > 5) {
+        if (fields[5] == "TRADING") {
+            instrument.state = TradingState::TRADING;
+        } else if (fields[5] == "HALTED") {
+            instrument.state = TradingState::HALTED;
+        } else {
+            return false;
+        }
+    }
+    if (count > 6) {
+        if (fields[6] == "MAP") {
+            book.backend = BookBackend::MAP;
+        } else if (fields[6] == "LADDER") {
+            book.backend = BookBackend::LADDER;
+        } else {
+            return false;
+        }
+    }
+    
+    if (book.max_price != 0 && book.max_price < book.min_price) {
+        return false;
+    }
+    // Band edges on the tick, so both are valid prices
+    if (book.tick_size != 0 && (book.min_price % book.tick_size != 0 || book.max_price % book.tick_size != 0)) {
+        return false;
+    }
+    return book.backend != BookBackend::LADDER || (book.tick_size != 0 && book.max_price != 0);
+}
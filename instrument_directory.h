@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "price_levels.h"
+
+// Static reference data of one tradable symbol. The book's tick size and
+// min/max price double as the order checks: a non-zero tick requires prices on
+// it, a non-zero max_price bands limit prices to [min_price, max_price], and a
+// non-zero lot size requires quantities in whole lots.
+struct Instrument {
+    std::string symbol;
+    BookConfig book;
+    uint64_t lot_size = 0;
+    // At start; HALTED holds the symbol until an admin resumes it
+    TradingState state = TradingState::TRADING;
+};
+
+// The instrument universe, loaded once at startup. Only listed symbols trade,
+// and a symbol's id is its position in the file, so clients can send the id
+// alone (see the *_BY_ID messages in order_entry_protocol.h).
+//
+// One instrument per line; blank lines and text after '#' are ignored:
+//   SYMBOL:TICK:LOT:MIN_PRICE:MAX_PRICE[:TRADING|HALTED[:MAP|LADDER]]
+// Prices and tick are in nanos; 0 leaves the tick, lot or band unchecked. A
+// LADDER book needs a tick and a band, which its levels then cover.
+class InstrumentDirectory {
+public:
+    // False, with the offending line logged, unless every line is valid
+    static bool load(const std::string& path, std::vector<Instrument>& instruments);
+    
+private:
+    static bool parse_line(std::string_view line, Instrument& instrument);
+};
@@ -0,0 +1,152 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Cheap cycle counter for latency measurement; falls back to steady_clock off x86
+inline uint64_t read_tsc() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Measures TSC ticks per nanosecond against steady_clock
+inline double calibrate_tsc_per_ns(std::chrono::milliseconds window = std::chrono::milliseconds(100)) {
+    auto wall_start = std::chrono::steady_clock::now();
+    uint64_t tsc_start = read_tsc();
+    std::this_thread::sleep_for(window);
+    uint64_t tsc_end = read_tsc();
+    auto wall_end = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(wall_end - wall_start).count();
+    return ns > 0 ? (tsc_end - tsc_start) / ns : 1.0;
+}
+
+// HDR-style log-linear histogram: values are grouped by power of two, and each
+// power of two is split into kSubBuckets linear buckets, so any recorded value
+// is reported within 1 / kSubBuckets (under 1%) of its true value.
+// Recording is a couple of shifts and an increment, with no allocation.
+class LatencyHistogram {
+public:
+    static constexpr unsigned kSubBucketBits = 7;
+    static constexpr uint64_t kSubBuckets = 1ULL << kSubBucketBits;
+    static constexpr unsigned kMagnitudes = 64 - kSubBucketBits + 1;
+    static constexpr size_t kBucketCount = kMagnitudes * (kSubBuckets / 2) + kSubBuckets / 2;
+    
+    static size_t index_of(uint64_t value) {
+        if (value < kSubBuckets) {
+            return static_cast<size_t>(value);
+        }
+        unsigned magnitude = 63 - __builtin_clzll(value) - kSubBucketBits + 1;
+        uint64_t sub_bucket = value >> magnitude;    // in [kSubBuckets / 2, kSubBuckets)
+        return static_cast<size_t>(magnitude * (kSubBuckets / 2) + sub_bucket);
+    }
+    
+    // Highest value that lands in the bucket at index
+    static uint64_t value_at(size_t index) {
+        if (index < kSubBuckets) {
+            return index;
+        }
+        size_t magnitude = (index - kSubBuckets / 2) / (kSubBuckets / 2);
+        uint64_t sub_bucket = index - magnitude * (kSubBuckets / 2);
+        return ((sub_bucket + 1) << magnitude) - 1;
+    }
+    
+private:
+    std::vector<uint64_t> counts;
+    uint64_t total = 0;
+    uint64_t min_value = UINT64_MAX;
+    uint64_t max_value = 0;
+    
+public:
+    LatencyHistogram() : counts(kBucketCount, 0) {}
+    
+    void record(uint64_t value, uint64_t count = 1) {
+        counts[index_of(value)] += count;
+        total += count;
+        if (value < min_value) min_value = value;
+        if (value > max_value) max_value = value;
+    }
+    
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < counts.size(); ++i) {
+            counts[i] += other.counts[i];
+        }
+        total += other.total;
+        if (other.min_value < min_value) min_value = other.min_value;
+        if (other.max_value > max_value) max_value = other.max_value;
+    }
+    
+    void reset() {
+        std::fill(counts.begin(), counts.end(), 0);
+        total = 0;
+        min_value = UINT64_MAX;
+        max_value = 0;
+    }
+    
+    // Value at percentile (0-100), as the upper edge of its bucket
+    uint64_t percentile(double pct) const {
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(pct / 100.0 * total + 0.5);
+        if (rank == 0) rank = 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); ++i) {
+            seen += counts[i];
+            if (seen >= rank) {
+                uint64_t value = value_at(i);
+                return value < max_value ? value : max_value;
+            }
+        }
+        return max_value;
+    }
+    
+    uint64_t count() const { return total; }
+    uint64_t min() const { return total ? min_value : 0; }
+    uint64_t max() const { return max_value; }
+};
+
+// Single-writer histogram that other threads may read while it is being recorded.
+// Counters are relaxed atomics updated with plain load/store, so recording costs
+// no more than LatencyHistogram and never takes a lock.
+class SharedLatencyHistogram {
+    std::vector<std::atomic<uint64_t>> counts;
+    std::atomic<uint64_t> max_value{0};
+    
+public:
+    SharedLatencyHistogram() : counts(LatencyHistogram::kBucketCount) {
+        for (auto& count : counts) {
+            count.store(0, std::memory_order_relaxed);
+        }
+    }
+    
+    // Writer thread only
+    void record(uint64_t value) {
+        auto& count = counts[LatencyHistogram::index_of(value)];
+        count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (value > max_value.load(std::memory_order_relaxed)) {
+            max_value.store(value, std::memory_order_relaxed);
+        }
+    }
+    
+    // Any thread: adds the current contents to out, at bucket resolution
+    void copy_to(LatencyHistogram& out) const {
+        uint64_t max = max_value.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < counts.size(); ++i) {
+            uint64_t count = counts[i].load(std::memory_order_relaxed);
+            if (count > 0) {
+                uint64_t value = LatencyHistogram::value_at(i);
+                out.record(value < max ? value : max, count);
+            }
+        }
+    }
+};
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+// Longest partial request line a subscriber connection carries over between reads
+constexpr size_t kMaxRequestLineLength = 1024;
+
+// Splits a read into newline-terminated lines for a text protocol whose lines may
+// arrive split across reads or several to a read. Complete lines are framed in
+// place, without their "\r\n" or "\n"; only a partial trailing line is carried
+// over in rxbuf. Returns false once that partial line is longer than max_length,
+// and the caller drops the connection.
+template<typename OnLine>
+bool frame_lines(std::vector<uint8_t>& rxbuf, const uint8_t* buf, size_t len, size_t max_length, OnLine&& on_line) {
+    const char* data = reinterpret_cast<const char*>(buf);
+    size_t available = len;
+    if (!rxbuf.empty()) {
+        rxbuf.insert(rxbuf.end(), buf, buf + len);
+        data = reinterpret_cast<const char*>(rxbuf.data());
+        available = rxbuf.size();
+    }
+    
+    size_t offset = 0;
+    while (offset < available) {
+        const char* newline = static_cast<const char*>(memchr(data + offset, '\n', available - offset));
+        if (!newline) {
+            break;
+        }
+        std::string_view line(data + offset, newline - (data + offset));
+        offset = (newline - data) + 1;
+        
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        on_line(line);
+    }
+    
+    if (available - offset > max_length) {
+        rxbuf.clear();
+        return false;
+    }
+    if (reinterpret_cast<const uint8_t*>(data) == buf) {
+        rxbuf.assign(buf + offset, buf + available);
+    } else {
+        rxbuf.erase(rxbuf.begin(), rxbuf.begin() + offset);
+    }
+    return true;
+}
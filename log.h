@@ -0,0 +1,29 @@
+#pragma once
+#include <cstdio>
+#include "async_logger.h"
+
+// Compile-time log levels. Statements above SME_LOG_LEVEL are compiled out
+// (the format string is still type-checked), so per-order debug logging costs
+// nothing in production builds. Build with `make LOG_LEVEL=4` to enable it.
+// Enabled statements go to async_logger(): the caller only copies the format
+// pointer and arguments, and formatting and I/O happen on the logger thread.
+// Arguments must be numbers or NUL-terminated strings.
+#define SME_LOG_ERROR 1
+#define SME_LOG_WARN 2
+#define SME_LOG_INFO 3
+#define SME_LOG_DEBUG 4
+
+#ifndef SME_LOG_LEVEL
+#define SME_LOG_LEVEL SME_LOG_INFO
+#endif
+
+#define SME_LOG_AT(level, ...) \
+    do { \
+        if (false) printf(__VA_ARGS__); \
+        if (SME_LOG_LEVEL >= (level)) async_logger().log(__VA_ARGS__); \
+    } while (0)
+
+#define LOG_ERROR(...) SME_LOG_AT(SME_LOG_ERROR, __VA_ARGS__)
+#define LOG_WARN(...) SME_LOG_AT(SME_LOG_WARN, __VA_ARGS__)
+#define LOG_INFO(...) SME_LOG_AT(SME_LOG_INFO, __VA_ARGS__)
+#define LOG_DEBUG(...) SME_LOG_AT(SME_LOG_DEBUG, __VA_ARGS__)
@@ -1,15 +1,23 @@
 #include <cstdio>
 #include <signal.h>
+#include <cstdlib>
+#include <cstring>
 #include <string>
+#include <vector>
 #include "../TradeCoreExport/event_manager.h"
 #include "matching_engine.h"
+#include "log.h"
 
 // Global event manager
 event_manager_t* g_event_manager = nullptr;
+MatchingEngine* g_engine = nullptr;
 
 // Signal handler for CTRL-C
 void signal_handler(int signal) {
     if (signal == SIGINT) {
+        if (g_engine) {
+            g_engine->stop_following();
+        }
         if (g_event_manager) {
             printf("\n[matching_engine] Shutting down gracefully...\n");
             g_event_manager->shutdown();
@@ -19,10 +27,43 @@ void signal_handler(int signal) {
     }
 }
 
+// Parses a comma separated core list such as "2,3,4"
+std::vector<int> parse_core_list(const char* list) {
+    std::vector<int> cores;
+    for (const char* p = list; *p; ) {
+        cores.push_back(std::atoi(p));
+        const char* comma = std::strchr(p, ',');
+        if (!comma) {
+            break;
+        }
+        p = comma + 1;
+    }
+    return cores;
+}
+
+void print_usage(const char* prog) {
+    printf("Usage: %s <bind_ip> <multicast_ip> <multicast_port> [options]\n", prog);
+    printf("Options: --instruments PATH (SYMBOL:TICK:LOT:MIN_PRICE:MAX_PRICE[:TRADING|HALTED[:MAP|LADDER]] per line)\n");
+    printf("         --shards N --cores c0,c1,... --publisher-core c --md-depth N (1-255) --md-hold-ns N\n");
+    printf("         --journal PATH --journal-sync-us N --stats-interval-ms N\n");
+    printf("         --checkpoint PATH --checkpoint-interval-ms N\n");
+    printf("         --replication primary|backup --replication-primary IP[:PORT] --replication-sync N\n");
+    printf("         --replication-failover on|off\n");
+    printf("         --subscriber-queue-kb N --slow-consumer disconnect|conflate\n");
+    printf("         --drop-copy-history PATH --drop-copy-history-size N\n");
+    printf("         --risk-max-qty N --risk-max-notional USD --risk-price-band-bps N\n");
+    printf("         --risk-max-open-notional USD --risk-max-position N --risk-max-orders-per-sec N\n");
+    printf("         --self-trade-prevention none|cancel-resting|cancel-aggressor|cancel-both\n");
+    printf("         --session PHASE@HH:MM[:SS],... (PRE_OPEN, OPENING_AUCTION, TRADING, CLOSING_AUCTION, CLOSED; local time)\n");
+    printf("         --log-file PATH --log-max-mb N (rotates PATH to PATH.1..PATH.%d)\n", AsyncLogger::kRotatedFiles);
+    printf("Example: %s 192.168.1.100 239.255.0.1 9999\n", prog);
+    printf("Example: %s 192.168.1.100 239.255.0.1 9999 --shards 2 --cores 2,3 --publisher-core 4\n", prog);
+    printf("Example: %s 127.0.0.2 239.255.0.1 9999 --journal b.jrnl --replication backup --replication-primary 127.0.0.1\n", prog);
+}
+
 int main(int argc, char** argv) {
-    if (argc != 4) {
-        printf("Usage: %s <bind_ip> <multicast_ip> <multicast_port>\n", argv[0]);
-        printf("Example: %s 192.168.1.100 239.255.0.1 9999\n", argv[0]);
+    if (argc < 4) {
+        print_usage(argv[0]);
         return 1;
     }
     
@@ -30,25 +71,170 @@ int main(int argc, char** argv) {
     std::string multicast_ip = argv[2];
     uint16_t multicast_port = std::atoi(argv[3]);
     
+    EngineConfig config;
+    std::string log_file;
+    uint64_t log_max_bytes = 0;
+    for (int i = 4; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        if (arg == "--instruments") {
+            config.instrument_path = argv[++i];
+        } else if (arg == "--shards") {
+            config.shard_count = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--cores") {
+            config.shard_cores = parse_core_list(argv[++i]);
+        } else if (arg == "--publisher-core") {
+            config.publisher_core = std::atoi(argv[++i]);
+        } else if (arg == "--md-depth") {
+            config.md_depth = std::strtoul(argv[++i], nullptr, 10);
+            if (config.md_depth == 0 || config.md_depth > kMaxMdDepth) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--md-hold-ns") {
+            config.md_max_hold_ns = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--journal") {
+            config.journal_path = argv[++i];
+        } else if (arg == "--checkpoint") {
+            config.checkpoint_path = argv[++i];
+        } else if (arg == "--checkpoint-interval-ms") {
+            config.checkpoint_interval_ms = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--replication") {
+            std::string role = argv[++i];
+            if (role == "primary") {
+                config.replication_role = ReplicationRole::PRIMARY;
+            } else if (role == "backup") {
+                config.replication_role = ReplicationRole::BACKUP;
+            } else {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--replication-primary") {
+            std::string endpoint = argv[++i];
+            size_t colon = endpoint.find(':');
+            config.replication_primary_host = endpoint.substr(0, colon);
+            if (colon != std::string::npos) {
+                config.replication_primary_port = std::atoi(endpoint.c_str() + colon + 1);
+            }
+        } else if (arg == "--replication-sync") {
+            config.replication_sync_backups = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--replication-failover") {
+            std::string failover = argv[++i];
+            if (failover == "on" || failover == "off") {
+                config.replication_failover = failover == "on";
+            } else {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--stats-interval-ms") {
+            config.stats_interval_ms = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--journal-sync-us") {
+            config.journal_sync_interval_ns = std::strtoull(argv[++i], nullptr, 10) * 1000;
+        } else if (arg == "--subscriber-queue-kb") {
+            config.subscriber_queue_bytes = std::strtoull(argv[++i], nullptr, 10) * 1024;
+        } else if (arg == "--slow-consumer") {
+            std::string policy = argv[++i];
+            if (policy == "disconnect") {
+                config.slow_consumer_policy = SlowConsumerPolicy::DISCONNECT;
+            } else if (policy == "conflate") {
+                config.slow_consumer_policy = SlowConsumerPolicy::CONFLATE;
+            } else {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--drop-copy-history") {
+            config.drop_copy_history_path = argv[++i];
+        } else if (arg == "--drop-copy-history-size") {
+            config.drop_copy_history_capacity = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--risk-max-qty") {
+            config.risk.max_order_quantity = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--risk-max-notional") {
+            config.risk.max_order_notional = dollars_to_nanos(std::strtod(argv[++i], nullptr));
+        } else if (arg == "--risk-price-band-bps") {
+            config.risk.price_band_bps = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--risk-max-open-notional") {
+            config.risk.max_open_notional = dollars_to_nanos(std::strtod(argv[++i], nullptr));
+        } else if (arg == "--risk-max-position") {
+            config.risk.max_position = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--risk-max-orders-per-sec") {
+            config.risk.max_orders_per_second = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--self-trade-prevention") {
+            std::string mode = argv[++i];
+            if (mode == "none") {
+                config.self_trade_prevention = SelfTradePrevention::NONE;
+            } else if (mode == "cancel-resting") {
+                config.self_trade_prevention = SelfTradePrevention::CANCEL_RESTING;
+            } else if (mode == "cancel-aggressor") {
+                config.self_trade_prevention = SelfTradePrevention::CANCEL_AGGRESSOR;
+            } else if (mode == "cancel-both") {
+                config.self_trade_prevention = SelfTradePrevention::CANCEL_BOTH;
+            } else {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--session") {
+            if (!TradingSession::parse_schedule(argv[++i], config.session_schedule)) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--log-file") {
+            log_file = argv[++i];
+        } else if (arg == "--log-max-mb") {
+            log_max_bytes = std::strtoull(argv[++i], nullptr, 10) * 1024 * 1024;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    
     // Set up signal handler
     signal(SIGINT, signal_handler);
     
-    printf("[matching_engine] Initializing matching engine...\n");
+    async_logger().start(log_file, log_max_bytes);
+    LOG_INFO("[matching_engine] Initializing matching engine...\n");
     
     event_manager_t em;
     g_event_manager = &em;
     
-    MatchingEngine engine(bind_ip, multicast_ip, multicast_port);
-    engine.start(&em);
+    MatchingEngine engine(bind_ip, multicast_ip, multicast_port, config);
+    g_engine = &engine;
+    // A backup returns from start() only once it takes over, or stops without ever serving
+    if (!engine.start(&em)) {
+        engine.stop();
+        LOG_INFO("[matching_engine] Shutdown complete\n");
+        async_logger().stop();
+        return 1;
+    }
     
     printf("[matching_engine] Press CTRL-C to shutdown gracefully\n");
-    printf("[matching_engine] Order format: BUY:SYMBOL:QUANTITY:PRICE_NANOS\n");
+    printf("[matching_engine] Order format: BUY:SYMBOL:QUANTITY:PRICE_NANOS, one order per line\n");
     printf("[matching_engine]   Example: BUY:AAPL:100:150123456789 (for $150.123456789)\n");
+    printf("[matching_engine]   Order types: BUY:AAPL:100:MARKET, or append :IOC, :FOK or :POST (post-only) to a limit\n");
+    printf("[matching_engine]   Also: CANCEL:SYMBOL:ORDER_ID, REPLACE:SYMBOL:ORDER_ID:QTY:PRICE, MODIFY:SYMBOL:ORDER_ID:QTY (quantity down, keeps priority)\n");
+    printf("[matching_engine] Binary gateway: packed NEW/CANCEL/REPLACE/MODIFY messages by symbol or directory id (see order_entry_protocol.h)\n");
+    printf("[matching_engine] Multicast feed: binary level add/modify/delete and trade messages (see market_data_protocol.h)\n");
+    printf("[matching_engine] Drop copy: binary fill and order messages, FILTER:SYMBOL:X / FILTER:CLIENT:X / REPLAY:SEQ (see drop_copy_protocol.h)\n");
     printf("[matching_engine] MD Recovery format: SNAPSHOT:SYMBOL (e.g., SNAPSHOT:AAPL)\n");
+    printf("[matching_engine]   Gap fill: RETRANS:FIRST_SEQ:COUNT (e.g., RETRANS:1000:50)\n");
+    printf("[matching_engine]   Full depth: BOOK:L2:SYMBOL (levels) or BOOK:L3:SYMBOL (orders), SYMBOL * for all\n");
+    printf("[matching_engine]   Latency stats: STATS\n");
+    printf("[matching_engine]   Instrument ids, limits and phases: DIRECTORY\n");
+    printf("[matching_engine] Admin (127.0.0.1 port 8006 only):\n");
+    printf("[matching_engine]   Trading phase: PHASE:SYMBOL:STATE or PHASE:SYMBOL:RESUME (back to the schedule), SYMBOL * for all\n");
+printf("[matching_engine] Replication: backups connect to port 8005 and take over when the primary is lost (see replication_protocol.h)\n");
     printf("[matching_engine] Note: Prices are in nanos for maximum precision\n");
     
     em.run();
+    engine.stop();
+    g_engine = nullptr;
     
-    printf("[matching_engine] Shutdown complete\n");
+    LOG_INFO("[matching_engine] Shutdown complete\n");
+    async_logger().stop();
+    if (async_logger().get_dropped() > 0) {
+        printf("[matching_engine] Logger dropped %lu messages\n", async_logger().get_dropped());
+    }
     return 0;
 }
\ No newline at end of file
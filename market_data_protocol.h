@@ -0,0 +1,122 @@
+#pragma once
+#include <cstdint>
+#include "order_entry_protocol.h"
+
+// Incremental market data feed: fixed-layout, packed, little-endian messages
+// sent on the multicast group. Levels are keyed by (symbol, side, price);
+// a receiver applies ADD/MODIFY/DELETE to rebuild the top N levels per side.
+//
+// Every datagram starts with a PacketHeader. Each message carries an implicit
+// sequence number: header.sequence for the first, +1 for each that follows.
+// A gap in sequence numbers means loss; recover it on the MD recovery port with
+//   RETRANS:<first_sequence>:<count>
+// which replays the range as PacketHeader-framed packets, or, if the range has
+// aged out of the history, answers with SNAPSHOT packets: one per symbol, with
+// header.sequence set to the last sequence the image includes.
+//
+// SESSION_STATUS announces each phase change of a symbol. During an auction call
+// it is sent again whenever the indicative uncross moves, and the one that ends
+// the call gives the price and quantity the auction traded, after its TRADEs.
+//
+// Full-depth images of one symbol, or of all with *, are served on request:
+//   BOOK:L2:<symbol>    every price level
+//   BOOK:L3:<symbol>    every resting order
+// Each symbol's reply is a BookImageMsg followed by entry_count DEPTH_LEVEL or
+// ORDER_ENTRY messages, not packet framed. Entries come in no particular order:
+// sort levels by price, and orders by price then order_id, which is their time
+// priority (a replace takes a new id, a modify keeps it). The image includes every
+// feed message up to its sequence; the feed only carries the top levels, so
+// deeper ones are as of that sequence. An image with sequence 0 and no entries
+// was requested while the book was mid-update: ask for it again.
+enum class MdMsgType : uint8_t {
+    LEVEL_ADD = 'A',
+    LEVEL_MODIFY = 'M',
+    LEVEL_DELETE = 'D',
+    TRADE = 'T',
+    SNAPSHOT = 'S',
+    BOOK_IMAGE = 'B',
+    DEPTH_LEVEL = 'L',
+    ORDER_ENTRY = 'O',
+    SESSION_STATUS = 'P'
+};
+
+// Largest datagram the publisher builds, kept under a typical Ethernet MTU
+constexpr size_t kMaxPacketSize = 1400;
+// Deepest feed a level index and a snapshot's level counts can describe
+constexpr size_t kMaxMdDepth = UINT8_MAX;
+
+#pragma pack(push, 1)
+struct PacketHeader {
+    uint16_t length;                // whole packet including this header
+    uint8_t channel;
+    uint16_t message_count;
+    uint64_t sequence;              // sequence of the first message
+};
+
+struct LevelUpdateMsg {
+    MsgHeader header;
+    char symbol[kSymbolLength];     // NUL padded
+    uint8_t side;                   // OrderSide
+    uint8_t level;                  // position from the best price, 0 = best
+    uint64_t price;                 // nanos
+    uint64_t quantity;              // total resting quantity, 0 on delete
+    uint32_t order_count;
+};
+
+struct TradeMsg {
+    MsgHeader header;
+    char symbol[kSymbolLength];
+    uint64_t fill_id;
+    uint64_t quantity;
+    uint64_t price;
+    uint64_t timestamp;
+};
+
+struct SessionStatusMsg {
+    MsgHeader header;
+    char symbol[kSymbolLength];
+    uint8_t phase;                  // TradingState
+    uint8_t imbalance_side;         // OrderSide left with quantity at the price, 0 if none
+    uint64_t price;                 // 0 while the book does not cross
+    uint64_t matched_quantity;
+    uint64_t imbalance_quantity;
+};
+
+// Recovery only: replaces the symbol's book image; followed in the same packet
+// by bid_levels then ask_levels LEVEL_ADD messages, best first, and the
+// symbol's last SESSION_STATUS
+struct SymbolSnapshotMsg {
+    MsgHeader header;
+    char symbol[kSymbolLength];
+    uint64_t last_trade_price;
+    uint64_t last_trade_quantity;
+    uint8_t bid_levels;
+    uint8_t ask_levels;
+};
+
+struct BookImageMsg {
+    MsgHeader header;
+    char symbol[kSymbolLength];
+    uint64_t sequence;              // last feed message the image includes
+    uint8_t depth;                  // 2 = levels follow, 3 = orders follow
+    uint32_t entry_count;
+    uint64_t last_trade_price;
+    uint64_t last_trade_quantity;
+};
+
+struct DepthLevelMsg {
+    MsgHeader header;
+    uint8_t side;                   // OrderSide
+    uint64_t price;
+    uint64_t quantity;
+    uint32_t order_count;
+};
+
+struct OrderEntryMsg {
+    MsgHeader header;
+    uint8_t side;
+    uint64_t order_id;
+    uint64_t price;
+    uint64_t quantity;              // remaining
+};
+#pragma pack(pop)
@@ -1,116 +1,1253 @@
 #include "matching_engine.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
 #include <cstdio>
+#include <cstring>
+#include <functional>
+#include "replication_client.h"
+
+namespace {
+    // Backup standby: longest wait for records before checking for a stop, and the
+    // pause between attempts to reach the primary
+    constexpr int kStandbyPollMs = 100;
+    constexpr int kReconnectIntervalMs = 100;
+    // How often the output pump tops up replays and drains backlogs
+    constexpr int kOutputPumpIntervalMs = 1;
+    
+    // BACKLOG line of the STATS reply for one drop copy or MD recovery connection
+    void append_backlog_line(std::string& out, const std::string& subscriber, const SubscriberOutput& subscriber_output) {
+        char line[256];
+        const OutputQueue& output = subscriber_output.get_queue();
+        const OutputQueueStats& stats = output.get_stats();
+        int len = snprintf(line, sizeof(line),
+                "BACKLOG:%s:bytes=%zu:messages=%zu:high_water=%zu:sent_bytes=%lu:sent_messages=%lu:conflated=%lu\n",
+                subscriber.c_str(), output.backlog_bytes(), output.backlog_messages(), stats.high_water_bytes,
+                stats.sent_bytes, stats.sent_messages, stats.conflated);
+        out.append(line, std::min<size_t>(len, sizeof(line) - 1));
+    }
+}
 
 // MatchingEngine Constructor
 MatchingEngine::MatchingEngine(const std::string& bind_ip_param, 
-                               const std::string& mcast_ip, uint16_t mcast_port)
-    : bind_ip(bind_ip_param), multicast_ip(mcast_ip), multicast_port(mcast_port) {
+                               const std::string& mcast_ip, uint16_t mcast_port,
+                               const EngineConfig& engine_config)
+    : bind_ip(bind_ip_param), config(engine_config), md_history(engine_config.md_history_capacity),
+      multicast_ip(mcast_ip), multicast_port(mcast_port) {
     
     // Create servers
     order_gateway = std::make_unique<OrderGatewayServer>(this, order_gateway_port, bind_ip);
+    binary_gateway = std::make_unique<BinaryOrderGatewayServer>(this, binary_gateway_port, bind_ip);
     drop_copy_server = std::make_unique<DropCopyServer>(this, drop_copy_port, bind_ip);
     md_recovery_server = std::make_unique<MDRecoveryServer>(this, md_recovery_port, bind_ip);
+    admin_server = std::make_unique<AdminServer>(this, admin_port);
     
     // Create multicast publisher
-    multicast_publisher = std::make_unique<MulticastPublisher>(mcast_ip, mcast_port, bind_ip);
+    multicast_publisher = std::make_unique<MulticastPublisher>(mcast_ip, mcast_port, bind_ip, 1, config.md_max_hold_ns);
     
-    // Initialize some test symbols
-    order_books["AAPL"] = std::make_unique<OrderBook>("AAPL");
-    order_books["MSFT"] = std::make_unique<OrderBook>("MSFT");
-    order_books["TSLA"] = std::make_unique<OrderBook>("TSLA");
+    // Create matching shards
+    size_t shard_count = is_sharded() ? config.shard_count : 1;
+    for (size_t i = 0; i < shard_count; ++i) {
+        shards.push_back(std::make_unique<MatchingShard>(i, symbols, config.md_depth));
+    }
+    if (config.risk.enabled()) {
+        risk = std::make_unique<RiskManager>(config.risk, clients.capacity(), symbols.capacity());
+        for (auto& shard : shards) {
+            shard->set_risk(risk.get());
+        }
+    }
+    if (!config.checkpoint_path.empty()) {
+        if (config.journal_path.empty()) {
+            LOG_WARN("[matching_engine] Checkpoints need a journal; not taking any\n");
+        } else {
+            checkpoint_writer = std::make_unique<CheckpointWriter>(journal, config.checkpoint_path,
+                                                                   config.checkpoint_interval_ms);
+        }
+    }
+    if (config.replication_role == ReplicationRole::PRIMARY && config.journal_path.empty()) {
+        LOG_WARN("[matching_engine] A replication primary needs a journal; running standalone\n");
+        config.replication_role = ReplicationRole::NONE;
+    } else if (config.replication_role == ReplicationRole::BACKUP && config.replication_primary_host.empty()) {
+        LOG_WARN("[matching_engine] A replication backup needs a primary to follow; running standalone\n");
+        config.replication_role = ReplicationRole::NONE;
+    }
+    // A backup without a journal still follows, but cannot serve backups of its own
+    if (config.replication_role != ReplicationRole::NONE && !config.journal_path.empty()) {
+        replication_server = std::make_unique<ReplicationServer>(this, replication_port, bind_ip);
+    }
+    following.store(config.replication_role == ReplicationRole::BACKUP, std::memory_order_relaxed);
+    
+    if (config.instrument_path.empty()) {
+        // Initialize some test symbols
+        add_symbol("AAPL", BookConfig{});
+        add_symbol("MSFT", BookConfig{});
+        add_symbol("TSLA", BookConfig{});
+    } else {
+        std::vector<Instrument> directory;
+        if (InstrumentDirectory::load(config.instrument_path, directory)) {
+            for (const auto& instrument : directory) {
+                add_instrument(instrument);
+            }
+            LOG_INFO("[matching_engine] Loaded %zu instruments from %s\n", directory.size(),
+                     config.instrument_path.c_str());
+        } else {
+            LOG_ERROR("[matching_engine] No instruments loaded; every order will be rejected\n");
+        }
+    }
 }
 
-void MatchingEngine::start(event_manager_t* em) {
+MatchingEngine::~MatchingEngine() {
+    stop();
+}
+
+void MatchingEngine::add_symbol(const std::string& symbol, const BookConfig& book_config) {
+    Instrument instrument;
+    instrument.symbol = symbol;
+    instrument.book = book_config;
+    add_instrument(instrument);
+}
+
+// Ids are handed out in the order symbols are added, so a directory's ids follow the file
+void MatchingEngine::add_instrument(const Instrument& instrument) {
+    const std::string& symbol = instrument.symbol;
+    if (is_sharded() && started) {
+        LOG_WARN("[matching_engine] Cannot add %s: the symbol set is fixed once shards start\n", symbol.c_str());
+        return;
+    }
+    SymbolId id = symbols.intern(symbol);
+    if (id == StringInterner::kInvalidId) {
+        LOG_ERROR("[matching_engine] Symbol table full, cannot add %s\n", symbol.c_str());
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(md_mutex);
+        if (id >= md_images.size()) {
+            md_images.resize(id + 1);
+        }
+        md_images[id].top.symbol_id = id;
+        md_images[id].session.symbol_id = id;
+    }
+    if (id >= instruments.size()) {
+        instruments.resize(id + 1);
+        phases.resize(id + 1, TradingState::TRADING);
+    }
+    instruments[id] = instrument;
+    BookConfig& effective = instruments[id].book;
+    if (effective.self_trade_prevention == SelfTradePrevention::NONE) {
+        effective.self_trade_prevention = config.self_trade_prevention;
+    }
+    shard_for(id).add_book(id, effective);
+    if (checkpoint_writer) {
+        checkpoint_writer->add_symbol(symbol, effective);
+    }
+}
+
+bool MatchingEngine::start(event_manager_t* em) {
+    init_stage_metrics();
+    
+    if (!drop_copy_server->open_history(config.drop_copy_history_path, config.drop_copy_history_capacity)) {
+        LOG_WARN("[matching_engine] Continuing without drop copy replay\n");
+    }
+    
+    if (!config.journal_path.empty()) {
+        if (journal.open(config.journal_path, config.journal_capacity)) {
+            journal.start_group_commit(config.journal_sync_interval_ns);
+            BookCheckpoint::State checkpoint;
+            uint64_t restored_sequence = checkpoint_writer ? restore_checkpoint(checkpoint) : 0;
+            replay_journal(restored_sequence);
+            if (checkpoint_writer) {
+                checkpoint_writer->start(std::move(checkpoint));
+            }
+        } else {
+            LOG_WARN("[matching_engine] Continuing without a journal\n");
+            checkpoint_writer.reset();
+            if (replication_server) {
+                LOG_WARN("[matching_engine] Continuing without replication\n");
+                replication_server.reset();
+            }
+        }
+    }
+    
+    // Nothing is served while a backup follows, so the books are this thread's alone
+    if (config.replication_role == ReplicationRole::BACKUP && !follow_primary()) {
+        return false;
+    }
+    
+    if (is_sharded()) {
+        for (auto& shard : shards) {
+            size_t i = shard->get_index();
+            shard->start(i < config.shard_cores.size() ? config.shard_cores[i] : -1);
+        }
+        for (auto& shard : shards) {
+            while (!shard->is_ready()) {
+                std::this_thread::yield();
+            }
+        }
+        publishing.store(true, std::memory_order_release);
+        publisher_thread = std::thread(&MatchingEngine::run_publisher, this);
+    } else {
+        shards[0]->materialize();
+    }
+    started = true;
+    
     // Add all servers to event manager
     em->add_pollable(order_gateway.get());
+    em->add_pollable(binary_gateway.get());
     em->add_pollable(drop_copy_server.get());
     em->add_pollable(md_recovery_server.get());
-    em->add_pollable(multicast_publisher.get());
+    em->add_pollable(admin_server.get());
+em->add_pollable(multicast_publisher.get());
+    if (replication_server) {
+        em->add_pollable(replication_server.get());
+    }
+    pumping.store(true, std::memory_order_release);
+    output_pump_thread = std::thread(&MatchingEngine::run_output_pump, this);
+    
+    LOG_INFO("[matching_engine] Started on %s\n", bind_ip.c_str());
+    LOG_INFO("[matching_engine] Order Gateway:     port %d\n", order_gateway_port);
+    LOG_INFO("[matching_engine] Binary Gateway:    port %d\n", binary_gateway_port);
+    LOG_INFO("[matching_engine] Drop Copy:         port %d\n", drop_copy_port);
+    LOG_INFO("[matching_engine] Market Data:       port %d\n", md_recovery_port);
+    LOG_INFO("[matching_engine] Admin:             127.0.0.1 port %d\n", admin_port);
+LOG_INFO("[matching_engine] Multicast:         %s:%d\n", multicast_ip.c_str(), multicast_port);
+    if (replication_server) {
+        LOG_INFO("[matching_engine] Replication:       port %d (%s)\n", replication_port,
+                 config.replication_sync_backups > 0 ? "synchronous" : "asynchronous");
+    }
+    if (is_sharded()) {
+        LOG_INFO("[matching_engine] Matching shards:   %zu\n", shards.size());
+    }
+    open_session();
+    return true;
+}
+
+void MatchingEngine::stop() {
+    for (auto& shard : shards) {
+        shard->stop();
+    }
+    publishing.store(false, std::memory_order_release);
+    if (publisher_thread.joinable()) {
+        publisher_thread.join();
+    }
+    pumping.store(false, std::memory_order_release);
+    if (output_pump_thread.joinable()) {
+        output_pump_thread.join();
+    }
+    if (checkpoint_writer) {
+        // The last checkpoint covers everything journaled
+        journal.sync();
+        checkpoint_writer->stop();
+    }
+    
+    if (started) {
+        started = false;
+        const PublisherStats& stats = multicast_publisher->get_stats();
+        LOG_INFO("[matching_engine] Multicast: %lu messages in %lu packets over %lu send calls (%.1f msgs/packet, %.1f packets/call)\n",
+                 stats.messages, stats.packets, stats.send_calls,
+                 stats.packets ? static_cast<double>(stats.messages) / stats.packets : 0.0,
+                 stats.send_calls ? static_cast<double>(stats.packets) / stats.send_calls : 0.0);
+        if (stats.dropped_packets > 0) {
+            LOG_WARN("[matching_engine] Multicast: %lu packets dropped on send\n", stats.dropped_packets);
+        }
+    }
+}
+
+SymbolId MatchingEngine::find_symbol(std::string_view symbol) const {
+    return symbols.find(symbol);
+}
+
+// Journal replay only: orders never create books. Without a directory, a journal
+// may name symbols from before that rule, and they come back with a default book
+SymbolId MatchingEngine::find_or_add_symbol(std::string_view symbol) {
+    SymbolId id = find_symbol(symbol);
+    if (id == StringInterner::kInvalidId && !symbol.empty() && config.instrument_path.empty()) {
+        add_symbol(std::string(symbol), BookConfig{});
+        id = find_symbol(symbol);
+    }
+    return id;
+}
+
+// Parses a decimal field in place; rejects empty, signed or trailing-garbage input instead of throwing
+static bool parse_u64(std::string_view field, uint64_t& value) {
+    if (field.empty()) {
+        return false;
+    }
+    auto result = std::from_chars(field.data(), field.data() + field.size(), value);
+    return result.ec == std::errc() && result.ptr == field.data() + field.size();
+}
+
+bool MatchingEngine::decode_text_order(ClientId client, std::string_view order_msg, OrderRequest& request) {
+    if (client == StringInterner::kInvalidId) {
+        return false;
+    }
+    LOG_DEBUG("[matching_engine] Order from %s: %s\n", clients.name(client).c_str(),
+              std::string(order_msg).c_str());
+    
+    if (!parse_text_order(order_msg, request)) {
+        LOG_WARN("[matching_engine] Invalid order or unknown symbol from %s\n", clients.name(client).c_str());
+        return false;
+    }
+    request.client_id = client;
+    return true;
+}
+
+// Text order entry, one command per line:
+//   BUY|SELL:SYMBOL:QTY:PRICE[:TIF]       new limit order; TIF is IOC, FOK or POST (post-only)
+//   BUY|SELL:SYMBOL:QTY:MARKET            new market order
+//   CANCEL:SYMBOL:ORDER_ID
+//   REPLACE:SYMBOL:ORDER_ID:QTY:PRICE     cancel and new; loses time priority
+//   MODIFY:SYMBOL:ORDER_ID:QTY            reduce remaining quantity to QTY in place
+bool MatchingEngine::parse_text_order(std::string_view order_msg, OrderRequest& request) {
+    // Split on ':' without copying
+    constexpr size_t kMaxParts = 5;
+    std::string_view parts[kMaxParts];
+    size_t count = 0;
+    size_t start = 0;
+    while (true) {
+        size_t end = order_msg.find(':', start);
+        if (count == kMaxParts) {
+            return false;
+        }
+        parts[count++] = order_msg.substr(start, end - start);
+        if (end == std::string_view::npos) {
+            break;
+        }
+        start = end + 1;
+    }
+    
+    SymbolId symbol_id = StringInterner::kInvalidId;
+    if (parts[0] == "BUY" || parts[0] == "SELL") {
+        if (count < 4 || !parse_u64(parts[2], request.quantity) || request.quantity == 0) {
+            return false;
+        }
+        if (parts[3] == "MARKET") {
+            if (count != 4) {
+                return false;
+            }
+            request.order_type = OrderType::MARKET;
+            request.price = 0;
+        } else {
+            if (!parse_u64(parts[3], request.price)) {
+                return false;
+            }
+            if (count == 4) {
+                request.order_type = OrderType::LIMIT;
+            } else if (parts[4] == "IOC") {
+                request.order_type = OrderType::IOC;
+            } else if (parts[4] == "FOK") {
+                request.order_type = OrderType::FOK;
+            } else if (parts[4] == "POST") {
+                request.order_type = OrderType::POST_ONLY;
+            } else {
+                return false;
+            }
+        }
+        request.type = RequestType::NEW_ORDER;
+        request.side = (parts[0] == "BUY") ? OrderSide::BUY : OrderSide::SELL;
+        symbol_id = find_symbol(parts[1]);
+    } else if (parts[0] == "CANCEL") {
+        if (count != 3 || !parse_u64(parts[2], request.orig_order_id)) {
+            return false;
+        }
+        request.type = RequestType::CANCEL_ORDER;
+        symbol_id = find_symbol(parts[1]);
+    } else if (parts[0] == "REPLACE") {
+        if (count != 5 || !parse_u64(parts[2], request.orig_order_id) || !parse_u64(parts[3], request.quantity) ||
+            !parse_u64(parts[4], request.price) || request.quantity == 0) {
+            return false;
+        }
+        request.type = RequestType::REPLACE_ORDER;
+        symbol_id = find_symbol(parts[1]);
+    } else if (parts[0] == "MODIFY") {
+        if (count != 4 || !parse_u64(parts[2], request.orig_order_id) || !parse_u64(parts[3], request.quantity)) {
+            return false;
+        }
+        request.type = RequestType::MODIFY_ORDER;
+        symbol_id = find_symbol(parts[1]);
+    } else {
+        return false;
+    }
+    
+    if (symbol_id == StringInterner::kInvalidId) {
+        return false;
+    }
+    request.symbol_id = symbol_id;
+    return true;
+}
+
+// Field checks shared by the named and id-only form of each binary message
+namespace {
+    template<typename Msg>
+    bool decode_new_order(const Msg* msg, bool has_type, OrderRequest& request) {
+        if (msg->side != static_cast<uint8_t>(OrderSide::BUY) && msg->side != static_cast<uint8_t>(OrderSide::SELL)) {
+            return false;
+        }
+        if (msg->quantity == 0) {
+            return false;
+        }
+        if (has_type && (msg->order_type < static_cast<uint8_t>(OrderType::MARKET) ||
+                         msg->order_type > static_cast<uint8_t>(OrderType::POST_ONLY))) {
+            return false;
+        }
+        request.type = RequestType::NEW_ORDER;
+        request.order_type = has_type ? static_cast<OrderType>(msg->order_type) : OrderType::LIMIT;
+        request.side = static_cast<OrderSide>(msg->side);
+        request.quantity = msg->quantity;
+        request.price = msg->price;
+        return true;
+    }
+    
+    template<typename Msg>
+    bool decode_cancel_order(const Msg* msg, OrderRequest& request) {
+        request.type = RequestType::CANCEL_ORDER;
+        request.orig_order_id = msg->order_id;
+        return true;
+    }
+    
+    template<typename Msg>
+    bool decode_replace_order(const Msg* msg, OrderRequest& request) {
+        if (msg->quantity == 0) {
+            return false;
+        }
+        request.type = RequestType::REPLACE_ORDER;
+        request.orig_order_id = msg->order_id;
+        request.quantity = msg->quantity;
+        request.price = msg->price;
+        return true;
+    }
+    
+    template<typename Msg>
+    bool decode_modify_order(const Msg* msg, OrderRequest& request) {
+        request.type = RequestType::MODIFY_ORDER;
+        request.orig_order_id = msg->order_id;
+        request.quantity = msg->quantity;
+        return true;
+    }
+}
+
+bool MatchingEngine::decode_binary_message(ClientId client, const MsgHeader* header, OrderRequest& request) {
+    if (client == StringInterner::kInvalidId) {
+        return false;
+    }
+    request.client_id = client;
+    SymbolId symbol_id = StringInterner::kInvalidId;
+    
+    switch (static_cast<MsgType>(header->msg_type)) {
+        case MsgType::NEW_ORDER: {
+            // Messages from before order_type was added end just ahead of it and are limits
+            bool has_type = header->length == sizeof(NewOrderMsg);
+            if (!has_type && header->length != offsetof(NewOrderMsg, order_type)) break;
+            const auto* msg = reinterpret_cast<const NewOrderMsg*>(header);
+            if (decode_new_order(msg, has_type, request)) symbol_id = find_symbol(symbol_view(msg->symbol));
+            break;
+        }
+        case MsgType::CANCEL_ORDER: {
+            if (header->length != sizeof(CancelOrderMsg)) break;
+            const auto* msg = reinterpret_cast<const CancelOrderMsg*>(header);
+            if (decode_cancel_order(msg, request)) symbol_id = find_symbol(symbol_view(msg->symbol));
+            break;
+        }
+        case MsgType::REPLACE_ORDER: {
+            if (header->length != sizeof(ReplaceOrderMsg)) break;
+            const auto* msg = reinterpret_cast<const ReplaceOrderMsg*>(header);
+            if (decode_replace_order(msg, request)) symbol_id = find_symbol(symbol_view(msg->symbol));
+            break;
+        }
+        case MsgType::MODIFY_ORDER: {
+            if (header->length != sizeof(ModifyOrderMsg)) break;
+            const auto* msg = reinterpret_cast<const ModifyOrderMsg*>(header);
+            if (decode_modify_order(msg, request)) symbol_id = find_symbol(symbol_view(msg->symbol));
+            break;
+        }
+        case MsgType::NEW_ORDER_BY_ID: {
+            if (header->length != sizeof(NewOrderByIdMsg)) break;
+            const auto* msg = reinterpret_cast<const NewOrderByIdMsg*>(header);
+            if (decode_new_order(msg, true, request)) symbol_id = symbol_by_id(msg->symbol_id);
+            break;
+        }
+        case MsgType::CANCEL_ORDER_BY_ID: {
+            if (header->length != sizeof(CancelOrderByIdMsg)) break;
+            const auto* msg = reinterpret_cast<const CancelOrderByIdMsg*>(header);
+            if (decode_cancel_order(msg, request)) symbol_id = symbol_by_id(msg->symbol_id);
+            break;
+        }
+        case MsgType::REPLACE_ORDER_BY_ID: {
+            if (header->length != sizeof(ReplaceOrderByIdMsg)) break;
+            const auto* msg = reinterpret_cast<const ReplaceOrderByIdMsg*>(header);
+            if (decode_replace_order(msg, request)) symbol_id = symbol_by_id(msg->symbol_id);
+            break;
+        }
+        case MsgType::MODIFY_ORDER_BY_ID: {
+            if (header->length != sizeof(ModifyOrderByIdMsg)) break;
+            const auto* msg = reinterpret_cast<const ModifyOrderByIdMsg*>(header);
+            if (decode_modify_order(msg, request)) symbol_id = symbol_by_id(msg->symbol_id);
+            break;
+        }
+    }
+    
+    if (symbol_id == StringInterner::kInvalidId) {
+        LOG_WARN("[matching_engine] Invalid binary message type %u length %u or unknown symbol from %s\n",
+               header->msg_type, header->length, clients.name(client).c_str());
+        return false;
+    }
+    
+    request.symbol_id = symbol_id;
+    return true;
+}
+
+void MatchingEngine::process_request(const OrderRequest& request) {
+    process_batch(&request, 1);
+}
+
+// Sequences and risk-checks every request, then either matches the batch inline
+// and flushes drop copy and market data once, or hands each request to its
+// symbol's shard. Instrument, risk and journal-full rejections still go to the
+// shard, which reports them on drop copy, but are not journaled. With synchronous replication the requests
+// are held, in order, until enough backups acknowledge their journal records.
+void MatchingEngine::process_batch(const OrderRequest* requests, size_t count) {
+    uint64_t now = (risk || !config.session_schedule.empty()) ? get_current_timestamp() : 0;
+    if (now >= next_session_change) {
+        advance_session(now);
+    }
+    for (size_t i = 0; i < count; ++i) {
+        sequence(requests[i], now);
+    }
+    
+    // Without a group-commit interval every batch is durable before it is acked
+    if (journal.is_open() && config.journal_sync_interval_ns == 0) {
+        journal.sync();
+    }
+    if (replication_server) {
+        replication_server->flush();
+        release_replicated();
+    }
     
-    printf("[matching_engine] Started on %s\n", bind_ip.c_str());
-    printf("[matching_engine] Order Gateway:     port %d\n", order_gateway_port);
-    printf("[matching_engine] Drop Copy:         port %d\n", drop_copy_port);
-    printf("[matching_engine] Market Data:       port %d\n", md_recovery_port);
-    printf("[matching_engine] Multicast:         %s:%d\n", multicast_ip.c_str(), multicast_port);
+    if (!is_sharded()) {
+        shards[0]->end_batch();
+        publish_events(shards[0]->pending_events());
+    }
 }
 
-void MatchingEngine::process_order_request(const std::string& client_id, const std::string& order_msg) {
-    printf("[matching_engine] Order from %s: %s\n", client_id.c_str(), order_msg.c_str());
+// One request of a batch: id, checks, journal, then match or hold
+void MatchingEngine::sequence(OrderRequest request, uint64_t now) {
+    // Cancel and modify act on the existing order and take no new id
+    if (request.type == RequestType::NEW_ORDER || request.type == RequestType::REPLACE_ORDER) {
+        request.order_id = next_order_id++;
+    }
     
-    // Parse order message
-    std::vector<std::string> parts;
-    std::stringstream ss(order_msg);
-    std::string part;
-    while (std::getline(ss, part, ':')) {
-        parts.push_back(part);
+    request.reject_reason = check_instrument(request);
+    if (request.reject_reason != RejectReason::NONE) {
+        LOG_DEBUG("[matching_engine] Rejected order %lu from %s: %s\n", request.order_id,
+                  clients.name(request.client_id).c_str(), reject_reason_name(request.reject_reason));
+    } else if (risk) {
+        request.reject_reason = risk->check(request, now);
+        if (request.reject_reason != RejectReason::NONE) {
+            LOG_DEBUG("[risk] Rejected order %lu from %s: %s\n", request.order_id,
+                      clients.name(request.client_id).c_str(), reject_reason_name(request.reject_reason));
+        }
     }
     
-    if (parts.size() != 4) {
-        printf("[matching_engine] Invalid order format from %s\n", client_id.c_str());
+    // Write-ahead: a command that cannot be journaled is not executed, and its
+    // client gets the rejection from the shard like any other
+    if (journal.is_open() && request.reject_reason == RejectReason::NONE &&
+        !journal.append(request, symbols.name(request.symbol_id), clients.name(request.client_id))) {
+        LOG_ERROR("[matching_engine] Journal full, rejecting request from %s\n", clients.name(request.client_id).c_str());
+        if (risk && (request.type == RequestType::NEW_ORDER || request.type == RequestType::REPLACE_ORDER)) {
+            risk->settle(request);
+        }
+        // A phase change has no client to tell; the symbol stays where it is
+        if (request.type == RequestType::SESSION_PHASE) {
+            return;
+        }
+        request.reject_reason = RejectReason::JOURNAL;
+    } else if (request.type == RequestType::SESSION_PHASE) {
+        phases[request.symbol_id] = request.phase;
+    }
+    
+    if (replication_server && config.replication_sync_backups > 0) {
+        replication_held.push_back(HeldRequest{journal.last_sequence(), request});
+    } else {
+        dispatch(request);
+    }
+}
+
+// Instrument limits: a halted or closed symbol takes only cancels and modifies, and
+// before the open or during a call only orders that can rest; every quantity must be
+// in whole lots and every limit price on the tick and in the band
+RejectReason MatchingEngine::check_instrument(const OrderRequest& request) const {
+    const Instrument& instrument = instruments[request.symbol_id];
+    if (request.type == RequestType::CANCEL_ORDER || request.type == RequestType::SESSION_PHASE) {
+        return RejectReason::NONE;
+    }
+    if (instrument.lot_size != 0 && request.quantity % instrument.lot_size != 0) {
+        return RejectReason::LOT_SIZE;
+    }
+    if (request.type == RequestType::MODIFY_ORDER) {
+        return RejectReason::NONE;
+    }
+    switch (phases[request.symbol_id]) {
+        case TradingState::TRADING:
+            break;
+        case TradingState::HALTED:
+            return RejectReason::HALTED;
+        case TradingState::CLOSED:
+            return RejectReason::SESSION;
+        case TradingState::PRE_OPEN:
+        case TradingState::OPENING_AUCTION:
+        case TradingState::CLOSING_AUCTION:
+            // Nothing matches until the uncross, so an order must be able to wait for it
+            if (request.order_type != OrderType::LIMIT && request.order_type != OrderType::POST_ONLY) {
+                return RejectReason::SESSION;
+            }
+            break;
+    }
+    if (request.order_type == OrderType::MARKET) {
+        return RejectReason::NONE;
+    }
+    const BookConfig& book = instrument.book;
+    if (book.tick_size != 0 && request.price % book.tick_size != 0) {
+        return RejectReason::TICK_SIZE;
+    }
+    if (book.max_price != 0 && (request.price < book.min_price || request.price > book.max_price)) {
+        return RejectReason::PRICE_BAND;
+    }
+    return RejectReason::NONE;
+}
+
+// Puts every symbol where the directory and the schedule want it once the books
+// are live. A halt from the directory always holds; otherwise a symbol that
+// replay left halted stays halted, and the rest follow the schedule
+void MatchingEngine::open_session() {
+    if (!config.session_schedule.empty()) {
+        scheduled_phase = TradingSession::phase_at(config.session_schedule, get_current_timestamp(),
+                                                   next_session_change);
+    }
+    std::vector<OrderRequest> changes;
+    for (SymbolId id = 0; id < instruments.size(); ++id) {
+        TradingState target = phases[id];
+        if (instruments[id].state == TradingState::HALTED) {
+            target = TradingState::HALTED;
+        } else if (phases[id] != TradingState::HALTED && !config.session_schedule.empty()) {
+            target = scheduled_phase;
+        }
+        if (target != phases[id]) {
+            changes.push_back(session_request(id, target));
+        }
+    }
+    if (!changes.empty()) {
+        process_batch(changes.data(), changes.size());
+    }
+    if (!config.session_schedule.empty()) {
+        LOG_INFO("[session] Opened in %s, %zu symbols changed phase\n", TradingSession::state_name(scheduled_phase),
+                 changes.size());
+    }
+}
+
+// The event loop has no timers, so a scheduled change takes effect with the first
+// batch sequenced after its time; halted symbols wait for an admin to resume them
+void MatchingEngine::advance_session(uint64_t now) {
+    TradingState phase = TradingSession::phase_at(config.session_schedule, now, next_session_change);
+    if (phase == scheduled_phase) {
+        return;
+    }
+    scheduled_phase = phase;
+    size_t changed = 0;
+    for (SymbolId id = 0; id < phases.size(); ++id) {
+        if (phases[id] != TradingState::HALTED && phases[id] != phase) {
+            sequence(session_request(id, phase), now);
+            changed++;
+        }
+    }
+    LOG_INFO("[session] %s: %zu symbols changed phase\n", TradingSession::state_name(phase), changed);
+}
+
+void MatchingEngine::change_phase(const std::vector<SymbolId>& symbol_ids, TradingState phase) {
+    std::vector<OrderRequest> changes;
+    for (SymbolId id : symbol_ids) {
+        if (phases[id] != phase) {
+            changes.push_back(session_request(id, phase));
+        }
+    }
+    if (!changes.empty()) {
+        process_batch(changes.data(), changes.size());
+    }
+}
+
+OrderRequest MatchingEngine::session_request(SymbolId symbol_id, TradingState phase) {
+    OrderRequest request;
+    request.type = RequestType::SESSION_PHASE;
+    request.symbol_id = symbol_id;
+    request.client_id = clients.intern(TradingSession::kClient);
+    request.phase = phase;
+    return request;
+}
+
+void MatchingEngine::dispatch(const OrderRequest& request) {
+    if (is_sharded()) {
+        shard_for(request.symbol_id).inbound.push(request);
+    } else {
+        shards[0]->execute(request);
+    }
+}
+
+// Matches the held requests that enough backups now hold
+void MatchingEngine::release_replicated() {
+    if (replication_held.empty()) {
+        return;
+    }
+    uint64_t confirmed = replication_server->confirmed_sequence(config.replication_sync_backups,
+                                                                journal.last_sequence());
+    while (!replication_held.empty() && replication_held.front().sequence <= confirmed) {
+        dispatch(replication_held.front().request);
+        replication_held.pop_front();
+    }
+}
+
+// An acknowledgement or a lost backup can release held requests; inline, their
+// events go out as a batch of their own
+void MatchingEngine::on_replication_progress() {
+    if (replication_held.empty()) {
         return;
     }
+    release_replicated();
+    if (!is_sharded()) {
+        shards[0]->end_batch();
+        publish_events(shards[0]->pending_events());
+    }
+}
+
+// Loads the checkpoint into the books and the market data image; returns the
+// journal sequence it covers, or 0 to replay the whole journal. checkpoint is left
+// holding what was loaded, for the checkpoint writer to start from.
+uint64_t MatchingEngine::restore_checkpoint(BookCheckpoint::State& checkpoint) {
+    uint64_t start_ts = get_current_timestamp();
+    if (!BookCheckpoint::read(config.checkpoint_path, checkpoint)) {
+        return 0;
+    }
+    if (checkpoint.journal_sequence > journal.last_sequence()) {
+        LOG_WARN("[matching_engine] Checkpoint %s is at journal sequence %lu but the journal ends at %lu; "
+                 "replaying the whole journal\n", config.checkpoint_path.c_str(), checkpoint.journal_sequence,
+                 journal.last_sequence());
+        checkpoint = BookCheckpoint::State();
+        return 0;
+    }
     
-    OrderSide side = (parts[0] == "BUY") ? OrderSide::BUY : OrderSide::SELL;
-    std::string symbol = parts[1];
-    uint64_t quantity = std::stoull(parts[2]);
-    uint64_t price_nanos = std::stoull(parts[3]);
+    // A directory decides the universe and each book's configuration; without one
+    // the checkpoint's symbols come back as they were
+    std::vector<SymbolId> symbol_ids;
+    for (const auto& symbol : checkpoint.symbols) {
+        if (config.instrument_path.empty()) {
+            add_symbol(symbol.name, symbol.config);
+        }
+        symbol_ids.push_back(find_symbol(symbol.name));
+        if (symbol_ids.back() == StringInterner::kInvalidId && !symbol.orders.empty()) {
+            LOG_WARN("[matching_engine] Dropping %zu checkpointed orders on %s: not in the instrument directory\n",
+                     symbol.orders.size(), symbol.name.c_str());
+        }
+    }
+    std::vector<ClientId> client_ids;
+    for (const auto& client : checkpoint.clients) {
+        client_ids.push_back(clients.intern(client));
+    }
+    for (auto& shard : shards) {
+        shard->materialize();
+    }
     
-    // Log order with dollar conversion
-    printf("[matching_engine] Processing %s %lu %s at $%.9f (%lu nanos)\n", 
-           (side == OrderSide::BUY) ? "BUY" : "SELL", 
-           quantity, symbol.c_str(), 
-           nanos_to_dollars(price_nanos), price_nanos);
+    size_t restored = 0;
+    std::vector<Order> orders;
+    for (size_t i = 0; i < checkpoint.symbols.size(); ++i) {
+        SymbolId symbol_id = symbol_ids[i];
+        if (symbol_id == StringInterner::kInvalidId) {
+            continue;
+        }
+        const BookCheckpoint::SymbolState& symbol = checkpoint.symbols[i];
+        orders = symbol.orders;
+        for (auto& order : orders) {
+            order.symbol_id = symbol_id;
+            order.client_id = client_ids[order.client_id];
+        }
+        restored += shard_for(symbol_id).restore_book(symbol_id, symbol.next_fill_id, symbol.phase, orders);
+        phases[symbol_id] = symbol.phase;
+        
+        SymbolImage& image = md_images[symbol_id];
+        image.session.phase = symbol.phase;
+        image.top.last_trade_price = symbol.last_trade_price;
+        image.top.last_trade_quantity = symbol.last_trade_quantity;
+        for (const auto& order : orders) {
+            image.book.apply_order(order);
+        }
+        if (risk && symbol.last_trade_price) {
+            risk->restore_last_trade(symbol_id, symbol.last_trade_price);
+        }
+    }
+    if (risk) {
+        for (const auto& position : checkpoint.positions) {
+            if (symbol_ids[position.symbol] != StringInterner::kInvalidId) {
+                risk->restore_position(client_ids[position.client], symbol_ids[position.symbol], position.position);
+            }
+        }
+    }
+    next_order_id = std::max(next_order_id, checkpoint.next_order_id);
     
-    if (order_books.find(symbol) == order_books.end()) {
-        order_books[symbol] = std::make_unique<OrderBook>(symbol);
+    uint64_t elapsed_ns = get_current_timestamp() - start_ts;
+    LOG_INFO("[matching_engine] Restored %s at journal sequence %lu: %zu symbols, %zu orders in %.3f ms\n",
+             config.checkpoint_path.c_str(), checkpoint.journal_sequence, checkpoint.symbols.size(), restored,
+             elapsed_ns / 1e6);
+    return checkpoint.journal_sequence;
+}
+
+// Rebuilds every book by running the journal after after_sequence back through the
+// shards with output suppressed; only the resulting market data image is kept, for
+// MD recovery
+void MatchingEngine::replay_journal(uint64_t after_sequence) {
+    for (auto& shard : shards) {
+        shard->materialize();
+        shard->set_logging(false);
     }
     
-    auto order = std::make_shared<Order>(next_order_id++, symbol, side, OrderType::LIMIT, quantity, price_nanos, client_id);
-    auto fills = order_books[symbol]->add_order(order);
+    uint64_t start_ts = get_current_timestamp();
+    size_t count = journal.replay([this](const OrderJournal::Record& record) {
+        apply_journal_record(record);
+    }, after_sequence);
+    settle_replayed_books();
+    for (auto& shard : shards) {
+        shard->set_logging(true);
+    }
     
-    // Broadcast order update
-    drop_copy_server->broadcast_order_update(*order);
+    uint64_t elapsed_ns = get_current_timestamp() - start_ts;
+    LOG_INFO("[matching_engine] Replayed %zu journal records after sequence %lu in %.3f ms (%.2fM records/s)\n",
+             count, after_sequence, elapsed_ns / 1e6, elapsed_ns ? count * 1e3 / elapsed_ns : 0.0);
+}
+
+// Replay and backup standby: matches one journaled command on the calling thread
+// before the shards start, keeping only its effect on the market data image
+void MatchingEngine::apply_journal_record(const OrderJournal::Record& record) {
+    OrderRequest request = OrderJournal::to_request(record);
+    request.symbol_id = find_or_add_symbol(symbol_view(record.symbol));
+    request.client_id = clients.intern(OrderJournal::client_view(record.client));
+    if (request.symbol_id == StringInterner::kInvalidId || request.client_id == StringInterner::kInvalidId) {
+        LOG_WARN("[matching_engine] Skipping journal record %lu: unknown symbol or client table full\n",
+                 record.sequence);
+        return;
+    }
     
-    // Broadcast fills
-    for (const auto& fill : fills) {
-        printf("[matching_engine] Fill: %lu shares at $%.9f (%lu nanos)\n", 
-               fill.quantity, nanos_to_dollars(fill.price), fill.price);
-        drop_copy_server->broadcast_fill(fill);
+    // Rebuilds exposure too: the shard settles what the gateway would have reserved
+    if (risk && (request.type == RequestType::NEW_ORDER || request.type == RequestType::REPLACE_ORDER)) {
+        request.risk_price = risk->valuation_price(request);
+        risk->reserve(request);
+    }
+    if (request.type == RequestType::SESSION_PHASE) {
+        phases[request.symbol_id] = request.phase;
+    }
+    MatchingShard& shard = shard_for(request.symbol_id);
+    shard.execute(request);
+    for (const auto& event : shard.pending_events()) {
+        if (event.type == EventType::FILL) {
+            MarketDataSnapshot& top = md_images[event.fill.symbol_id].top;
+            top.last_trade_price = event.fill.price;
+            top.last_trade_quantity = event.fill.quantity;
+            md_images[event.fill.symbol_id].book.apply_fill(event.fill);
+        } else if (event.type == EventType::ORDER_UPDATE) {
+            md_images[event.order.symbol_id].book.apply_order(event.order);
+        } else if (event.type == EventType::SESSION_UPDATE) {
+            md_images[event.session.symbol_id].session = event.session;
+        }
+    }
+    shard.pending_events().clear();
+    next_order_id = std::max(next_order_id, request.order_id + 1);
+}
+
+// Closes a run of apply_journal_record calls: folds the books' depth into the
+// market data image and drops the suppressed events
+void MatchingEngine::settle_replayed_books() {
+    for (auto& shard : shards) {
+        shard->end_batch();
+        std::lock_guard<std::mutex> lock(md_mutex);
+        for (const auto& event : shard->pending_events()) {
+            if (event.type == EventType::LEVEL_UPDATE) {
+                apply_level_update(md_images[event.level.symbol_id], event.level);
+            } else if (event.type == EventType::BOOK_UPDATE) {
+                md_images[event.snapshot.symbol_id].book.settle();
+                MarketDataSnapshot& top = md_images[event.snapshot.symbol_id].top;
+                top.bid_price = event.snapshot.bid_price;
+                top.bid_quantity = event.snapshot.bid_quantity;
+                top.ask_price = event.snapshot.ask_price;
+                top.ask_quantity = event.snapshot.ask_quantity;
+                top.timestamp = event.snapshot.timestamp;
+            } else if (event.type == EventType::SESSION_UPDATE) {
+                md_images[event.session.symbol_id].session = event.session;
+            }
+        }
+        shard->pending_events().clear();
+    }
+}
+
+// Backup standby: applies the primary's records as they arrive, the same way
+// startup replays the journal, appends them to this engine's own journal if it has
+// one, and acknowledges each batch. Returns true to take over from the state built
+// so far, false if stopped or the primary's stream cannot be followed.
+bool MatchingEngine::follow_primary() {
+    for (auto& shard : shards) {
+        shard->materialize();
+        shard->set_logging(false);
+    }
+    
+    ReplicationClient client(config.replication_primary_host, config.replication_primary_port);
+    std::vector<OrderJournal::Record> records;
+    uint64_t applied = journal.is_open() ? journal.last_sequence() : 0;
+    bool take_over = false;
+    while (following.load(std::memory_order_acquire)) {
+        if (!client.is_connected() && !client.connect(applied)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(kReconnectIntervalMs));
+            continue;
+        }
+        
+        records.clear();
+        ReplicationClient::Status status = client.receive(records, kStandbyPollMs);
+        if (status == ReplicationClient::Status::RECORDS) {
+            for (const auto& record : records) {
+                if (journal.is_open() && !journal.append_record(record)) {
+                    LOG_ERROR("[replication] Journal full at sequence %lu; no longer following\n", applied);
+                    following.store(false, std::memory_order_release);
+                    break;
+                }
+                apply_journal_record(record);
+                applied = record.sequence;
+            }
+            settle_replayed_books();
+            if (journal.is_open() && config.journal_sync_interval_ns == 0) {
+                journal.sync();
+            }
+            client.ack(applied);
+        } else if (status == ReplicationClient::Status::LOST) {
+            if (client.is_synchronized() && config.replication_failover) {
+                LOG_WARN("[replication] Taking over from the primary at sequence %lu\n", applied);
+                take_over = true;
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(kReconnectIntervalMs));
+        } else if (status == ReplicationClient::Status::FAILED) {
+            break;
+        }
+    }
+    
+    for (auto& shard : shards) {
+        shard->set_logging(true);
+    }
+    if (!take_over) {
+        LOG_WARN("[replication] Stopped following at sequence %lu\n", applied);
+    }
+    return take_over;
+}
+
+void MatchingEngine::publish_events(std::vector<ExecutionEvent>& events) {
+    for (const auto& event : events) {
+        publish_event(event);
+    }
+    events.clear();
+    drop_copy_server->flush();
+    md_recovery_server->flush();
+    admin_server->flush();
+    multicast_publisher->flush();
+    
+    if (config.stats_interval_ms > 0) {
+        uint64_t now = get_current_timestamp();
+        if (now - last_stats_dump_ts >= config.stats_interval_ms * 1000000) {
+            last_stats_dump_ts = now;
+            // One statement per line keeps each within the logger's record size
+            std::string report = format_stage_report();
+            for (size_t start = 0; start < report.size(); ) {
+                size_t end = report.find('\n', start);
+                if (end == std::string::npos) end = report.size();
+                LOG_INFO("%s\n", report.substr(start, end - start).c_str());
+                start = end + 1;
+            }
+        }
+    }
+}
+
+void MatchingEngine::publish_event(const ExecutionEvent& event) {
+    switch (event.type) {
+        case EventType::ORDER_UPDATE: {
+            drop_copy_server->broadcast_order_update(event.order);
+            std::lock_guard<std::mutex> lock(md_mutex);
+            md_images[event.order.symbol_id].book.apply_order(event.order);
+            break;
+        }
+        case EventType::FILL:
+            LOG_DEBUG("[matching_engine] Fill: %lu shares at $%.9f (%lu nanos)\n", 
+                   event.fill.quantity, nanos_to_dollars(event.fill.price), event.fill.price);
+            drop_copy_server->broadcast_fill(event.fill);
+            publish_trade(event.fill);
+            break;
+        case EventType::BOOK_UPDATE: {
+            std::lock_guard<std::mutex> lock(md_mutex);
+            // Closes the symbol's batch: its feed messages are all out
+            md_images[event.snapshot.symbol_id].book.settle();
+            MarketDataSnapshot& cached = md_images[event.snapshot.symbol_id].top;
+            cached.bid_price = event.snapshot.bid_price;
+            cached.bid_quantity = event.snapshot.bid_quantity;
+            cached.ask_price = event.snapshot.ask_price;
+            cached.ask_quantity = event.snapshot.ask_quantity;
+            cached.timestamp = event.snapshot.timestamp;
+            break;
+        }
+        case EventType::LEVEL_UPDATE:
+            publish_level_update(event.level);
+            break;
+        case EventType::SESSION_UPDATE:
+            publish_session_status(event.session);
+            break;
     }
+}
+
+// Sharded mode: drains every shard's outbound ring and publishes on this thread
+void MatchingEngine::run_publisher() {
+    pin_thread_to_core(config.publisher_core);
+    std::vector<ExecutionEvent> events;
+    events.reserve(MatchingShard::kMaxBatch * 4);
+    ExecutionEvent event;
     
-    // Publish market data
-    auto snapshot = order_books[symbol]->get_snapshot();
-    publish_market_data(snapshot);
+    while (publishing.load(std::memory_order_acquire)) {
+        for (auto& shard : shards) {
+            while (events.size() < events.capacity() && shard->outbound.try_pop(event)) {
+                events.push_back(event);
+            }
+        }
+        if (events.empty()) {
+            cpu_relax();
+            continue;
+        }
+        publish_events(events);
+    }
+}
+
+// The event loop has no timers and flushes only when a batch publishes events, so a
+// quiet market would otherwise leave a replay or a backlog waiting for order flow
+void MatchingEngine::run_output_pump() {
+    while (pumping.load(std::memory_order_acquire)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(kOutputPumpIntervalMs));
+        drop_copy_server->pump();
+        md_recovery_server->flush();
+        admin_server->flush();
+    }
 }
 
 void MatchingEngine::send_market_data_snapshot(md_recovery_socket_t<MDRecoveryServer>* client, const std::string& symbol) {
-    if (order_books.find(symbol) != order_books.end()) {
-        auto snapshot = order_books[symbol]->get_snapshot();
+    SymbolId symbol_id = find_symbol(symbol);
+    if (symbol_id != StringInterner::kInvalidId) {
+        MarketDataSnapshot snapshot;
+        uint64_t sequence;
+        {
+            std::lock_guard<std::mutex> lock(md_mutex);
+            snapshot = md_images[symbol_id].top;
+            sequence = md_history.last_sequence();
+        }
         
         char buffer[1024];
         snprintf(buffer, sizeof(buffer), 
-                "SNAPSHOT:%s:BID:%lu@%lu($%.9f):ASK:%lu@%lu($%.9f):LAST:%lu@%lu($%.9f)\n",
+                "SNAPSHOT:%s:BID:%lu@%lu($%.9f):ASK:%lu@%lu($%.9f):LAST:%lu@%lu($%.9f):SEQ:%lu\n",
                 symbol.c_str(),
                 snapshot.bid_quantity, snapshot.bid_price, nanos_to_dollars(snapshot.bid_price),
                 snapshot.ask_quantity, snapshot.ask_price, nanos_to_dollars(snapshot.ask_price),
-                snapshot.last_trade_quantity, snapshot.last_trade_price, nanos_to_dollars(snapshot.last_trade_price));
+                snapshot.last_trade_quantity, snapshot.last_trade_price, nanos_to_dollars(snapshot.last_trade_price),
+                sequence);
         
         client->send_message(std::string(buffer));
     }
 }
 
-void MatchingEngine::publish_market_data(const MarketDataSnapshot& snapshot) {
-    char buffer[1024];
-    snprintf(buffer, sizeof(buffer),
-            "MD:%s:BID:%lu@%lu($%.9f):ASK:%lu@%lu($%.9f):LAST:%lu@%lu($%.9f):TS:%lu\n",
-            snapshot.symbol.c_str(),
-            snapshot.bid_quantity, snapshot.bid_price, nanos_to_dollars(snapshot.bid_price),
-            snapshot.ask_quantity, snapshot.ask_price, nanos_to_dollars(snapshot.ask_price),
-            snapshot.last_trade_quantity, snapshot.last_trade_price, nanos_to_dollars(snapshot.last_trade_price),
-            snapshot.timestamp);
+SharedBuffer MatchingEngine::book_image(SymbolId symbol_id, BookImage::Depth depth) {
+    std::lock_guard<std::mutex> lock(md_mutex);
+    SymbolImage& image = md_images[symbol_id];
+    return image.book.encode(depth, symbols.name(symbol_id), md_history.last_sequence(), image.top);
+}
+
+// Replays [first, first + count) from the history as sequenced packets, or sends a
+// snapshot of every symbol when part of the range is no longer held
+void MatchingEngine::retransmit(md_recovery_socket_t<MDRecoveryServer>* client, uint64_t first, uint64_t count) {
+    std::string out;
+    {
+        std::lock_guard<std::mutex> lock(md_mutex);
+        if (md_history.contains(first, count)) {
+            size_t packet_start = begin_packet(out, first);
+            uint16_t message_count = 0;
+            md_history.for_range(first, count, [&](uint64_t sequence, const uint8_t* data, size_t length) {
+                if (out.size() - packet_start + length > kMaxPacketSize) {
+                    finish_packet(out, packet_start, message_count);
+                    packet_start = begin_packet(out, sequence);
+                    message_count = 0;
+                }
+                out.append(reinterpret_cast<const char*>(data), length);
+                message_count++;
+            });
+            finish_packet(out, packet_start, message_count);
+        } else {
+            uint64_t sequence = md_history.last_sequence();
+            for (SymbolId symbol_id = 0; symbol_id < md_images.size(); ++symbol_id) {
+                size_t packet_start = begin_packet(out, sequence);
+                uint16_t message_count = append_symbol_snapshot(symbol_id, out);
+                finish_packet(out, packet_start, message_count);
+            }
+        }
+    }
+    
+    LOG_INFO("[md_recovery] Retransmission %lu+%lu: %zu bytes\n", first, count, out.size());
+    client->send_message(out);
+}
+
+// Appends a PacketHeader for a packet starting at sequence; returns its offset in out
+size_t MatchingEngine::begin_packet(std::string& out, uint64_t sequence) {
+    PacketHeader header;
+    header.length = 0;
+    header.channel = multicast_publisher->get_channel();
+    header.message_count = 0;
+    header.sequence = sequence;
+    size_t offset = out.size();
+    out.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    return offset;
+}
+
+// Fills in length and message_count of the packet at offset, which runs to the end of out
+void MatchingEngine::finish_packet(std::string& out, size_t offset, uint16_t message_count) {
+    PacketHeader header;
+    memcpy(&header, out.data() + offset, sizeof(header));
+    header.length = static_cast<uint16_t>(out.size() - offset);
+    header.message_count = message_count;
+    memcpy(&out[offset], &header, sizeof(header));
+}
+
+// Appends a SNAPSHOT message, its levels and its SESSION_STATUS; returns the number
+// of messages written
+uint16_t MatchingEngine::append_symbol_snapshot(SymbolId symbol_id, std::string& out) {
+    const SymbolImage& image = md_images[symbol_id];
     
-    std::string msg(buffer);
-    multicast_publisher->send_message(msg);
+    SymbolSnapshotMsg snapshot;
+    snapshot.header.length = sizeof(snapshot);
+    snapshot.header.msg_type = static_cast<uint8_t>(MdMsgType::SNAPSHOT);
+    copy_symbol(snapshot.symbol, symbols.name(symbol_id));
+    snapshot.last_trade_price = image.top.last_trade_price;
+    snapshot.last_trade_quantity = image.top.last_trade_quantity;
+    snapshot.bid_levels = static_cast<uint8_t>(image.bids.size());
+    snapshot.ask_levels = static_cast<uint8_t>(image.asks.size());
+    out.append(reinterpret_cast<const char*>(&snapshot), sizeof(snapshot));
+    
+    auto append_levels = [&](OrderSide side, const std::vector<DepthLevel>& levels) {
+        for (size_t i = 0; i < levels.size(); ++i) {
+            LevelUpdateMsg msg;
+            encode_level(LevelUpdate{symbol_id, side, LevelAction::ADD, static_cast<uint8_t>(i),
+                                     levels[i].price, levels[i].quantity, levels[i].order_count}, msg);
+            out.append(reinterpret_cast<const char*>(&msg), sizeof(msg));
+        }
+    };
+    append_levels(OrderSide::BUY, image.bids);
+    append_levels(OrderSide::SELL, image.asks);
+    
+    SessionStatusMsg session;
+    encode_session(image.session, session);
+    out.append(reinterpret_cast<const char*>(&session), sizeof(session));
+    return static_cast<uint16_t>(2 + image.bids.size() + image.asks.size());
+}
+
+// Sequences msg on the multicast feed and keeps it for retransmission; caller holds md_mutex
+void MatchingEngine::send_md_message(const void* msg, size_t length) {
+    uint64_t sequence = multicast_publisher->publish(msg, length);
+    md_history.append(sequence, msg, length);
+}
+
+void MatchingEngine::encode_level(const LevelUpdate& update, LevelUpdateMsg& msg) {
+    MdMsgType msg_type = MdMsgType::LEVEL_ADD;
+    switch (update.action) {
+        case LevelAction::ADD: msg_type = MdMsgType::LEVEL_ADD; break;
+        case LevelAction::MODIFY: msg_type = MdMsgType::LEVEL_MODIFY; break;
+        case LevelAction::DELETE: msg_type = MdMsgType::LEVEL_DELETE; break;
+    }
+    
+    msg.header.length = sizeof(msg);
+    msg.header.msg_type = static_cast<uint8_t>(msg_type);
+    copy_symbol(msg.symbol, symbols.name(update.symbol_id));
+    msg.side = static_cast<uint8_t>(update.side);
+    msg.level = update.level;
+    msg.price = update.price;
+    msg.quantity = update.quantity;
+    msg.order_count = update.order_count;
+}
+
+void MatchingEngine::encode_session(const SessionUpdate& update, SessionStatusMsg& msg) {
+    msg.header.length = sizeof(msg);
+    msg.header.msg_type = static_cast<uint8_t>(MdMsgType::SESSION_STATUS);
+    copy_symbol(msg.symbol, symbols.name(update.symbol_id));
+    msg.phase = static_cast<uint8_t>(update.phase);
+    msg.imbalance_side = update.imbalance_quantity ? static_cast<uint8_t>(update.imbalance_side) : 0;
+    msg.price = update.price;
+    msg.matched_quantity = update.matched_quantity;
+    msg.imbalance_quantity = update.imbalance_quantity;
+}
+
+// Applies a level update to the recovery image, mirroring what a feed consumer does
+void MatchingEngine::apply_level_update(SymbolImage& image, const LevelUpdate& update) {
+    auto& levels = (update.side == OrderSide::BUY) ? image.bids : image.asks;
+    auto it = std::find_if(levels.begin(), levels.end(),
+                           [&](const DepthLevel& level) { return level.price == update.price; });
+    
+    switch (update.action) {
+        case LevelAction::ADD: {
+            size_t position = std::min<size_t>(update.level, levels.size());
+            levels.insert(levels.begin() + position, DepthLevel{update.price, update.quantity, update.order_count});
+            break;
+        }
+        case LevelAction::MODIFY:
+            if (it != levels.end()) {
+                it->quantity = update.quantity;
+                it->order_count = update.order_count;
+            }
+            break;
+        case LevelAction::DELETE:
+            if (it != levels.end()) {
+                levels.erase(it);
+            }
+            break;
+    }
+}
+
+void MatchingEngine::publish_level_update(const LevelUpdate& update) {
+    LevelUpdateMsg msg;
+    encode_level(update, msg);
+    
+    std::lock_guard<std::mutex> lock(md_mutex);
+    apply_level_update(md_images[update.symbol_id], update);
+    send_md_message(&msg, sizeof(msg));
+}
+
+void MatchingEngine::publish_trade(const Fill& fill) {
+    TradeMsg msg;
+    msg.header.length = sizeof(msg);
+    msg.header.msg_type = static_cast<uint8_t>(MdMsgType::TRADE);
+    copy_symbol(msg.symbol, symbols.name(fill.symbol_id));
+    msg.fill_id = fill.fill_id;
+    msg.quantity = fill.quantity;
+    msg.price = fill.price;
+    msg.timestamp = fill.timestamp;
+    
+    std::lock_guard<std::mutex> lock(md_mutex);
+    MarketDataSnapshot& cached = md_images[fill.symbol_id].top;
+    cached.last_trade_price = fill.price;
+    cached.last_trade_quantity = fill.quantity;
+    md_images[fill.symbol_id].book.apply_fill(fill);
+    send_md_message(&msg, sizeof(msg));
+}
+
+void MatchingEngine::publish_session_status(const SessionUpdate& update) {
+    LOG_DEBUG("[matching_engine] %s %s: indicative %lu at $%.9f, imbalance %lu\n",
+              symbols.name(update.symbol_id).c_str(), TradingSession::state_name(update.phase),
+              update.matched_quantity, nanos_to_dollars(update.price), update.imbalance_quantity);
+    SessionStatusMsg msg;
+    encode_session(update, msg);
+    
+    std::lock_guard<std::mutex> lock(md_mutex);
+    md_images[update.symbol_id].session = update;
+    send_md_message(&msg, sizeof(msg));
 }
 
 // OrderGatewayServer Implementation
@@ -121,6 +1258,7 @@ tcp_server_socket_t* MatchingEngine::OrderGatewayServer::make_child(int fd, sock
                                                                    sockaddr_in local_addr, uint16_t local_port_, tcp_server_t* parent) {
     auto* socket = new order_gateway_socket_t<OrderGatewayServer>(fd, clientaddr, clientlen, local_addr, local_port_, parent);
     socket->parent_server = this;
+    socket->client = engine->register_client(socket->client_id);
     return socket;
 }
 
@@ -129,15 +1267,51 @@ void MatchingEngine::OrderGatewayServer::emplace_reserve(std::vector<std::pair<t
 }
 
 void MatchingEngine::OrderGatewayServer::on_add() {
-    printf("[order_gateway_server] Server started on port %d\n", engine->order_gateway_port);
+    LOG_INFO("[order_gateway_server] Server started on port %d\n", engine->order_gateway_port);
 }
 
 void MatchingEngine::OrderGatewayServer::on_remove() {
-    printf("[order_gateway_server] Server stopped\n");
+    LOG_INFO("[order_gateway_server] Server stopped\n");
+}
+
+bool MatchingEngine::OrderGatewayServer::decode(ClientId client, std::string_view line, OrderRequest& request) {
+    return engine->decode_text_order(client, line, request);
+}
+
+void MatchingEngine::OrderGatewayServer::on_order_batch(const std::vector<OrderRequest>& batch) {
+    engine->process_batch(batch.data(), batch.size());
+}
+
+// BinaryOrderGatewayServer Implementation
+MatchingEngine::BinaryOrderGatewayServer::BinaryOrderGatewayServer(MatchingEngine* eng, uint16_t port, const std::string& ip)
+    : tcp_server_t(port, ip), engine(eng) {}
+
+tcp_server_socket_t* MatchingEngine::BinaryOrderGatewayServer::make_child(int fd, sockaddr_in clientaddr, socklen_t clientlen,
+                                                                         sockaddr_in local_addr, uint16_t local_port_, tcp_server_t* parent) {
+    auto* socket = new binary_order_gateway_socket_t<BinaryOrderGatewayServer>(fd, clientaddr, clientlen, local_addr, local_port_, parent);
+    socket->parent_server = this;
+    socket->client = engine->register_client(socket->client_id);
+    return socket;
+}
+
+void MatchingEngine::BinaryOrderGatewayServer::emplace_reserve(std::vector<std::pair<tcp_server_socket_t*, uint8_t*>>&, const uint64_t) {
+    // TODO
+}
+
+void MatchingEngine::BinaryOrderGatewayServer::on_add() {
+    LOG_INFO("[binary_gateway_server] Server started on port %d\n", engine->binary_gateway_port);
+}
+
+void MatchingEngine::BinaryOrderGatewayServer::on_remove() {
+    LOG_INFO("[binary_gateway_server] Server stopped\n");
 }
 
-void MatchingEngine::OrderGatewayServer::on_order_request(const std::string& client_id, const std::string& order_msg) {
-    engine->process_order_request(client_id, order_msg);
+bool MatchingEngine::BinaryOrderGatewayServer::decode(ClientId client, const MsgHeader* header, OrderRequest& request) {
+    return engine->decode_binary_message(client, header, request);
+}
+
+void MatchingEngine::BinaryOrderGatewayServer::on_order_batch(const std::vector<OrderRequest>& batch) {
+    engine->process_batch(batch.data(), batch.size());
 }
 
 // DropCopyServer Implementation
@@ -148,7 +1322,10 @@ tcp_server_socket_t* MatchingEngine::DropCopyServer::make_child(int fd, sockaddr
                                                                sockaddr_in local_addr, uint16_t local_port_, tcp_server_t* parent) {
     auto* socket = new drop_copy_socket_t<DropCopyServer>(fd, clientaddr, clientlen, local_addr, local_port_, parent);
     socket->parent_server = this;
+    socket->output.configure(engine->config.subscriber_queue_bytes, engine->config.slow_consumer_policy);
+    std::lock_guard<std::mutex> lock(subscribers_mutex);
     subscribers.push_back(socket);
+    subscriber_count.store(subscribers.size(), std::memory_order_relaxed);
     return socket;
 }
 
@@ -157,54 +1334,247 @@ void MatchingEngine::DropCopyServer::emplace_reserve(std::vector<std::pair<tcp_s
 }
 
 void MatchingEngine::DropCopyServer::on_add() {
-    printf("[drop_copy_server] Server started on port %d\n", engine->drop_copy_port);
+    LOG_INFO("[drop_copy_server] Server started on port %d\n", engine->drop_copy_port);
 }
 
 void MatchingEngine::DropCopyServer::on_remove() {
-    printf("[drop_copy_server] Server stopped\n");
+    LOG_INFO("[drop_copy_server] Server stopped\n");
 }
 
+// Events are queued in pending and go out to subscribers on flush(). They are
+// queued with no subscriber too: every event is sequenced into the history
 void MatchingEngine::DropCopyServer::broadcast_fill(const Fill& fill) {
-    std::string fill_msg = format_fill_message(fill);
-    for (auto* subscriber : subscribers) {
-        subscriber->send_message(fill_msg);
-    }
+    pending.emplace_back(fill);
 }
 
 void MatchingEngine::DropCopyServer::broadcast_order_update(const Order& order) {
-    std::string order_msg = format_order_message(order);
-    for (auto* subscriber : subscribers) {
-        subscriber->send_message(order_msg);
+    pending.emplace_back(order);
+}
+
+// Each event is sequenced and encoded once; the encoded bytes go into the history
+// and are shared by every interested live queue. A slow subscriber backs up its own
+// queue (and is conflated or cut off) without holding up matching or the others.
+// Replaying subscribers take no live events: their replay reads them from the
+// history once it gets there, so the switch to live has no gap or overlap.
+void MatchingEngine::DropCopyServer::flush() {
+    if (pending.empty() && subscriber_count.load(std::memory_order_relaxed) == 0) {
+        return;
     }
+    uint64_t send_start = read_tsc();
+    {
+        std::lock_guard<std::mutex> lock(subscribers_mutex);
+        // Send the old backlog first so only messages the socket refused are conflated
+        for (auto* subscriber : subscribers) {
+            if (!subscriber->output.empty()) {
+                subscriber->output.flush();
+            }
+        }
+        
+        if (!pending.empty()) {
+            auto buffer = std::make_shared<std::string>();
+            buffer->reserve(pending.size() * sizeof(DropCopyFillMsg));
+            for (const auto& event : pending) {
+                size_t offset = buffer->size();
+                uint64_t sequence = history.last_sequence() + 1;
+                uint64_t key = 0;
+                if (event.type == EventType::FILL) {
+                    encode_fill(event.fill, sequence, *buffer);
+                } else {
+                    encode_order(event.order, sequence, *buffer);
+                    key = event.order.order_id;
+                }
+                size_t length = buffer->size() - offset;
+                const uint8_t* msg = reinterpret_cast<const uint8_t*>(buffer->data() + offset);
+                history.append(sequence, buffer->data() + offset, length);
+                
+                for (auto* subscriber : subscribers) {
+                    if (subscriber->replay_next != 0 || subscriber->output.is_disconnecting()) {
+                        continue;
+                    }
+                    bool wanted = event.type == EventType::FILL
+                        ? subscriber->filter.matches(msg, event.fill.symbol_id, event.fill.buy_client_id, event.fill.sell_client_id)
+                        : subscriber->filter.matches(msg, event.order.symbol_id, event.order.client_id);
+                    if (wanted) {
+                        subscriber->output.push(buffer, offset, length, key);
+                    }
+                }
+            }
+        }
+        
+        send_backlogs();
+    }
+    if (!pending.empty()) {
+        record_stage_ticks(Stage::DROP_COPY, send_start, read_tsc());
+    }
+    pending.clear();
 }
 
-std::string MatchingEngine::DropCopyServer::format_fill_message(const Fill& fill) {
-    char buffer[1024];
-    snprintf(buffer, sizeof(buffer),
-            "FILL:%lu:BUY_ORDER:%lu:SELL_ORDER:%lu:SYMBOL:%s:QTY:%lu:PRICE:%lu($%.9f):TS:%lu\n",
-            fill.fill_id, fill.buy_order_id, fill.sell_order_id,
-            fill.symbol.c_str(), fill.quantity, fill.price, nanos_to_dollars(fill.price), fill.timestamp);
-    return std::string(buffer);
+void MatchingEngine::DropCopyServer::handle_request(drop_copy_socket_t<DropCopyServer>* subscriber, std::string_view request) {
+    constexpr std::string_view kSymbolFilter = "FILTER:SYMBOL:";
+    constexpr std::string_view kClientFilter = "FILTER:CLIENT:";
+    constexpr std::string_view kReplay = "REPLAY:";
+    
+    std::lock_guard<std::mutex> lock(subscribers_mutex);
+    if (request.substr(0, kSymbolFilter.size()) == kSymbolFilter) {
+        SymbolId symbol = engine->find_symbol(request.substr(kSymbolFilter.size()));
+        if (symbol == StringInterner::kInvalidId) {
+            LOG_WARN("[drop_copy] %s: unknown symbol in filter\n", subscriber->subscriber_id.c_str());
+            return;
+        }
+        char field[kSymbolLength];
+        copy_symbol(field, engine->symbol_name(symbol));
+        subscriber->filter.symbols.push_back(symbol);
+        subscriber->filter.symbol_fields.emplace_back(field, sizeof(field));
+    } else if (request.substr(0, kClientFilter.size()) == kClientFilter) {
+        // A client that has not connected yet is matched by name alone
+        std::string_view name = request.substr(kClientFilter.size());
+        if (name.empty()) {
+            return;
+        }
+        ClientId client = engine->clients.find(name);
+        if (client != StringInterner::kInvalidId) {
+            subscriber->filter.clients.push_back(client);
+        }
+        char field[kClientNameLength];
+        copy_client(field, name);
+        subscriber->filter.client_fields.emplace_back(field, sizeof(field));
+    } else if (request == "FILTER:CLEAR") {
+        subscriber->filter = DropCopyFilter{};
+    } else if (request.substr(0, kReplay.size()) == kReplay) {
+        uint64_t from = 0;
+        if (!parse_u64(request.substr(kReplay.size()), from)) {
+            return;
+        }
+        if (!history.is_open()) {
+            LOG_WARN("[drop_copy] %s: replay requested but no history is kept\n", subscriber->subscriber_id.c_str());
+            return;
+        }
+        if (from < history.first_sequence()) {
+            LOG_WARN("[drop_copy] %s: replay from %lu, oldest held is %lu\n", subscriber->subscriber_id.c_str(),
+                     from, history.first_sequence());
+            from = history.first_sequence();
+        }
+        LOG_INFO("[drop_copy] %s replaying %lu-%lu\n", subscriber->subscriber_id.c_str(), from, history.last_sequence());
+        subscriber->replay_next = from;
+        send_replay(subscriber);
+        return;
+    } else {
+        return;
+    }
+    LOG_INFO("[drop_copy] %s filter: %zu symbols, %zu clients\n", subscriber->subscriber_id.c_str(),
+             subscriber->filter.symbols.size(), subscriber->filter.clients.size());
 }
 
-std::string MatchingEngine::DropCopyServer::format_order_message(const Order& order) {
-    char buffer[1024];
-    const char* status_str = "";
-    switch (order.status) {
-        case OrderStatus::NEW: status_str = "NEW"; break;
-        case OrderStatus::PARTIALLY_FILLED: status_str = "PARTIAL"; break;
-        case OrderStatus::FILLED: status_str = "FILLED"; break;
-        case OrderStatus::CANCELLED: status_str = "CANCELLED"; break;
-        case OrderStatus::REJECTED: status_str = "REJECTED"; break;
+void MatchingEngine::DropCopyServer::pump() {
+    if (subscriber_count.load(std::memory_order_relaxed) == 0) {
+        return;
     }
+    std::lock_guard<std::mutex> lock(subscribers_mutex);
+    send_backlogs();
+}
+
+// Sends each subscriber what its socket takes now: the backlog, or as much of its
+// replay as it will take. Caller holds subscribers_mutex.
+void MatchingEngine::DropCopyServer::send_backlogs() {
+    for (auto* subscriber : subscribers) {
+        if (subscriber->replay_next != 0) {
+            send_replay(subscriber);
+        } else if (!subscriber->output.empty()) {
+            subscriber->output.flush();
+        }
+    }
+}
+
+// Tops up and drains in turn until the socket would block or the subscriber is
+// live; the output pump resumes a blocked replay. Caller holds subscribers_mutex.
+void MatchingEngine::DropCopyServer::send_replay(drop_copy_socket_t<DropCopyServer>* subscriber) {
+    do {
+        continue_replay(subscriber);
+        subscriber->output.flush();
+    } while (subscriber->replay_next != 0 && !subscriber->output.is_disconnecting() && subscriber->output.empty());
+}
+
+// Tops the subscriber's queue up from the history a chunk at a time, so a long
+// replay never holds more than about one chunk in memory beyond the socket's
+// backlog; a subscriber that reaches the newest event becomes live. Caller holds
+// subscribers_mutex.
+void MatchingEngine::DropCopyServer::continue_replay(drop_copy_socket_t<DropCopyServer>* subscriber) {
+    constexpr size_t kReplayChunkBytes = 64 << 10;
     
-    snprintf(buffer, sizeof(buffer),
-            "ORDER:%lu:CLIENT:%s:SIDE:%s:SYMBOL:%s:QTY:%lu:REMAINING:%lu:PRICE:%lu($%.9f):STATUS:%s:TS:%lu\n",
-            order.order_id, order.client_id.c_str(),
-            (order.side == OrderSide::BUY) ? "BUY" : "SELL",
-            order.symbol.c_str(), order.quantity, order.remaining_quantity,
-            order.price, nanos_to_dollars(order.price), status_str, order.timestamp);
-    return std::string(buffer);
+    while (subscriber->replay_next != 0 && !subscriber->output.is_disconnecting() &&
+           subscriber->output.backlog_bytes() < kReplayChunkBytes) {
+        if (subscriber->replay_next > history.last_sequence()) {
+            LOG_INFO("[drop_copy] %s caught up at %lu, now live\n", subscriber->subscriber_id.c_str(),
+                     history.last_sequence());
+            subscriber->replay_next = 0;
+            break;
+        }
+        if (subscriber->replay_next < history.first_sequence()) {
+            // Overwritten while the subscriber was catching up
+            LOG_WARN("[drop_copy] %s fell behind the history at %lu\n", subscriber->subscriber_id.c_str(),
+                     subscriber->replay_next);
+            subscriber->replay_next = history.first_sequence();
+        }
+        
+        auto buffer = std::make_shared<std::string>();
+        buffer->reserve(kReplayChunkBytes);
+        uint64_t last = history.last_sequence();
+        for (uint64_t& next = subscriber->replay_next; next <= last && buffer->size() < kReplayChunkBytes; ++next) {
+            size_t length;
+            const uint8_t* msg = history.message(next, length);
+            if (subscriber->filter.matches_message(msg)) {
+                buffer->append(reinterpret_cast<const char*>(msg), length);
+            }
+        }
+        if (!buffer->empty()) {
+            subscriber->output.push(buffer, 0, buffer->size());
+        }
+    }
+}
+
+bool MatchingEngine::DropCopyServer::open_history(const std::string& path, size_t capacity) {
+    return history.open(path, capacity);
+}
+
+void MatchingEngine::DropCopyServer::append_backlog_report(std::string& out) {
+    std::lock_guard<std::mutex> lock(subscribers_mutex);
+    for (const auto* subscriber : subscribers) {
+        append_backlog_line(out, subscriber->subscriber_id, subscriber->output);
+    }
+}
+
+void MatchingEngine::DropCopyServer::encode_fill(const Fill& fill, uint64_t sequence, std::string& out) {
+    DropCopyFillMsg msg;
+    msg.header.length = sizeof(msg);
+    msg.header.msg_type = static_cast<uint8_t>(DropCopyMsgType::FILL);
+    msg.sequence = sequence;
+    copy_symbol(msg.symbol, engine->symbol_name(fill.symbol_id));
+    copy_client(msg.buy_client, engine->client_name(fill.buy_client_id));
+    copy_client(msg.sell_client, engine->client_name(fill.sell_client_id));
+    msg.fill_id = fill.fill_id;
+    msg.buy_order_id = fill.buy_order_id;
+    msg.sell_order_id = fill.sell_order_id;
+    msg.quantity = fill.quantity;
+    msg.price = fill.price;
+    msg.timestamp = fill.timestamp;
+    out.append(reinterpret_cast<const char*>(&msg), sizeof(msg));
+}
+
+void MatchingEngine::DropCopyServer::encode_order(const Order& order, uint64_t sequence, std::string& out) {
+    DropCopyOrderMsg msg;
+    msg.header.length = sizeof(msg);
+    msg.header.msg_type = static_cast<uint8_t>(DropCopyMsgType::ORDER_UPDATE);
+    msg.sequence = sequence;
+    copy_symbol(msg.symbol, engine->symbol_name(order.symbol_id));
+    copy_client(msg.client, engine->client_name(order.client_id));
+    msg.order_id = order.order_id;
+    msg.side = static_cast<uint8_t>(order.side);
+    msg.status = static_cast<uint8_t>(order.status);
+    msg.quantity = order.quantity;
+    msg.remaining_quantity = order.remaining_quantity;
+    msg.price = order.price;
+    msg.timestamp = order.timestamp;
+    out.append(reinterpret_cast<const char*>(&msg), sizeof(msg));
 }
 
 // MDRecoveryServer Implementation
@@ -215,6 +1585,9 @@ tcp_server_socket_t* MatchingEngine::MDRecoveryServer::make_child(int fd, sockad
                                                                  sockaddr_in local_addr, uint16_t local_port_, tcp_server_t* parent) {
     auto* socket = new md_recovery_socket_t<MDRecoveryServer>(fd, clientaddr, clientlen, local_addr, local_port_, parent);
     socket->parent_server = this;
+    socket->output.configure(engine->config.subscriber_queue_bytes, engine->config.slow_consumer_policy);
+    std::lock_guard<std::mutex> lock(clients_mutex);
+    clients.push_back(socket);
     return socket;
 }
 
@@ -223,13 +1596,283 @@ void MatchingEngine::MDRecoveryServer::emplace_reserve(std::vector<std::pair<tcp
 }
 
 void MatchingEngine::MDRecoveryServer::on_add() {
-    printf("[md_recovery_server] Server started on port %d\n", engine->md_recovery_port);
+    LOG_INFO("[md_recovery_server] Server started on port %d\n", engine->md_recovery_port);
 }
 
 void MatchingEngine::MDRecoveryServer::on_remove() {
-    printf("[md_recovery_server] Server stopped\n");
+    LOG_INFO("[md_recovery_server] Server stopped\n");
 }
 
 void MatchingEngine::MDRecoveryServer::send_snapshot(md_recovery_socket_t<MDRecoveryServer>* client, const std::string& symbol) {
     engine->send_market_data_snapshot(client, symbol);
-}
\ No newline at end of file
+}
+
+void MatchingEngine::MDRecoveryServer::send_stats(md_recovery_socket_t<MDRecoveryServer>* client) {
+    std::string report = format_stage_report();
+    if (engine->risk) {
+        engine->risk->append_report(report);
+    }
+    engine->drop_copy_server->append_backlog_report(report);
+    append_backlog_report(report);
+    client->send_message(report);
+}
+
+void MatchingEngine::MDRecoveryServer::send_directory(md_recovery_socket_t<MDRecoveryServer>* client) {
+    std::string reply;
+    char line[256];
+    for (SymbolId id = 0; id < engine->instruments.size(); ++id) {
+        const Instrument& instrument = engine->instruments[id];
+        int len = snprintf(line, sizeof(line), "INSTRUMENT:%u:%s:%lu:%lu:%lu:%lu:%s\n", id, instrument.symbol.c_str(),
+                           instrument.book.tick_size, instrument.lot_size, instrument.book.min_price,
+                           instrument.book.max_price, TradingSession::state_name(engine->get_phase(id)));
+        reply.append(line, std::min<size_t>(len, sizeof(line) - 1));
+    }
+    client->send_message(reply);
+}
+
+void MatchingEngine::MDRecoveryServer::send_book_images(md_recovery_socket_t<MDRecoveryServer>* client,
+                                                        BookImage::Depth depth, const std::string& symbol) {
+    std::vector<SymbolId> symbol_ids;
+    if (symbol == "*") {
+        std::lock_guard<std::mutex> lock(engine->md_mutex);
+        for (SymbolId symbol_id = 0; symbol_id < engine->md_images.size(); ++symbol_id) {
+            symbol_ids.push_back(symbol_id);
+        }
+    } else {
+        SymbolId symbol_id = engine->find_symbol(symbol);
+        if (symbol_id == StringInterner::kInvalidId) {
+            LOG_WARN("[md_recovery] %s: unknown symbol %s in BOOK request\n", client->subscriber_id.c_str(), symbol.c_str());
+            return;
+        }
+        symbol_ids.push_back(symbol_id);
+    }
+    
+    std::lock_guard<std::mutex> lock(clients_mutex);
+    for (SymbolId symbol_id : symbol_ids) {
+        client->pending_images.emplace_back(symbol_id, depth);
+    }
+    send_images(client);
+}
+
+// Tops up and drains in turn until the socket would block or every requested image
+// is out; the output pump resumes a blocked stream. Caller holds clients_mutex.
+void MatchingEngine::MDRecoveryServer::send_images(md_recovery_socket_t<MDRecoveryServer>* client) {
+    do {
+        continue_book_images(client);
+        client->output.flush();
+    } while ((client->image_buffer || !client->pending_images.empty()) && !client->output.is_disconnecting() &&
+             client->output.empty());
+}
+
+// Tops the client's queue up a slice at a time, so a large image is never queued
+// whole: every requester shares the one encoded buffer and holds at most about a
+// slice of it beyond what its socket has taken. Caller holds clients_mutex.
+void MatchingEngine::MDRecoveryServer::continue_book_images(md_recovery_socket_t<MDRecoveryServer>* client) {
+    constexpr size_t kImageSliceBytes = 256 << 10;
+    
+    while (!client->output.is_disconnecting() && client->output.backlog_bytes() < kImageSliceBytes) {
+        if (!client->image_buffer) {
+            if (client->pending_images.empty()) {
+                break;
+            }
+            const auto& request = client->pending_images.front();
+            client->image_buffer = engine->book_image(request.first, request.second);
+            client->image_offset = 0;
+            client->pending_images.pop_front();
+        }
+        
+        size_t length = std::min(kImageSliceBytes, client->image_buffer->size() - client->image_offset);
+        client->output.push(client->image_buffer, client->image_offset, length);
+        client->image_offset += length;
+        if (client->image_offset == client->image_buffer->size()) {
+            client->image_buffer.reset();
+        }
+    }
+}
+
+void MatchingEngine::MDRecoveryServer::flush() {
+    std::lock_guard<std::mutex> lock(clients_mutex);
+    for (auto* client : clients) {
+        if (client->image_buffer || !client->pending_images.empty()) {
+            send_images(client);
+        } else if (!client->output.empty()) {
+            client->output.flush();
+        }
+    }
+}
+
+void MatchingEngine::MDRecoveryServer::append_backlog_report(std::string& out) {
+    std::lock_guard<std::mutex> lock(clients_mutex);
+    for (const auto* client : clients) {
+        append_backlog_line(out, client->subscriber_id, client->output);
+    }
+}
+
+void MatchingEngine::MDRecoveryServer::send_retransmission(md_recovery_socket_t<MDRecoveryServer>* client, uint64_t first, uint64_t count) {
+    engine->retransmit(client, first, count);
+}
+// ReplicationServer Implementation
+// Loopback only, whatever the engine's bind address: state changes never reach
+// the public interfaces
+MatchingEngine::AdminServer::AdminServer(MatchingEngine* eng, uint16_t port)
+    : tcp_server_t(port, "127.0.0.1"), engine(eng) {}
+
+tcp_server_socket_t* MatchingEngine::AdminServer::make_child(int fd, sockaddr_in clientaddr, socklen_t clientlen,
+                                                            sockaddr_in local_addr, uint16_t local_port_, tcp_server_t* parent) {
+    auto* socket = new admin_socket_t<AdminServer>(fd, clientaddr, clientlen, local_addr, local_port_, parent);
+    socket->parent_server = this;
+    socket->output.configure(engine->config.subscriber_queue_bytes, engine->config.slow_consumer_policy);
+    std::lock_guard<std::mutex> lock(sessions_mutex);
+    sessions.push_back(socket);
+    return socket;
+}
+
+void MatchingEngine::AdminServer::emplace_reserve(std::vector<std::pair<tcp_server_socket_t*, uint8_t*>>&, const uint64_t) {
+    // TODO
+}
+
+void MatchingEngine::AdminServer::on_add() {
+    LOG_INFO("[admin_server] Server started on 127.0.0.1 port %d\n", engine->admin_port);
+}
+
+void MatchingEngine::AdminServer::on_remove() {
+    LOG_INFO("[admin_server] Server stopped\n");
+}
+
+// Replies with one PHASE line per symbol giving the phase it is now in
+void MatchingEngine::AdminServer::change_phase(admin_socket_t<AdminServer>* session, const std::string& symbol,
+                                               const std::string& state) {
+    TradingState phase = TradingState::TRADING;
+    if (state == "RESUME") {
+        phase = engine->get_scheduled_phase();
+    } else if (!TradingSession::parse_state(state, phase)) {
+        LOG_WARN("[admin] %s: unknown phase %s in PHASE request\n", session->session_id.c_str(), state.c_str());
+        return;
+    }
+    std::vector<SymbolId> symbol_ids;
+    if (symbol == "*") {
+        for (SymbolId id = 0; id < engine->instruments.size(); ++id) {
+            symbol_ids.push_back(id);
+        }
+    } else {
+        SymbolId id = engine->find_symbol(symbol);
+        if (id == StringInterner::kInvalidId) {
+            LOG_WARN("[admin] %s: unknown symbol %s in PHASE request\n", session->session_id.c_str(), symbol.c_str());
+            return;
+        }
+        symbol_ids.push_back(id);
+    }
+    engine->change_phase(symbol_ids, phase);
+    LOG_INFO("[session] Admin moved %s to %s\n", symbol.c_str(), TradingSession::state_name(phase));
+    
+    std::string reply;
+    for (SymbolId id : symbol_ids) {
+        reply += "PHASE:" + engine->symbol_name(id) + ":" + TradingSession::state_name(engine->get_phase(id)) + "\n";
+    }
+    session->send_message(reply);
+}
+
+void MatchingEngine::AdminServer::flush() {
+    std::lock_guard<std::mutex> lock(sessions_mutex);
+    for (auto* session : sessions) {
+        if (!session->output.empty()) {
+            session->output.flush();
+        }
+    }
+}
+
+MatchingEngine::ReplicationServer::ReplicationServer(MatchingEngine* eng, uint16_t port, const std::string& ip)
+    : tcp_server_t(port, ip), engine(eng) {}
+
+tcp_server_socket_t* MatchingEngine::ReplicationServer::make_child(int fd, sockaddr_in clientaddr, socklen_t clientlen,
+                                                                  sockaddr_in local_addr, uint16_t local_port_, tcp_server_t* parent) {
+    auto* socket = new replication_socket_t<ReplicationServer>(fd, clientaddr, clientlen, local_addr, local_port_, parent);
+    socket->parent_server = this;
+    backups.push_back(socket);
+    return socket;
+}
+
+void MatchingEngine::ReplicationServer::emplace_reserve(std::vector<std::pair<tcp_server_socket_t*, uint8_t*>>&, const uint64_t) {
+    // TODO
+}
+
+void MatchingEngine::ReplicationServer::on_add() {
+    LOG_INFO("[replication_server] Server started on port %d\n", engine->replication_port);
+}
+
+void MatchingEngine::ReplicationServer::on_remove() {
+    LOG_INFO("[replication_server] Server stopped\n");
+}
+
+// Streams from the backup's position; a backup already past the journal holds
+// commands this primary never sequenced and is turned away
+void MatchingEngine::ReplicationServer::on_hello(replication_socket_t<ReplicationServer>* backup, uint64_t last_sequence) {
+    uint64_t journal_sequence = engine->journal.last_sequence();
+    ReplicationStartMsg start;
+    start.header.length = sizeof(start);
+    start.header.msg_type = static_cast<uint8_t>(ReplicationMsgType::START);
+    start.record_size = sizeof(OrderJournal::Record);
+    start.last_sequence = journal_sequence;
+    backup->preamble.append(reinterpret_cast<const char*>(&start), sizeof(start));
+    
+    if (last_sequence > journal_sequence) {
+        LOG_ERROR("[replication] %s is at sequence %lu, past this journal's %lu; it has diverged\n",
+                  backup->backup_id.c_str(), last_sequence, journal_sequence);
+        backup->send_records(engine->journal);
+        backup->disconnect("diverged");
+        return;
+    }
+    backup->streaming = true;
+    backup->next_sequence = last_sequence + 1;
+    backup->sent_bytes = 0;
+    backup->acked_sequence = last_sequence;
+    backup->catch_up_sequence = journal_sequence;
+    backup->in_sync = last_sequence >= journal_sequence;
+    LOG_INFO("[replication] %s joined at sequence %lu, %lu records behind\n", backup->backup_id.c_str(),
+             last_sequence, journal_sequence - last_sequence);
+    backup->send_records(engine->journal);
+}
+
+// Acknowledgements pace a catch-up: each one sends the backup what it does not have
+void MatchingEngine::ReplicationServer::on_ack(replication_socket_t<ReplicationServer>* backup, uint64_t sequence) {
+    backup->acked_sequence = std::max(backup->acked_sequence, sequence);
+    if (!backup->in_sync && backup->acked_sequence >= backup->catch_up_sequence) {
+        backup->in_sync = true;
+        LOG_INFO("[replication] %s caught up at sequence %lu\n", backup->backup_id.c_str(), backup->acked_sequence);
+    }
+    backup->send_records(engine->journal);
+    engine->on_replication_progress();
+}
+
+void MatchingEngine::ReplicationServer::on_backup_lost() {
+    engine->on_replication_progress();
+}
+
+void MatchingEngine::ReplicationServer::flush() {
+    for (auto* backup : backups) {
+        backup->send_records(engine->journal);
+    }
+}
+
+uint64_t MatchingEngine::ReplicationServer::confirmed_sequence(size_t required, uint64_t last_sequence) {
+    acked.clear();
+    for (const auto* backup : backups) {
+        if (backup->in_sync && !backup->disconnecting) {
+            acked.push_back(backup->acked_sequence);
+        }
+    }
+    if (acked.size() < required) {
+        if (!degraded) {
+            LOG_WARN("[replication] %zu of %zu backups in sync; matching without waiting for them\n",
+                     acked.size(), required);
+            degraded = true;
+        }
+        return last_sequence;
+    }
+    if (degraded) {
+        LOG_INFO("[replication] %zu backups in sync; matching waits for them again\n", acked.size());
+        degraded = false;
+    }
+    std::nth_element(acked.begin(), acked.begin() + (required - 1), acked.end(), std::greater<uint64_t>());
+    return acked[required - 1];
+}
@@ -1,17 +1,100 @@
 #pragma once
+#include <atomic>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 #include <string>
-#include <sstream>
+#include <string_view>
 #include "../TradeCoreExport/tcp_server_socket.h"
 #include "../TradeCoreExport/event_manager.h"
 #include "matching_engine_types.h"
 #include "order_book.h"
+#include "matching_shard.h"
+#include "string_interner.h"
 #include "order_gateway_server.h"
+#include "binary_order_gateway_server.h"
 #include "drop_copy_server.h"
 #include "md_recovery_server.h"
+#include "admin_server.h"
+#include "output_queue.h"
+#include "drop_copy_protocol.h"
+#include "drop_copy_history.h"
 #include "multicast_publisher.h"
+#include "market_data_protocol.h"
+#include "book_image.h"
+#include "sequenced_message_ring.h"
+#include "order_journal.h"
+#include "book_checkpoint.h"
+#include "checkpoint_writer.h"
+#include "replication_server.h"
+#include "instrument_directory.h"
+#include "risk_manager.h"
+#include "trading_session.h"
+#include "log.h"
+#include "stage_metrics.h"
+
+enum class ReplicationRole : uint8_t {
+    NONE,
+    PRIMARY,        // streams its journal to backups
+    BACKUP          // follows a primary with output suppressed and takes over when it is lost
+};
+
+// Runtime options for MatchingEngine
+struct EngineConfig {
+    // Instrument directory (see instrument_directory.h); only its symbols trade.
+    // Empty trades a few built-in test symbols instead
+    std::string instrument_path;
+    // 0 matches inline on the event loop thread; N > 0 hashes symbols across N pinned matching threads
+    size_t shard_count = 0;
+    // Core per shard; shards without an entry are left unpinned
+    std::vector<int> shard_cores;
+    int publisher_core = -1;
+    // Price levels per side carried on the incremental market data feed, 1 to kMaxMdDepth
+    size_t md_depth = 5;
+    // Feed messages kept for retransmission on the MD recovery port
+    size_t md_history_capacity = 65536;
+    // Longest a feed message may wait in a partly filled packet before it is sent
+    uint64_t md_max_hold_ns = 50000;
+    // Write-ahead journal of accepted commands, replayed at start; empty disables it
+    std::string journal_path;
+    size_t journal_capacity = 1ULL << 30;
+    // Group commit: a journal thread flushes appends to disk this often, so they are
+    // durable within one interval even when traffic stops; 0 syncs every batch inline
+    uint64_t journal_sync_interval_ns = 1000000;
+    // Checkpoint of every book, restored at start so only newer journal records are
+    // replayed; needs the journal. Written this often and at stop, 0 for stop only
+    std::string checkpoint_path;
+    uint64_t checkpoint_interval_ms = 60000;
+    // Replication of the journaled command stream (see replication_protocol.h). A
+    // primary needs the journal. A backup follows replication_primary_host and, with
+    // failover on, takes over from the state it holds when the connection drops;
+    // with it off it reconnects and resumes instead
+    ReplicationRole replication_role = ReplicationRole::NONE;
+    std::string replication_primary_host;
+    uint16_t replication_primary_port = 8005;
+    bool replication_failover = true;
+    // Primary: a command is matched, and so acked to its client, only once this many
+    // caught-up backups hold it; 0 matches first and replicates after the batch
+    size_t replication_sync_backups = 0;
+    // Logs the per-stage latency report this often; 0 leaves it to STATS requests
+    uint64_t stats_interval_ms = 0;
+    // Per-subscriber output backlog allowed on drop copy and MD recovery connections
+    size_t subscriber_queue_bytes = 8 << 20;
+    SlowConsumerPolicy slow_consumer_policy = SlowConsumerPolicy::DISCONNECT;
+    // Drop copy events retained for REPLAY; a path keeps them in a file for the
+    // trading day, otherwise only the most recent capacity are held in memory
+    std::string drop_copy_history_path;
+    size_t drop_copy_history_capacity = 1 << 20;
+    // Pre-trade checks on new and replace orders; all off by default
+    RiskLimits risk;
+    // Applied to every book whose BookConfig leaves self-trade prevention off
+    SelfTradePrevention self_trade_prevention = SelfTradePrevention::NONE;
+    // Daily phase schedule (see trading_session.h); empty trades continuously
+    std::vector<SessionTransition> session_schedule;
+};
 
 // Main Matching Engine class
 class MatchingEngine {
@@ -29,7 +112,25 @@ public:
         void on_add() override;
         void on_remove() override;
         
-        void on_order_request(const std::string& client_id, const std::string& order_msg);
+        bool decode(ClientId client, std::string_view line, OrderRequest& request);
+        void on_order_batch(const std::vector<OrderRequest>& batch);
+    };
+    
+    // Binary Order Gateway Server
+    class BinaryOrderGatewayServer : public tcp_server_t {
+        MatchingEngine* engine;
+    public:
+        BinaryOrderGatewayServer(MatchingEngine* eng, uint16_t port, const std::string& ip);
+        
+        tcp_server_socket_t* make_child(int fd, sockaddr_in clientaddr, socklen_t clientlen,
+                                       sockaddr_in local_addr, uint16_t local_port_, tcp_server_t* parent) override;
+        
+        void emplace_reserve(std::vector<std::pair<tcp_server_socket_t*, uint8_t*>>& socketBuf, const uint64_t len) override;
+        void on_add() override;
+        void on_remove() override;
+        
+        bool decode(ClientId client, const MsgHeader* header, OrderRequest& request);
+        void on_order_batch(const std::vector<OrderRequest>& batch);
     };
     
     // Drop Copy Server
@@ -37,6 +138,9 @@ public:
         MatchingEngine* engine;
     public:
         std::vector<drop_copy_socket_t<DropCopyServer>*> subscribers;
+        // Guards subscribers when a publisher thread flushes (sharded mode)
+        std::mutex subscribers_mutex;
+        std::atomic<size_t> subscriber_count{0};
         
         DropCopyServer(MatchingEngine* eng, uint16_t port, const std::string& ip);
         
@@ -49,16 +153,37 @@ public:
         
         void broadcast_fill(const Fill& fill);
         void broadcast_order_update(const Order& order);
+        void flush();
+        // Output pump: sends backlogs and replays without waiting for events to flush
+        void pump();
+        // FILTER and REPLAY requests from a subscriber (see drop_copy_protocol.h)
+        void handle_request(drop_copy_socket_t<DropCopyServer>* subscriber, std::string_view request);
+        void append_backlog_report(std::string& out);
+        bool open_history(const std::string& path, size_t capacity);
         
     private:
-        std::string format_fill_message(const Fill& fill);
-        std::string format_order_message(const Order& order);
+        // Events since the last flush. Each is sequenced and encoded once, at flush,
+        // into the history and a buffer shared by the queues of the live subscribers
+        // whose filter it matches
+        std::vector<ExecutionEvent> pending;
+        std::vector<drop_copy_socket_t<DropCopyServer>*> interested;
+        DropCopyHistory history;
+        
+        void encode_fill(const Fill& fill, uint64_t sequence, std::string& out);
+        void encode_order(const Order& order, uint64_t sequence, std::string& out);
+        void send_backlogs();
+        void send_replay(drop_copy_socket_t<DropCopyServer>* subscriber);
+        void continue_replay(drop_copy_socket_t<DropCopyServer>* subscriber);
     };
     
     // Market Data Recovery Server
     class MDRecoveryServer : public tcp_server_t {
         MatchingEngine* engine;
     public:
+        std::vector<md_recovery_socket_t<MDRecoveryServer>*> clients;
+        // Guards clients and their output queues against the publisher thread's flush
+        std::mutex clients_mutex;
+        
         MDRecoveryServer(MatchingEngine* eng, uint16_t port, const std::string& ip);
         
         tcp_server_socket_t* make_child(int fd, sockaddr_in clientaddr, socklen_t clientlen,
@@ -69,20 +194,131 @@ public:
         void on_remove() override;
         
         void send_snapshot(md_recovery_socket_t<MDRecoveryServer>* client, const std::string& symbol);
-    };
+        // BOOK:L2/L3 request: queues the images and streams them out a slice at a time
+        void send_book_images(md_recovery_socket_t<MDRecoveryServer>* client, BookImage::Depth depth,
+                              const std::string& symbol);
+        void send_retransmission(md_recovery_socket_t<MDRecoveryServer>* client, uint64_t first, uint64_t count);
+        // STATS request: per-stage latency percentiles in nanoseconds and
+        // per-subscriber output backlogs
+        void send_stats(md_recovery_socket_t<MDRecoveryServer>* client);
+        // DIRECTORY request: one INSTRUMENT line per symbol with its id, limits and phase
+        void send_directory(md_recovery_socket_t<MDRecoveryServer>* client);
+// Sends backlogged replies the sockets can now take; also run by the output pump
+        void flush();
+void append_backlog_report(std::string& out);
 
+    private:
+        void send_images(md_recovery_socket_t<MDRecoveryServer>* client);
+        void continue_book_images(md_recovery_socket_t<MDRecoveryServer>* client);
+    };
+    
+    // Admin Server: state-changing commands, on the loopback interface only
+    class AdminServer : public tcp_server_t {
+        MatchingEngine* engine;
+    public:
+        std::vector<admin_socket_t<AdminServer>*> sessions;
+        // Guards sessions and their output queues against the output pump's flush
+        std::mutex sessions_mutex;
+        
+        AdminServer(MatchingEngine* eng, uint16_t port);
+        
+        tcp_server_socket_t* make_child(int fd, sockaddr_in clientaddr, socklen_t clientlen,
+                                       sockaddr_in local_addr, uint16_t local_port_, tcp_server_t* parent) override;
+        
+        void emplace_reserve(std::vector<std::pair<tcp_server_socket_t*, uint8_t*>>& socketBuf, const uint64_t len) override;
+        void on_add() override;
+        void on_remove() override;
+        
+        // PHASE request: moves one symbol, or all with *, to state
+        void change_phase(admin_socket_t<AdminServer>* session, const std::string& symbol, const std::string& state);
+        // Sends backlogged replies the sockets can now take; also run by the output pump
+        void flush();
+    };
+    
+    // Replication Server: streams the journal to backups; event loop only
+    class ReplicationServer : public tcp_server_t {
+        MatchingEngine* engine;
+    public:
+        std::vector<replication_socket_t<ReplicationServer>*> backups;
+        
+        ReplicationServer(MatchingEngine* eng, uint16_t port, const std::string& ip);
+        
+        tcp_server_socket_t* make_child(int fd, sockaddr_in clientaddr, socklen_t clientlen,
+                                       sockaddr_in local_addr, uint16_t local_port_, tcp_server_t* parent) override;
+        
+        void emplace_reserve(std::vector<std::pair<tcp_server_socket_t*, uint8_t*>>& socketBuf, const uint64_t len) override;
+        void on_add() override;
+        void on_remove() override;
+        
+        void on_hello(replication_socket_t<ReplicationServer>* backup, uint64_t last_sequence);
+        void on_ack(replication_socket_t<ReplicationServer>* backup, uint64_t sequence);
+        void on_backup_lost();
+        // Sends every backup the journal records it does not have yet
+        void flush();
+        // Highest sequence held by at least required caught-up backups; last_sequence
+        // while fewer are connected, so losing backups never stalls matching
+        uint64_t confirmed_sequence(size_t required, uint64_t last_sequence);
+        
+    private:
+        std::vector<uint64_t> acked;
+        bool degraded = false;
+    };
+    
 private:
     std::string bind_ip;
     uint16_t order_gateway_port = 8001;
     uint16_t drop_copy_port = 8002;
     uint16_t md_recovery_port = 8003;
+    uint16_t binary_gateway_port = 8004;
+    uint16_t replication_port = 8005;
+    uint16_t admin_port = 8006;
     
     std::unique_ptr<OrderGatewayServer> order_gateway;
+    std::unique_ptr<BinaryOrderGatewayServer> binary_gateway;
     std::unique_ptr<DropCopyServer> drop_copy_server;
     std::unique_ptr<MDRecoveryServer> md_recovery_server;
+    std::unique_ptr<AdminServer> admin_server;
+// Null unless replicating with a journal; a backup serves it once it takes over
+    std::unique_ptr<ReplicationServer> replication_server;
+    
+    EngineConfig config;
     
-    // Order books by symbol
-    std::unordered_map<std::string, std::unique_ptr<OrderBook>> order_books;
+    // Books live in the shards; shard 0 runs inline when shard_count is 0
+    std::vector<std::unique_ptr<MatchingShard>> shards;
+    std::thread publisher_thread;
+    std::atomic<bool> publishing{false};
+    // Keeps replies streaming to subscribers that asked for more than their socket
+    // took at once, whether or not any events are being published
+    std::thread output_pump_thread;
+    std::atomic<bool> pumping{false};
+    bool started = false;
+    
+    // Interned symbol and client ids carried by orders and fills
+    StringInterner symbols;
+    StringInterner clients;
+    // Reference data per symbol id, checked as requests are sequenced
+    std::vector<Instrument> instruments;
+    // Phase per symbol id as of the last sequenced request; the books follow it as
+    // they execute the journaled phase changes
+    std::vector<TradingState> phases;
+    // Where the schedule has the day now and when it next moves; UINT64_MAX without one
+    TradingState scheduled_phase = TradingState::TRADING;
+    uint64_t next_session_change = UINT64_MAX;
+    
+    // Published market data image per symbol and the recent feed history, served to
+    // MD recovery requests; written by the publishing thread under md_mutex. bids and
+    // asks mirror the feed's top levels; book is the full depth; session is the last
+    // SESSION_STATUS
+    struct SymbolImage {
+        MarketDataSnapshot top;
+        std::vector<DepthLevel> bids;
+        std::vector<DepthLevel> asks;
+        BookImage book;
+        SessionUpdate session{};
+    };
+    std::vector<SymbolImage> md_images;
+    SequencedMessageRing md_history;
+    std::mutex md_mutex;
     
     // Multicast publisher for market data
     std::unique_ptr<MulticastPublisher> multicast_publisher;
@@ -90,15 +326,91 @@ private:
     uint16_t multicast_port;
     
     uint64_t next_order_id = 1;
+    OrderJournal journal;
+    // Null without a checkpoint path; declared after the journal it reads, so it
+    // stops first
+    std::unique_ptr<CheckpointWriter> checkpoint_writer;
+    // Synchronous replication: requests sequenced but not yet held by enough
+    // backups, each with the journal sequence it must wait for
+    struct HeldRequest {
+        uint64_t sequence;
+        OrderRequest request;
+    };
+    std::deque<HeldRequest> replication_held;
+    // Cleared by stop_following() to end a backup's standby
+    std::atomic<bool> following{false};
+    // Null unless a risk limit is set
+    std::unique_ptr<RiskManager> risk;
+    uint64_t last_stats_dump_ts = 0;
     
 public:
     MatchingEngine(const std::string& bind_ip, 
-                   const std::string& mcast_ip, uint16_t mcast_port);
+                   const std::string& mcast_ip, uint16_t mcast_port,
+                   const EngineConfig& config = EngineConfig());
+    ~MatchingEngine();
     
-    void start(event_manager_t* em);
-    void process_order_request(const std::string& client_id, const std::string& order_msg);
+    // A backup follows its primary here until it takes over; false if it was
+    // stopped or refused first, and the engine never went live
+    bool start(event_manager_t* em);
+    void stop();
+    // Async-signal-safe: ends a backup's standby
+    void stop_following() { following.store(false, std::memory_order_release); }
+    // Creates or replaces the book for symbol; use BookBackend::LADDER for tick-bounded names
+    void add_symbol(const std::string& symbol, const BookConfig& config);
+    void add_instrument(const Instrument& instrument);
+    bool decode_text_order(ClientId client, std::string_view order_msg, OrderRequest& request);
+    bool decode_binary_message(ClientId client, const MsgHeader* header, OrderRequest& request);
+    void process_request(const OrderRequest& request);
+    void process_batch(const OrderRequest* requests, size_t count);
+    ClientId register_client(const std::string& client_id) { return clients.intern(client_id); }
+    // Sequences a phase change for each symbol not already in phase
+    void change_phase(const std::vector<SymbolId>& symbol_ids, TradingState phase);
+    TradingState get_phase(SymbolId symbol_id) const { return phases[symbol_id]; }
+    // Phase the schedule has now; TRADING without one
+    TradingState get_scheduled_phase() const { return scheduled_phase; }
     void send_market_data_snapshot(md_recovery_socket_t<MDRecoveryServer>* client, const std::string& symbol);
-    void publish_market_data(const MarketDataSnapshot& snapshot);
+    // Encoded full-depth image of the symbol, null until one has settled
+    SharedBuffer book_image(SymbolId symbol_id, BookImage::Depth depth);
+    void retransmit(md_recovery_socket_t<MDRecoveryServer>* client, uint64_t first, uint64_t count);
+    void publish_level_update(const LevelUpdate& update);
+    void publish_trade(const Fill& fill);
+    void publish_session_status(const SessionUpdate& update);
     
     const std::string& get_bind_ip() const { return bind_ip; }
+    const std::string& symbol_name(SymbolId id) const { return symbols.name(id); }
+    const std::string& client_name(ClientId id) const { return clients.name(id); }
+    
+private:
+    bool is_sharded() const { return config.shard_count > 0; }
+    MatchingShard& shard_for(SymbolId symbol_id) { return *shards[symbol_id % shards.size()]; }
+    SymbolId find_symbol(std::string_view symbol) const;
+    SymbolId find_or_add_symbol(std::string_view symbol);
+    SymbolId symbol_by_id(uint32_t symbol_id) const {
+        return symbol_id < symbols.size() ? symbol_id : StringInterner::kInvalidId;
+    }
+    void sequence(OrderRequest request, uint64_t now);
+    RejectReason check_instrument(const OrderRequest& request) const;
+    void open_session();
+    void advance_session(uint64_t now);
+    OrderRequest session_request(SymbolId symbol_id, TradingState phase);
+    bool parse_text_order(std::string_view order_msg, OrderRequest& request);
+    void publish_events(std::vector<ExecutionEvent>& events);
+    void publish_event(const ExecutionEvent& event);
+    void run_publisher();
+    void run_output_pump();
+    void dispatch(const OrderRequest& request);
+    void release_replicated();
+    void on_replication_progress();
+    uint64_t restore_checkpoint(BookCheckpoint::State& checkpoint);
+    void replay_journal(uint64_t after_sequence);
+    void apply_journal_record(const OrderJournal::Record& record);
+    void settle_replayed_books();
+    bool follow_primary();
+    void send_md_message(const void* msg, size_t length);
+    void encode_level(const LevelUpdate& update, LevelUpdateMsg& msg);
+    void encode_session(const SessionUpdate& update, SessionStatusMsg& msg);
+    static void apply_level_update(SymbolImage& image, const LevelUpdate& update);
+    size_t begin_packet(std::string& out, uint64_t sequence);
+    static void finish_packet(std::string& out, size_t offset, uint16_t message_count);
+    uint16_t append_symbol_snapshot(SymbolId symbol_id, std::string& out);
 };
\ No newline at end of file
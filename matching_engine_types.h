@@ -1,12 +1,19 @@
 #pragma once
 #include <cstdint>
-#include <string>
 #include <chrono>
 
+// Interned ids (see string_interner.h)
+using SymbolId = uint32_t;
+using ClientId = uint32_t;
+
 // Order types and structures
+// Only LIMIT and POST_ONLY orders rest; the others cancel whatever they cannot fill at once
 enum class OrderType : uint8_t {
     MARKET = 1,
-    LIMIT = 2
+    LIMIT = 2,
+    IOC = 3,                        // limit, immediate-or-cancel
+    FOK = 4,                        // limit, fill-or-kill: all or nothing
+    POST_ONLY = 5                   // limit, rejected if it would take liquidity
 };
 
 enum class OrderSide : uint8_t {
@@ -22,6 +29,16 @@ enum class OrderStatus : uint8_t {
     REJECTED = 5
 };
 
+// Trading phase of one symbol (see trading_session.h)
+enum class TradingState : uint8_t {
+    TRADING = 0,            // continuous matching
+    HALTED = 1,             // new and replace orders are rejected; cancels and modifies still act
+    PRE_OPEN = 2,           // limit orders rest without matching
+    OPENING_AUCTION = 3,    // as pre-open, with the indicative uncross published
+    CLOSING_AUCTION = 4,
+    CLOSED = 5              // cancels and modifies only
+};
+
 // Helper function to get current timestamp
 inline uint64_t get_current_timestamp() {
     return std::chrono::duration_cast<std::chrono::nanoseconds>(
@@ -39,9 +56,11 @@ inline double nanos_to_dollars(uint64_t nanos) {
     return static_cast<double>(nanos) / 1000000000.0;
 }
 
+struct PriceLevel;
+
 struct Order {
     uint64_t order_id;
-    std::string symbol;
+    SymbolId symbol_id;
     OrderSide side;
     OrderType type;
     uint64_t quantity;
@@ -49,11 +68,16 @@ struct Order {
     uint64_t price;
     uint64_t timestamp;
     OrderStatus status;
-    std::string client_id;
+    ClientId client_id;
     
-    Order(uint64_t id, const std::string& sym, OrderSide s, OrderType t, 
-          uint64_t qty, uint64_t px, const std::string& client)
-        : order_id(id), symbol(sym), side(s), type(t), quantity(qty), 
+    // Intrusive price level links, owned by the OrderBook while resting
+    Order* prev = nullptr;
+    Order* next = nullptr;
+    PriceLevel* level = nullptr;
+    
+    Order(uint64_t id, SymbolId sym, OrderSide s, OrderType t, 
+          uint64_t qty, uint64_t px, ClientId client)
+        : order_id(id), symbol_id(sym), side(s), type(t), quantity(qty), 
           remaining_quantity(qty), price(px), status(OrderStatus::NEW), 
           client_id(client) {
         timestamp = get_current_timestamp();
@@ -64,22 +88,27 @@ struct Fill {
     uint64_t fill_id;
     uint64_t buy_order_id;
     uint64_t sell_order_id;
-    std::string symbol;
+    SymbolId symbol_id;
+    ClientId buy_client_id;
+    ClientId sell_client_id;
+    OrderSide aggressor_side;       // the other order was resting
+    bool auction = false;           // uncross fill: both orders were resting, aggressor_side is the later one's
     uint64_t quantity;
     uint64_t price;
     uint64_t timestamp;
     
-    Fill(uint64_t id, uint64_t buy_id, uint64_t sell_id, const std::string& sym,
-         uint64_t qty, uint64_t px)
+    Fill(uint64_t id, uint64_t buy_id, uint64_t sell_id, SymbolId sym,
+         ClientId buy_client, ClientId sell_client, OrderSide aggressor, uint64_t qty, uint64_t px)
         : fill_id(id), buy_order_id(buy_id), sell_order_id(sell_id), 
-          symbol(sym), quantity(qty), price(px) {
+          symbol_id(sym), buy_client_id(buy_client), sell_client_id(sell_client),
+          aggressor_side(aggressor), quantity(qty), price(px) {
         timestamp = get_current_timestamp();
     }
 };
 
 // Market data structures
 struct MarketDataSnapshot {
-    std::string symbol;
+    SymbolId symbol_id = 0;
     uint64_t bid_price = 0;
     uint64_t bid_quantity = 0;
     uint64_t ask_price = 0;
@@ -87,4 +116,102 @@ struct MarketDataSnapshot {
     uint64_t last_trade_price = 0;
     uint64_t last_trade_quantity = 0;
     uint64_t timestamp = 0;
-};
\ No newline at end of file
+};
+
+// Inbound command decoded from either gateway protocol
+enum class RequestType : uint8_t {
+    NEW_ORDER = 1,
+    CANCEL_ORDER = 2,
+    REPLACE_ORDER = 3,
+    MODIFY_ORDER = 4,               // reduce remaining quantity in place, keeping time priority
+    SESSION_PHASE = 5               // trading phase change, sequenced by the engine itself
+};
+
+// Why pre-trade risk turned a request away (see risk_manager.h)
+enum class RejectReason : uint8_t {
+    NONE = 0,
+    QUANTITY = 1,
+    NOTIONAL = 2,
+    PRICE_BAND = 3,
+    OPEN_NOTIONAL = 4,
+    POSITION = 5,
+    THROTTLE = 6,
+    CAPACITY = 7,                   // client or symbol id beyond the risk tables, which cover every interned id
+    // Instrument directory checks, ahead of pre-trade risk; PRICE_BAND also
+    // covers the instrument's static band
+    TICK_SIZE = 8,
+    LOT_SIZE = 9,
+    HALTED = 10,
+    SESSION = 11,                   // the phase takes no new orders, or none of this type
+    JOURNAL = 12                    // the journal is full, so the command cannot be made durable
+};
+
+struct OrderRequest {
+    RequestType type = RequestType::NEW_ORDER;
+    OrderSide side = OrderSide::BUY;
+    OrderType order_type = OrderType::LIMIT;
+    SymbolId symbol_id = 0;
+    ClientId client_id = 0;
+    uint64_t order_id = 0;          // assigned by the engine to new and replacement orders
+    uint64_t orig_order_id = 0;     // target of cancel/replace/modify
+    uint64_t quantity = 0;          // new remaining quantity on modify
+    uint64_t price = 0;
+    uint64_t risk_price = 0;        // what risk reserved the notional at; the reference price for a market order
+    RejectReason reject_reason = RejectReason::NONE;    // set by risk; the shard only reports it
+    TradingState phase = TradingState::TRADING;         // SESSION_PHASE only
+};
+
+// Change to one price level within the published market data depth
+enum class LevelAction : uint8_t {
+    ADD = 1,
+    MODIFY = 2,
+    DELETE = 3
+};
+
+struct LevelUpdate {
+    SymbolId symbol_id;
+    OrderSide side;
+    LevelAction action;
+    uint8_t level;                  // position from the best price after the update
+    uint64_t price;
+    uint64_t quantity;              // 0 on DELETE
+    uint32_t order_count;
+};
+
+// Phase of a symbol and, during an auction call, where its book would uncross now;
+// on the update that ends a call, where it did
+struct SessionUpdate {
+    SymbolId symbol_id;
+    TradingState phase;
+    OrderSide imbalance_side;       // side left with quantity at the price
+    uint64_t price;                 // 0 while the book does not cross
+    uint64_t matched_quantity;
+    uint64_t imbalance_quantity;
+};
+
+// Output of the matching path, consumed by drop copy and market data
+enum class EventType : uint8_t {
+    ORDER_UPDATE = 1,
+    FILL = 2,
+    BOOK_UPDATE = 3,
+    LEVEL_UPDATE = 4,
+    SESSION_UPDATE = 5
+};
+
+struct ExecutionEvent {
+    EventType type;
+    union {
+        Order order;
+        Fill fill;
+        MarketDataSnapshot snapshot;
+        LevelUpdate level;
+        SessionUpdate session;
+    };
+    
+    ExecutionEvent() : type(EventType::BOOK_UPDATE), snapshot() {}
+    explicit ExecutionEvent(const Order& o) : type(EventType::ORDER_UPDATE), order(o) {}
+    explicit ExecutionEvent(const Fill& f) : type(EventType::FILL), fill(f) {}
+    explicit ExecutionEvent(const MarketDataSnapshot& s) : type(EventType::BOOK_UPDATE), snapshot(s) {}
+    explicit ExecutionEvent(const LevelUpdate& l) : type(EventType::LEVEL_UPDATE), level(l) {}
+    explicit ExecutionEvent(const SessionUpdate& s) : type(EventType::SESSION_UPDATE), session(s) {}
+};
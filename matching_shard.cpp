@@ -0,0 +1,424 @@
+#include "matching_shard.h"
+#include <algorithm>
+#include <cstdio>
+#include "log.h"
+#include "market_data_protocol.h"
+#include "stage_metrics.h"
+#include <pthread.h>
+#include <sched.h>
+#include <numa.h>
+
+void pin_thread_to_core(int core) {
+    if (core < 0) {
+        return;
+    }
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(core, &cpus);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0) {
+        LOG_WARN("[matching_shard] Failed to pin thread to core %d\n", core);
+    }
+    if (numa_available() >= 0) {
+        int node = numa_node_of_cpu(core);
+        if (node >= 0) {
+            numa_set_preferred(node);
+        }
+    }
+}
+
+MatchingShard::MatchingShard(size_t idx, const StringInterner& syms, size_t depth)
+    : inbound(kRingCapacity), outbound(kRingCapacity), index(idx), symbols(syms),
+      md_depth(std::clamp<size_t>(depth, 1, kMaxMdDepth)) {
+    events.reserve(kMaxBatch * 4);
+    current.bids.reserve(md_depth);
+    current.asks.reserve(md_depth);
+}
+
+MatchingShard::~MatchingShard() {
+    stop();
+}
+
+void MatchingShard::add_book(SymbolId symbol_id, const BookConfig& config) {
+    // Re-adding a symbol before materialize() replaces its configuration
+    auto existing = std::find_if(book_configs.begin(), book_configs.end(),
+                                 [symbol_id](const auto& entry) { return entry.first == symbol_id; });
+    if (existing != book_configs.end()) {
+        existing->second = config;
+    } else {
+        book_configs.emplace_back(symbol_id, config);
+    }
+    if (symbol_id >= books.size()) {
+        books.resize(symbol_id + 1);
+        md_dirty.resize(symbol_id + 1, 0);
+        published.resize(symbol_id + 1);
+        session_status.resize(symbol_id + 1);
+    }
+    session_status[symbol_id] = SessionUpdate{symbol_id, TradingState::TRADING, OrderSide::BUY, 0, 0, 0};
+    published[symbol_id].bids.reserve(md_depth);
+    published[symbol_id].asks.reserve(md_depth);
+    if (materialized) {
+        books[symbol_id] = make_order_book(symbol_id, config);
+    }
+}
+
+void MatchingShard::materialize() {
+    for (const auto& entry : book_configs) {
+        if (!books[entry.first]) {
+            books[entry.first] = make_order_book(entry.first, entry.second);
+        }
+    }
+    materialized = true;
+}
+
+OrderBook* MatchingShard::find_book(SymbolId symbol_id) {
+    return symbol_id < books.size() ? books[symbol_id].get() : nullptr;
+}
+
+void MatchingShard::execute(const OrderRequest& request) {
+    OrderBook* book = find_book(request.symbol_id);
+    if (!book) {
+        return;
+    }
+    if (request.reject_reason != RejectReason::NONE) {
+        reject(request);
+        return;
+    }
+    if (risk && (request.type == RequestType::NEW_ORDER || request.type == RequestType::REPLACE_ORDER)) {
+        risk->settle(request);
+    }
+    
+    uint64_t match_start = read_tsc();
+    switch (request.type) {
+        case RequestType::NEW_ORDER: handle_new_order(*book, request); break;
+        case RequestType::CANCEL_ORDER: handle_cancel_order(*book, request); break;
+        case RequestType::REPLACE_ORDER: handle_replace_order(*book, request); break;
+        case RequestType::MODIFY_ORDER: handle_modify_order(*book, request); break;
+        case RequestType::SESSION_PHASE: handle_session_phase(*book, request); break;
+    }
+    if (logging) {
+        record_stage_ticks(Stage::MATCH, match_start, read_tsc());
+    }
+    
+    mark_dirty(request.symbol_id);
+}
+
+size_t MatchingShard::restore_book(SymbolId symbol_id, uint64_t next_fill_id, TradingState phase,
+                                   const std::vector<Order>& orders) {
+    OrderBook* book = find_book(symbol_id);
+    if (!book) {
+        return 0;
+    }
+    book->set_phase(phase);
+    session_status[symbol_id].phase = phase;
+    size_t restored = 0;
+    for (const auto& order : orders) {
+        if (!book->restore_order(order)) {
+            LOG_WARN("[matching_shard] Cannot restore order %lu on %s\n", order.order_id, symbols.name(symbol_id).c_str());
+            continue;
+        }
+        if (risk) {
+            risk->open(order.client_id, symbol_id, order.side, order.remaining_quantity, order.price);
+        }
+        restored++;
+    }
+    book->set_next_fill_id(next_fill_id);
+    mark_dirty(symbol_id);
+    return restored;
+}
+
+void MatchingShard::capture_book(SymbolId symbol_id, uint64_t& next_fill_id, TradingState& phase,
+                                 std::vector<Order>& orders) const {
+    const OrderBook* book = symbol_id < books.size() ? books[symbol_id].get() : nullptr;
+    if (!book) {
+        return;
+    }
+    next_fill_id = book->get_next_fill_id();
+    phase = book->get_phase();
+    book->collect_orders(orders);
+}
+
+void MatchingShard::end_batch() {
+    for (SymbolId symbol_id : dirty_symbols) {
+        md_dirty[symbol_id] = 0;
+        OrderBook& book = *books[symbol_id];
+        PublishedDepth& last = published[symbol_id];
+        book.get_depth(md_depth, current.bids, current.asks);
+        
+        diff_levels(symbol_id, OrderSide::BUY, last.bids, current.bids);
+        diff_levels(symbol_id, OrderSide::SELL, last.asks, current.asks);
+        
+        auto same_top = [](const std::vector<DepthLevel>& a, const std::vector<DepthLevel>& b) {
+            if (a.empty() || b.empty()) {
+                return a.empty() == b.empty();
+            }
+            return a[0].price == b[0].price && a[0].quantity == b[0].quantity;
+        };
+        if (TradingSession::is_call(book.get_phase())) {
+            publish_indicative(symbol_id, book);
+        }
+        // Always closes the symbol's changes, so the full-depth image knows the
+        // feed has caught up with it
+        events.emplace_back(book.get_snapshot());
+        if (risk && (!same_top(last.bids, current.bids) || !same_top(last.asks, current.asks))) {
+            risk->on_top(events.back().snapshot);
+        }
+        
+        // Swapping keeps both buffers' capacity, so steady state does not allocate
+        last.bids.swap(current.bids);
+        last.asks.swap(current.asks);
+    }
+    dirty_symbols.clear();
+}
+
+// Merges two best-first level lists by price and emits the difference
+void MatchingShard::diff_levels(SymbolId symbol_id, OrderSide side,
+                                const std::vector<DepthLevel>& before, const std::vector<DepthLevel>& after) {
+    bool is_bid = (side == OrderSide::BUY);
+    auto better = [is_bid](uint64_t a, uint64_t b) { return is_bid ? a > b : a < b; };
+    auto emit = [&](LevelAction action, size_t position, const DepthLevel& level) {
+        bool removed = (action == LevelAction::DELETE);
+        events.emplace_back(LevelUpdate{symbol_id, side, action, static_cast<uint8_t>(position), level.price,
+                                        removed ? 0 : level.quantity, removed ? 0 : level.order_count});
+    };
+    
+    size_t i = 0;
+    size_t j = 0;
+    while (i < before.size() || j < after.size()) {
+        if (j == after.size() || (i < before.size() && better(before[i].price, after[j].price))) {
+            emit(LevelAction::DELETE, i, before[i]);
+            i++;
+        } else if (i == before.size() || better(after[j].price, before[i].price)) {
+            emit(LevelAction::ADD, j, after[j]);
+            j++;
+        } else {
+            if (before[i].quantity != after[j].quantity || before[i].order_count != after[j].order_count) {
+                emit(LevelAction::MODIFY, j, after[j]);
+            }
+            i++;
+            j++;
+        }
+    }
+}
+
+void MatchingShard::handle_new_order(OrderBook& book, const OrderRequest& request) {
+    // Log order with dollar conversion
+    if (logging) {
+        LOG_DEBUG("[matching_engine] Processing %s %lu %s at $%.9f (%lu nanos)\n",
+               (request.side == OrderSide::BUY) ? "BUY" : "SELL",
+               request.quantity, symbols.name(request.symbol_id).c_str(),
+               nanos_to_dollars(request.price), request.price);
+    }
+    
+    Order order(request.order_id, request.symbol_id, request.side, request.order_type,
+                request.quantity, request.price, request.client_id);
+    const auto& fills = book.add_order(order);
+    
+    events.emplace_back(order);
+    for (const auto& fill : fills) {
+        events.emplace_back(fill);
+    }
+    apply_self_trade_cancels(book);
+    if (risk) {
+        apply_fills_to_risk(order, fills);
+    }
+}
+
+void MatchingShard::apply_self_trade_cancels(const OrderBook& book) {
+    for (const auto& cancelled : book.get_self_trade_cancels()) {
+        events.emplace_back(cancelled);
+        if (risk) {
+            risk->close(cancelled.client_id, cancelled.symbol_id, cancelled.side, cancelled.remaining_quantity, cancelled.price);
+        }
+    }
+}
+
+// Resting counterparties close what traded at their own price; the new order opens what rested
+void MatchingShard::apply_fills_to_risk(const Order& order, const std::vector<Fill>& fills) {
+    OrderSide resting_side = (order.side == OrderSide::BUY) ? OrderSide::SELL : OrderSide::BUY;
+    for (const auto& fill : fills) {
+        ClientId resting_client = (order.side == OrderSide::BUY) ? fill.sell_client_id : fill.buy_client_id;
+        risk->close(resting_client, order.symbol_id, resting_side, fill.quantity, fill.price);
+        risk->on_fill(fill);
+    }
+    if (order.status == OrderStatus::NEW || order.status == OrderStatus::PARTIALLY_FILLED) {
+        risk->open(order.client_id, order.symbol_id, order.side, order.remaining_quantity, order.price);
+    }
+}
+
+void MatchingShard::handle_cancel_order(OrderBook& book, const OrderRequest& request) {
+    const Order* resting = book.find_order(request.orig_order_id);
+    if (!resting || resting->client_id != request.client_id) {
+        if (logging) {
+            LOG_DEBUG("[matching_engine] Cancel rejected for order %lu\n", request.orig_order_id);
+        }
+        reject(request);
+        return;
+    }
+    
+    Order cancelled = *resting;
+    if (risk) {
+        risk->close(cancelled.client_id, cancelled.symbol_id, cancelled.side, cancelled.remaining_quantity, cancelled.price);
+    }
+    book.cancel_order(request.orig_order_id);
+    cancelled.status = OrderStatus::CANCELLED;
+    events.emplace_back(cancelled);
+}
+
+// Replace is cancel-then-new: the replacement gets a fresh order id and loses time priority
+void MatchingShard::handle_replace_order(OrderBook& book, const OrderRequest& request) {
+    const Order* resting = book.find_order(request.orig_order_id);
+    if (!resting || resting->client_id != request.client_id) {
+        if (logging) {
+            LOG_DEBUG("[matching_engine] Replace rejected for order %lu\n", request.orig_order_id);
+        }
+        reject(request);
+        return;
+    }
+    
+    OrderRequest replacement = request;
+    replacement.type = RequestType::NEW_ORDER;
+    replacement.side = resting->side;
+    replacement.order_type = resting->type;
+    
+    handle_cancel_order(book, request);
+    handle_new_order(book, replacement);
+}
+
+// Quantity-down in place: the order keeps its id and its place in the level's queue
+void MatchingShard::handle_modify_order(OrderBook& book, const OrderRequest& request) {
+    const Order* resting = book.find_order(request.orig_order_id);
+    if (!resting || resting->client_id != request.client_id || request.quantity >= resting->remaining_quantity) {
+        if (logging) {
+            LOG_DEBUG("[matching_engine] Modify rejected for order %lu\n", request.orig_order_id);
+        }
+        reject(request);
+        return;
+    }
+    
+    Order modified = *resting;
+    uint64_t reduction = resting->remaining_quantity - request.quantity;
+    if (risk) {
+        risk->close(modified.client_id, modified.symbol_id, modified.side, reduction, modified.price);
+    }
+    book.reduce_order(request.orig_order_id, reduction);
+    modified.quantity -= reduction;
+    modified.remaining_quantity = request.quantity;
+    if (request.quantity == 0) {
+        modified.status = OrderStatus::CANCELLED;
+    }
+    events.emplace_back(modified);
+}
+
+// Phase changes come through the journal like orders, so replay, backups and the
+// checkpoint shadow all change phase at the same point in the stream. Leaving
+// pre-open, a call or a halt for continuous trading or the close uncrosses the
+// book; the update that announces the new phase then carries the result.
+void MatchingShard::handle_session_phase(OrderBook& book, const OrderRequest& request) {
+    TradingState previous = book.get_phase();
+    book.set_phase(request.phase);
+    
+    SessionUpdate& status = session_status[request.symbol_id];
+    status = SessionUpdate{request.symbol_id, request.phase, OrderSide::BUY, 0, 0, 0};
+    if (previous != TradingState::TRADING &&
+        (request.phase == TradingState::TRADING || request.phase == TradingState::CLOSED)) {
+        uncross(book, status, request.phase == TradingState::TRADING);
+    }
+    events.emplace_back(status);
+    if (logging) {
+        LOG_DEBUG("[matching_engine] %s: %s -> %s\n", symbols.name(request.symbol_id).c_str(),
+                  TradingSession::state_name(previous), TradingSession::state_name(request.phase));
+    }
+}
+
+// Both orders of an uncross fill were resting, so each closes what traded at its own limit
+void MatchingShard::uncross(OrderBook& book, SessionUpdate& status, bool continuous) {
+    Equilibrium result;
+    const auto& fills = book.uncross(result, continuous);
+    for (const auto& fill : fills) {
+        events.emplace_back(fill);
+    }
+    apply_self_trade_cancels(book);
+    if (risk) {
+        const auto& limits = book.get_uncross_limits();
+        for (size_t i = 0; i < fills.size(); ++i) {
+            const Fill& fill = fills[i];
+            risk->close(fill.buy_client_id, fill.symbol_id, OrderSide::BUY, fill.quantity, limits[i].buy_price);
+            risk->close(fill.sell_client_id, fill.symbol_id, OrderSide::SELL, fill.quantity, limits[i].sell_price);
+            risk->on_fill(fill);
+        }
+    }
+    
+    status.price = result.price;
+    status.matched_quantity = result.matched_quantity;
+    status.imbalance_quantity = result.imbalance_quantity;
+    status.imbalance_side = result.imbalance_side;
+    if (logging && !fills.empty()) {
+        LOG_DEBUG("[matching_engine] %s uncrossed %lu at $%.9f in %zu fills\n", symbols.name(status.symbol_id).c_str(),
+                  result.matched_quantity, nanos_to_dollars(result.price), fills.size());
+    }
+}
+
+// Calls only: republishes the indicative uncross when the batch moved it
+void MatchingShard::publish_indicative(SymbolId symbol_id, OrderBook& book) {
+    Equilibrium indicative = book.find_equilibrium();
+    SessionUpdate& status = session_status[symbol_id];
+    if (indicative.price == status.price && indicative.matched_quantity == status.matched_quantity &&
+        indicative.imbalance_quantity == status.imbalance_quantity &&
+        indicative.imbalance_side == status.imbalance_side) {
+        return;
+    }
+    status.price = indicative.price;
+    status.matched_quantity = indicative.matched_quantity;
+    status.imbalance_quantity = indicative.imbalance_quantity;
+    status.imbalance_side = indicative.imbalance_side;
+    events.emplace_back(status);
+}
+
+// Acknowledges a new order turned away by risk, or a cancel, replace or modify that
+// was, or that found no order of the client's to act on
+void MatchingShard::reject(const OrderRequest& request) {
+    uint64_t order_id = (request.type == RequestType::NEW_ORDER) ? request.order_id : request.orig_order_id;
+    Order rejected(order_id, request.symbol_id, request.side, request.order_type,
+                   request.quantity, request.price, request.client_id);
+    rejected.remaining_quantity = 0;
+    rejected.status = OrderStatus::REJECTED;
+    events.emplace_back(rejected);
+}
+
+void MatchingShard::start(int core) {
+    running.store(true, std::memory_order_release);
+    thread = std::thread(&MatchingShard::run, this, core);
+}
+
+void MatchingShard::stop() {
+    running.store(false, std::memory_order_release);
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void MatchingShard::run(int core) {
+    pin_thread_to_core(core);
+    // Books are allocated here so their pools land on this core's NUMA node
+    materialize();
+    ready.store(true, std::memory_order_release);
+    
+    OrderRequest request;
+    while (running.load(std::memory_order_acquire)) {
+        size_t count = 0;
+        while (count < kMaxBatch && inbound.try_pop(request)) {
+            execute(request);
+            count++;
+        }
+        if (count == 0) {
+            cpu_relax();
+            continue;
+        }
+        
+        end_batch();
+        for (const auto& event : events) {
+            outbound.push(event);
+        }
+        events.clear();
+    }
+}
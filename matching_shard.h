@@ -0,0 +1,112 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "matching_engine_types.h"
+#include "order_book.h"
+#include "risk_manager.h"
+#include "spsc_ring.h"
+#include "string_interner.h"
+#include "trading_session.h"
+
+// Owns the books for a subset of symbols and runs the matching path for them.
+// Inline mode calls execute() on the event loop thread; threaded mode drains
+// the inbound ring on a pinned core and pushes events to the outbound ring.
+class MatchingShard {
+public:
+    static constexpr size_t kRingCapacity = 65536;
+    static constexpr size_t kMaxBatch = 256;
+    
+    SpscRing<OrderRequest> inbound;
+    SpscRing<ExecutionEvent> outbound;
+    
+    // md_depth is clamped to what the feed can index (kMaxMdDepth)
+    MatchingShard(size_t index, const StringInterner& symbols, size_t md_depth);
+    ~MatchingShard();
+    MatchingShard(const MatchingShard&) = delete;
+    MatchingShard& operator=(const MatchingShard&) = delete;
+    
+    // Books are created by materialize() on the thread that will own them
+    void add_book(SymbolId symbol_id, const BookConfig& config);
+    void materialize();
+    
+    void execute(const OrderRequest& request);
+    // Diffs every book touched since the last call against its last published
+    // depth: emits LEVEL_UPDATEs for changed levels, during a call a SESSION_UPDATE
+    // if the indicative uncross moved, then a BOOK_UPDATE that closes the symbol's
+    // events for the batch
+    void end_batch();
+    std::vector<ExecutionEvent>& pending_events() { return events; }
+    
+    void start(int core);
+    void stop();
+    bool is_ready() const { return ready.load(std::memory_order_acquire); }
+    size_t get_index() const { return index; }
+    // Per-order logging and MATCH timing, turned off while replaying the journal
+    // and in a checkpoint shadow
+    void set_logging(bool enabled) { logging = enabled; }
+    // Exposure is kept current from this shard's rests, fills and cancels; null when risk is off
+    void set_risk(RiskManager* manager) { risk = manager; }
+    
+    // Checkpoint support, on the thread that owns the books. restore_book puts the
+    // book in phase, rests orders in the order capture_book listed them and opens
+    // their exposure; the symbol is published at the next end_batch
+    size_t restore_book(SymbolId symbol_id, uint64_t next_fill_id, TradingState phase,
+                        const std::vector<Order>& orders);
+    void capture_book(SymbolId symbol_id, uint64_t& next_fill_id, TradingState& phase,
+                      std::vector<Order>& orders) const;
+                      
+private:
+    size_t index;
+    const StringInterner& symbols;
+    std::vector<std::unique_ptr<OrderBook>> books;
+    std::vector<std::pair<SymbolId, BookConfig>> book_configs;
+    bool materialized = false;
+    bool logging = true;
+    RiskManager* risk = nullptr;
+    
+    std::vector<ExecutionEvent> events;
+    std::vector<uint8_t> md_dirty;
+    std::vector<SymbolId> dirty_symbols;
+    
+    // Depth last published per symbol, plus scratch for the current one
+    struct PublishedDepth {
+        std::vector<DepthLevel> bids;
+        std::vector<DepthLevel> asks;
+    };
+    size_t md_depth;
+    std::vector<PublishedDepth> published;
+    PublishedDepth current;
+    // Session state last published per symbol
+    std::vector<SessionUpdate> session_status;
+    
+    std::thread thread;
+    std::atomic<bool> running{false};
+    std::atomic<bool> ready{false};
+    
+    void run(int core);
+    OrderBook* find_book(SymbolId symbol_id);
+    void mark_dirty(SymbolId symbol_id) {
+        if (!md_dirty[symbol_id]) {
+            md_dirty[symbol_id] = 1;
+            dirty_symbols.push_back(symbol_id);
+        }
+    }
+    void handle_new_order(OrderBook& book, const OrderRequest& request);
+    void handle_cancel_order(OrderBook& book, const OrderRequest& request);
+    void handle_replace_order(OrderBook& book, const OrderRequest& request);
+    void handle_modify_order(OrderBook& book, const OrderRequest& request);
+    void handle_session_phase(OrderBook& book, const OrderRequest& request);
+    void uncross(OrderBook& book, SessionUpdate& status, bool continuous);
+    void publish_indicative(SymbolId symbol_id, OrderBook& book);
+    void reject(const OrderRequest& request);
+    void apply_fills_to_risk(const Order& order, const std::vector<Fill>& fills);
+    void apply_self_trade_cancels(const OrderBook& book);
+    void diff_levels(SymbolId symbol_id, OrderSide side,
+                     const std::vector<DepthLevel>& before, const std::vector<DepthLevel>& after);
+};
+
+// Pins the calling thread to core and prefers that core's NUMA node for new allocations
+void pin_thread_to_core(int core);
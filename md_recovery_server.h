@@ -1,8 +1,18 @@
 #pragma once
 #include <string>
 #include <cstdio>
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <string_view>
+#include <utility>
+#include <vector>
 #include <sys/socket.h>
 #include "../TradeCoreExport/tcp_server_socket.h"
+#include "log.h"
+#include "book_image.h"
+#include "line_framing.h"
+#include "subscriber_output.h"
 
 // Market Data Recovery Server Socket  
 template<typename server_t>
@@ -10,38 +20,72 @@ class md_recovery_socket_t : public tcp_server_socket_t {
 public:
     server_t* parent_server;
     std::string subscriber_id;
+    std::vector<uint8_t> rxbuf;
+    // Replies not yet accepted by the socket; guarded by the server's clients_mutex
+    SubscriberOutput output;
+    // BOOK requests still to send, and the image being streamed out in slices;
+    // guarded by clients_mutex like output
+    std::deque<std::pair<SymbolId, BookImage::Depth>> pending_images;
+    SharedBuffer image_buffer;
+    size_t image_offset = 0;
     
     // Constructor
     md_recovery_socket_t(int fd, sockaddr_in clientaddr, socklen_t clientlen,
                         sockaddr_in local_addr, uint16_t local_port_, tcp_server_t* parent)
         : tcp_server_socket_t(fd, clientaddr, clientlen, local_addr, local_port_, parent),
-          parent_server(nullptr), subscriber_id("mdrecovery_" + std::to_string(fd)) {}
+          parent_server(nullptr), subscriber_id("mdrecovery_" + std::to_string(fd)),
+          output(fd, "md_recovery", subscriber_id) {}
     
     size_t handle_packet(const uint8_t* buf, const size_t len, uint64_t ts, void* sock, bool& should_disconnect) override;
     void gen_shm_name(const int fd, char* buf) override;
     void on_add() override;
     void on_remove() override;
     
+    // Queues msg and sends what the socket takes now; the rest goes out on later flushes
     void send_message(const std::string& msg);
+    
+private:
+    void handle_request(const std::string& request);
 };
 
 // Implementation
+// Requests are one per line and may be pipelined or split across reads
 template<typename server_t>
-size_t md_recovery_socket_t<server_t>::handle_packet(const uint8_t* buf, const size_t len, uint64_t, void*, bool&) {
-    std::string request(reinterpret_cast<const char*>(buf), len);
-    
-    // Remove newline if present
-    if (!request.empty() && request.back() == '\n') {
-        request.pop_back();
+size_t md_recovery_socket_t<server_t>::handle_packet(const uint8_t* buf, const size_t len, uint64_t, void*, bool& should_disconnect) {
+    bool framed = frame_lines(rxbuf, buf, len, kMaxRequestLineLength, [this](std::string_view line) {
+        if (!line.empty()) {
+            handle_request(std::string(line));
+        }
+    });
+    if (!framed) {
+        LOG_WARN("[md_recovery] Subscriber %s sent an unterminated line, disconnecting\n", subscriber_id.c_str());
+        should_disconnect = true;
     }
-    
-    // Parse market data request
+    return len;
+}
+
+template<typename server_t>
+void md_recovery_socket_t<server_t>::handle_request(const std::string& request) {
     if (request.length() > 9 && request.substr(0, 9) == "SNAPSHOT:" && parent_server) {
         std::string symbol = request.substr(9);
         parent_server->send_snapshot(this, symbol);
+    } else if (request.length() > 8 && (request.substr(0, 8) == "BOOK:L2:" || request.substr(0, 8) == "BOOK:L3:") &&
+               parent_server) {
+        // BOOK:L2:<symbol> or BOOK:L3:<symbol>, * for every symbol
+        BookImage::Depth depth = (request[6] == '2') ? BookImage::LEVELS : BookImage::ORDERS;
+        parent_server->send_book_images(this, depth, request.substr(8));
+    } else if (request == "STATS" && parent_server) {
+        parent_server->send_stats(this);
+    } else if (request == "DIRECTORY" && parent_server) {
+        parent_server->send_directory(this);
+    } else if (request.length() > 8 && request.substr(0, 8) == "RETRANS:" && parent_server) {
+        // RETRANS:<first_sequence>:<count>
+        unsigned long long first = 0;
+        unsigned long long count = 0;
+        if (sscanf(request.c_str() + 8, "%llu:%llu", &first, &count) == 2) {
+            parent_server->send_retransmission(this, first, count);
+        }
     }
-    
-    return len;
 }
 
 template<typename server_t>
@@ -51,15 +95,23 @@ void md_recovery_socket_t<server_t>::gen_shm_name(const int fd, char* buf) {
 
 template<typename server_t>
 void md_recovery_socket_t<server_t>::on_add() {
-    printf("[md_recovery] Subscriber %s connected (fd=%d)\n", subscriber_id.c_str(), get_fd());
+    LOG_INFO("[md_recovery] Subscriber %s connected (fd=%d)\n", subscriber_id.c_str(), get_fd());
 }
 
 template<typename server_t>
 void md_recovery_socket_t<server_t>::on_remove() {
-    printf("[md_recovery] Subscriber %s disconnected (fd=%d)\n", subscriber_id.c_str(), get_fd());
+    LOG_INFO("[md_recovery] Subscriber %s disconnected (fd=%d)\n", subscriber_id.c_str(), get_fd());
+    if (parent_server) {
+        std::lock_guard<std::mutex> lock(parent_server->clients_mutex);
+        auto& clients = parent_server->clients;
+        clients.erase(std::remove(clients.begin(), clients.end(), this), clients.end());
+    }
 }
 
 template<typename server_t>
 void md_recovery_socket_t<server_t>::send_message(const std::string& msg) {
-    ::send(get_fd(), msg.c_str(), msg.length(), 0);
-}
\ No newline at end of file
+    std::lock_guard<std::mutex> lock(parent_server->clients_mutex);
+    // Replies are never conflated: a recovering client needs every reply it asked for
+    output.push(msg.data(), msg.size());
+    output.flush();
+}
@@ -1,26 +1,63 @@
 #pragma once
 #include <string>
 #include <cstdio>
+#include <cerrno>
+#include <cstring>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include "../TradeCoreExport/udp_client_socket.h"
+#include "market_data_protocol.h"
+#include "matching_engine_types.h"
+#include "log.h"
+#include "stage_metrics.h"
+
+// Coalescing counters; messages / packets and packets / send_calls give the batching ratios.
+// packets counts only what the kernel took; dropped_packets were discarded after a
+// failed or short sendmmsg and leave a gap receivers fill from MD recovery
+struct PublisherStats {
+    uint64_t messages = 0;
+    uint64_t packets = 0;
+    uint64_t send_calls = 0;
+    uint64_t dropped_packets = 0;
+};
 
 // Multicast Publisher class
+// Messages are packed into MTU-sized packets and sent with one sendmmsg per flush.
+// A flush happens when the caller ends a batch, when the pending packets are all
+// full, or when the oldest pending message has been held for max_hold_ns.
 class MulticastPublisher : public udp_client_socket_t {
+public:
+    static constexpr size_t kMaxPendingPackets = 32;
+    
 private:
     std::string multicast_ip;
     uint16_t multicast_port;
+    uint8_t channel;
+    uint64_t next_sequence = 1;
+    uint64_t max_hold_ns;
+    
+    struct Packet {
+        size_t length;
+        uint8_t data[kMaxPacketSize];
+    };
+    Packet packets[kMaxPendingPackets];
+    size_t pending_packets = 0;         // packets in use, the last one still open
+    uint64_t oldest_pending_ts = 0;
+    PublisherStats stats;
     
 public:
     // Constructor
-    MulticastPublisher(const std::string& ip, uint16_t port, const std::string& bind_ip)
-        : udp_client_socket_t(ip, port, bind_ip), multicast_ip(ip), multicast_port(port) {}
+    MulticastPublisher(const std::string& ip, uint16_t port, const std::string& bind_ip,
+                       uint8_t channel_id = 1, uint64_t max_hold = 50000)
+        : udp_client_socket_t(ip, port, bind_ip), multicast_ip(ip), multicast_port(port),
+          channel(channel_id), max_hold_ns(max_hold) {}
     
     void on_add() override {
-        printf("[multicast] Publisher started on %s:%d\n", multicast_ip.c_str(), multicast_port);
+        LOG_INFO("[multicast] Publisher started on %s:%d\n", multicast_ip.c_str(), multicast_port);
     }
     
     void on_remove() override {
-        printf("[multicast] Publisher stopped\n");
+        LOG_INFO("[multicast] Publisher stopped\n");
     }
     
     bool handle_packet(const uint8_t*, const size_t, uint64_t) override {
@@ -30,4 +67,93 @@ public:
     void send_message(const std::string& msg) {
         ::send(get_fd(), msg.c_str(), msg.length(), 0);
     }
-};
\ No newline at end of file
+    
+    // Queues msg in the open packet and returns the sequence it was given
+    uint64_t publish(const void* msg, size_t length) {
+        if (pending_packets == 0 || packets[pending_packets - 1].length + length > kMaxPacketSize) {
+            if (pending_packets == kMaxPendingPackets) {
+                flush();
+            }
+            open_packet();
+        }
+        
+        Packet& packet = packets[pending_packets - 1];
+        memcpy(packet.data + packet.length, msg, length);
+        packet.length += length;
+        
+        PacketHeader* header = reinterpret_cast<PacketHeader*>(packet.data);
+        header->length = static_cast<uint16_t>(packet.length);
+        header->message_count++;
+        stats.messages++;
+        
+        uint64_t sequence = next_sequence++;
+        if (oldest_pending_ts == 0) {
+            oldest_pending_ts = get_current_timestamp();
+        } else if (get_current_timestamp() - oldest_pending_ts >= max_hold_ns) {
+            flush();
+        }
+        return sequence;
+    }
+    
+    // Sends every pending packet in one sendmmsg call
+    void flush() {
+        if (pending_packets == 0) {
+            return;
+        }
+        
+        mmsghdr msgs[kMaxPendingPackets];
+        iovec iovs[kMaxPendingPackets];
+        memset(msgs, 0, sizeof(mmsghdr) * pending_packets);
+        for (size_t i = 0; i < pending_packets; ++i) {
+            iovs[i].iov_base = packets[i].data;
+            iovs[i].iov_len = packets[i].length;
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        
+        uint64_t send_start = read_tsc();
+        size_t sent = 0;
+        int error = 0;
+        while (sent < pending_packets) {
+            int result = sendmmsg(get_fd(), msgs + sent, pending_packets - sent, 0);
+            stats.send_calls++;
+            if (result <= 0) {
+                error = (result < 0) ? errno : 0;
+                break;
+            }
+            sent += result;
+        }
+        record_stage_ticks(Stage::MULTICAST, send_start, read_tsc());
+        
+        stats.packets += sent;
+        if (sent < pending_packets) {
+            size_t dropped = pending_packets - sent;
+            stats.dropped_packets += dropped;
+            LOG_WARN("[multicast] Dropped %zu of %zu packets from sequence %lu: %s\n", dropped, pending_packets,
+                     first_sequence(sent), error ? strerror(error) : "nothing sent");
+        }
+        pending_packets = 0;
+        oldest_pending_ts = 0;
+    }
+    
+    uint8_t get_channel() const { return channel; }
+    const PublisherStats& get_stats() const { return stats; }
+    
+private:
+    uint64_t first_sequence(size_t packet) const {
+        PacketHeader header;
+        memcpy(&header, packets[packet].data, sizeof(header));
+        return header.sequence;
+    }
+    
+    void open_packet() {
+        Packet& packet = packets[pending_packets++];
+        PacketHeader header;
+        header.length = sizeof(PacketHeader);
+        header.channel = channel;
+        header.message_count = 0;
+        header.sequence = next_sequence;
+        memcpy(packet.data, &header, sizeof(header));
+        packet.length = sizeof(PacketHeader);
+    }
+};
@@ -0,0 +1,112 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+// Allocation counters exposed by each OrderBook
+struct AllocationStats {
+    uint64_t heap_allocations = 0;   // slabs, oversize blocks and fill buffer growth
+    uint64_t pool_allocations = 0;   // blocks served from the pool
+    uint64_t pool_in_use = 0;        // blocks currently handed out
+};
+
+// Per-book slab pool of fixed-size blocks for orders and container nodes.
+// Blocks are grouped into 16-byte size classes with an intrusive free list each;
+// freed blocks are reused and slabs are only released when the pool is destroyed.
+class NodePool {
+    static constexpr size_t kGranularity = 16;
+    static constexpr size_t kClassCount = 16;   // blocks up to 256 bytes
+    
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+    
+    FreeBlock* free_lists[kClassCount] = {};
+    std::vector<std::unique_ptr<unsigned char[]>> slabs;
+    size_t blocks_per_slab;
+    AllocationStats stats;
+    
+public:
+    explicit NodePool(size_t blocks_per_slab_ = 4096) : blocks_per_slab(blocks_per_slab_) {}
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+    
+    void* allocate(size_t size) {
+        if (size == 0 || size > kGranularity * kClassCount) {
+            stats.heap_allocations++;
+            return ::operator new(size);
+        }
+        size_t cls = (size - 1) / kGranularity;
+        if (!free_lists[cls]) {
+            refill(cls);
+        }
+        FreeBlock* block = free_lists[cls];
+        free_lists[cls] = block->next;
+        stats.pool_allocations++;
+        stats.pool_in_use++;
+        return block;
+    }
+    
+    void deallocate(void* ptr, size_t size) {
+        if (size == 0 || size > kGranularity * kClassCount) {
+            ::operator delete(ptr);
+            return;
+        }
+        size_t cls = (size - 1) / kGranularity;
+        FreeBlock* block = static_cast<FreeBlock*>(ptr);
+        block->next = free_lists[cls];
+        free_lists[cls] = block;
+        stats.pool_in_use--;
+    }
+    
+    // Carves slabs up front so the first blocks_per_slab allocations of this size never hit the heap
+    void reserve(size_t size) {
+        if (size > 0 && size <= kGranularity * kClassCount && !free_lists[(size - 1) / kGranularity]) {
+            refill((size - 1) / kGranularity);
+        }
+    }
+    
+    void note_heap_allocation() { stats.heap_allocations++; }
+    const AllocationStats& get_stats() const { return stats; }
+    
+private:
+    void refill(size_t cls) {
+        size_t block_size = (cls + 1) * kGranularity;
+        slabs.emplace_back(new unsigned char[block_size * blocks_per_slab]);
+        stats.heap_allocations++;
+        unsigned char* base = slabs.back().get();
+        for (size_t i = blocks_per_slab; i-- > 0;) {
+            FreeBlock* block = reinterpret_cast<FreeBlock*>(base + i * block_size);
+            block->next = free_lists[cls];
+            free_lists[cls] = block;
+        }
+    }
+};
+
+// Standard allocator adaptor so node-based containers draw from a NodePool
+template<typename T>
+class PoolAllocator {
+public:
+    using value_type = T;
+    
+    NodePool* pool;
+    
+    explicit PoolAllocator(NodePool& p) : pool(&p) {}
+    template<typename U>
+    PoolAllocator(const PoolAllocator<U>& other) : pool(other.pool) {}
+    
+    T* allocate(size_t n) {
+        return static_cast<T*>(pool->allocate(n * sizeof(T)));
+    }
+    
+    void deallocate(T* ptr, size_t n) {
+        pool->deallocate(ptr, n * sizeof(T));
+    }
+    
+    template<typename U>
+    bool operator==(const PoolAllocator<U>& other) const { return pool == other.pool; }
+    template<typename U>
+    bool operator!=(const PoolAllocator<U>& other) const { return pool != other.pool; }
+};
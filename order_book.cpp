@@ -1,162 +1,486 @@
 #include "order_book.h"
 #include <algorithm>
 
-OrderBook::OrderBook(const std::string& sym) : symbol(sym) {}
+std::unique_ptr<OrderBook> make_order_book(SymbolId symbol_id, const BookConfig& config) {
+    if (config.backend == BookBackend::LADDER && config.tick_size > 0 && config.max_price >= config.min_price) {
+        return std::make_unique<LadderOrderBook>(symbol_id, config);
+    }
+    return std::make_unique<MapOrderBook>(symbol_id, config);
+}
+
+OrderBook::OrderBook(SymbolId sym, const BookConfig& config)
+    : symbol_id(sym), pool(config.order_capacity), order_map(0, std::hash<uint64_t>(), std::equal_to<uint64_t>(),
+                                                          OrderMap::allocator_type(pool)),
+      self_trade_prevention(config.self_trade_prevention) {
+    order_map.reserve(config.order_capacity);
+    fills.reserve(kFillBufferCapacity);
+    self_trade_cancels.reserve(kFillBufferCapacity);
+    uncross_limits.reserve(kFillBufferCapacity);
+    pool.reserve(sizeof(Order));
+}
+
+template<template<bool> class Levels>
+BasicOrderBook<Levels>::BasicOrderBook(SymbolId sym, const BookConfig& config)
+    : OrderBook(sym, config), bids(config, pool), asks(config, pool) {}
+
+template<template<bool> class Levels>
+BasicOrderBook<Levels>::~BasicOrderBook() {
+    for (auto& entry : order_map) {
+        entry.second->~Order();
+        pool.deallocate(entry.second, sizeof(Order));
+    }
+}
 
-std::vector<Fill> OrderBook::add_order(std::shared_ptr<Order> order) {
-    order_map[order->order_id] = order;
+template<template<bool> class Levels>
+const std::vector<Fill>& BasicOrderBook<Levels>::add_order(Order& order) {
+    fills.clear();
+    self_trade_cancels.clear();
     
-    if (order->type == OrderType::MARKET) {
-        return match_order(order);
-    } else {
-        auto fills = match_order(order);
-        if (order->remaining_quantity > 0) {
-            add_to_book(order);
-        }
+    if (phase != TradingState::TRADING) {
+        accumulate(order);
         return fills;
     }
+    
+    // The only runtime dispatch on order type; everything below is specialised per type
+    switch (order.type) {
+        case OrderType::LIMIT: match_order<OrderType::LIMIT>(order); break;
+        case OrderType::MARKET: match_order<OrderType::MARKET>(order); break;
+        case OrderType::IOC: match_order<OrderType::IOC>(order); break;
+        case OrderType::FOK: match_order<OrderType::FOK>(order); break;
+        case OrderType::POST_ONLY: match_order<OrderType::POST_ONLY>(order); break;
+        default: order.status = OrderStatus::REJECTED; break;
+    }
+    return fills;
 }
 
-std::vector<Fill> OrderBook::match_order(std::shared_ptr<Order> order) {
-    std::vector<Fill> fills;
+template<template<bool> class Levels>
+template<OrderType Type>
+void BasicOrderBook<Levels>::match_order(Order& order) {
+    // Orders that may rest need a price the book can hold
+    if constexpr (Type == OrderType::LIMIT || Type == OrderType::POST_ONLY) {
+        bool on_ladder = (order.side == OrderSide::BUY) ? bids.accepts(order.price) : asks.accepts(order.price);
+        if (!on_ladder) {
+            order.status = OrderStatus::REJECTED;
+            return;
+        }
+    }
     
-    if (order->side == OrderSide::BUY) {
+    if (order.side == OrderSide::BUY) {
         // Match against asks
-        auto it = asks.begin();
-        while (it != asks.end() && order->remaining_quantity > 0) {
-            if (order->type == OrderType::LIMIT && it->first > order->price) {
+        match_side<Type>(asks, order);
+    } else {
+        // Match against bids
+        match_side<Type>(bids, order);
+    }
+}
+
+template<template<bool> class Levels>
+template<OrderType Type, typename Side>
+void BasicOrderBook<Levels>::match_side(Side& side, Order& order) {
+    if constexpr (Type == OrderType::POST_ONLY) {
+        const PriceLevel* best = side.best();
+        if (best && crosses<Side::is_bid>(best->price, order.price)) {
+            order.status = OrderStatus::REJECTED;
+            return;
+        }
+        add_to_book(order);
+        return;
+    }
+    if constexpr (Type == OrderType::FOK) {
+        if (!can_fill(side, order)) {
+            order.status = OrderStatus::CANCELLED;
+            return;
+        }
+    }
+    
+    bool stopped = match_against<Type>(side, order);
+    
+    // Update order status
+    if (order.remaining_quantity == 0) {
+        order.status = OrderStatus::FILLED;
+    } else if (stopped) {
+        order.status = OrderStatus::CANCELLED;
+    } else if constexpr (Type == OrderType::LIMIT) {
+        if (order.remaining_quantity < order.quantity) {
+            order.status = OrderStatus::PARTIALLY_FILLED;
+        }
+        add_to_book(order);
+    } else {
+        // Market and IOC remainders are cancelled rather than rested
+        order.status = OrderStatus::CANCELLED;
+    }
+}
+
+// Fill-or-kill pre-check over level totals: stops at the first level that no longer
+// crosses or once enough is found, without visiting the orders within a level. It
+// counts the client's own orders, so with self-trade prevention on a FOK can still
+// be stopped part way.
+template<template<bool> class Levels>
+template<typename Side>
+bool BasicOrderBook<Levels>::can_fill(const Side& side, const Order& order) const {
+    uint64_t available = 0;
+    side.for_each([&](const PriceLevel& level) {
+        if (!crosses<Side::is_bid>(level.price, order.price)) {
+            return false;
+        }
+        available += level.total_quantity;
+        return available < order.remaining_quantity;
+    });
+    return available >= order.remaining_quantity;
+}
+
+template<template<bool> class Levels>
+template<OrderType Type, typename Side>
+bool BasicOrderBook<Levels>::match_against(Side& side, Order& order) {
+    bool stopped = false;
+    while (order.remaining_quantity > 0 && !stopped) {
+        PriceLevel* level = side.best();
+        if (!level) {
+            break;
+        }
+        if constexpr (Type != OrderType::MARKET) {
+            if (!crosses<Side::is_bid>(level->price, order.price)) {
                 break;
             }
+        }
+        
+        while (!level->empty() && order.remaining_quantity > 0) {
+            Order* resting = level->head;
             
-            auto& queue = it->second;
-            while (!queue.empty() && order->remaining_quantity > 0) {
-                auto ask_order = queue.front();
-                
-                uint64_t trade_qty = std::min(order->remaining_quantity, ask_order->remaining_quantity);
-                uint64_t trade_price = ask_order->price;
-                
-                Fill fill(next_fill_id++, order->order_id, ask_order->order_id, 
-                         symbol, trade_qty, trade_price);
-                fills.push_back(fill);
-                
-                order->remaining_quantity -= trade_qty;
-                ask_order->remaining_quantity -= trade_qty;
-                
-                if (ask_order->remaining_quantity == 0) {
-                    ask_order->status = OrderStatus::FILLED;
-                    queue.pop();
-                } else {
-                    ask_order->status = OrderStatus::PARTIALLY_FILLED;
+            // The owner id sits in the resting order's first cache line, already loaded to trade
+            if (resting->client_id == order.client_id && self_trade_prevention != SelfTradePrevention::NONE) {
+                if (self_trade_prevention != SelfTradePrevention::CANCEL_AGGRESSOR) {
+                    resting->status = OrderStatus::CANCELLED;
+                    self_trade_cancels.push_back(*resting);
+                    remove_from_book(resting);
                 }
+                if (self_trade_prevention != SelfTradePrevention::CANCEL_RESTING) {
+                    stopped = true;
+                    break;
+                }
+                continue;
             }
             
-            if (queue.empty()) {
-                it = asks.erase(it);
-            } else {
-                ++it;
+            uint64_t trade_qty = std::min(order.remaining_quantity, resting->remaining_quantity);
+            uint64_t trade_price = resting->price;
+            
+            if (fills.size() == fills.capacity()) {
+                pool.note_heap_allocation();
             }
-        }
-    } else {
-        // Match against bids
-        auto it = bids.begin();
-        while (it != bids.end() && order->remaining_quantity > 0) {
-            if (order->type == OrderType::LIMIT && it->first < order->price) {
-                break;
+            if constexpr (Side::is_bid) {
+                fills.emplace_back(next_fill_id++, resting->order_id, order.order_id, symbol_id,
+                                   resting->client_id, order.client_id, OrderSide::SELL, trade_qty, trade_price);
+            } else {
+                fills.emplace_back(next_fill_id++, order.order_id, resting->order_id, symbol_id,
+                                   order.client_id, resting->client_id, OrderSide::BUY, trade_qty, trade_price);
             }
             
-            auto& queue = it->second;
-            while (!queue.empty() && order->remaining_quantity > 0) {
-                auto bid_order = queue.front();
-                
-                uint64_t trade_qty = std::min(order->remaining_quantity, bid_order->remaining_quantity);
-                uint64_t trade_price = bid_order->price;
-                
-                Fill fill(next_fill_id++, bid_order->order_id, order->order_id,
-                         symbol, trade_qty, trade_price);
-                fills.push_back(fill);
-                
-                order->remaining_quantity -= trade_qty;
-                bid_order->remaining_quantity -= trade_qty;
-                
-                if (bid_order->remaining_quantity == 0) {
-                    bid_order->status = OrderStatus::FILLED;
-                    queue.pop();
-                } else {
-                    bid_order->status = OrderStatus::PARTIALLY_FILLED;
-                }
-            }
+            order.remaining_quantity -= trade_qty;
+            resting->remaining_quantity -= trade_qty;
+            level->total_quantity -= trade_qty;
             
-            if (queue.empty()) {
-                it = bids.erase(it);
+            if (resting->remaining_quantity == 0) {
+                resting->status = OrderStatus::FILLED;
+                remove_from_book(resting);
             } else {
-                ++it;
+                resting->status = OrderStatus::PARTIALLY_FILLED;
             }
         }
+        
+        if (level->empty()) {
+            side.erase(*level);
+        }
+    }
+    return stopped;
+}
+
+// Pre-open and calls: orders that can wait for the uncross rest unmatched, even
+// across the spread
+template<template<bool> class Levels>
+void BasicOrderBook<Levels>::accumulate(Order& order) {
+    if (order.type != OrderType::LIMIT && order.type != OrderType::POST_ONLY) {
+        order.status = OrderStatus::CANCELLED;
+        return;
     }
+    bool on_ladder = (order.side == OrderSide::BUY) ? bids.accepts(order.price) : asks.accepts(order.price);
+    if (!on_ladder) {
+        order.status = OrderStatus::REJECTED;
+        return;
+    }
+    add_to_book(order);
+}
+
+// Collects the crossed levels of each side, then makes one pass up their merged
+// prices carrying the cumulative volume each side would trade at each: asks at or
+// below the price and bids at or above it. Every level is visited twice at most,
+// and nothing outside the crossed range at all.
+template<template<bool> class Levels>
+Equilibrium BasicOrderBook<Levels>::find_equilibrium() {
+    Equilibrium result;
+    const PriceLevel* best_bid = bids.best();
+    const PriceLevel* best_ask = asks.best();
+    if (!best_bid || !best_ask || best_bid->price < best_ask->price) {
+        return result;
+    }
+    uint64_t low = best_ask->price;
+    uint64_t high = best_bid->price;
     
-    // Update order status
-    if (order->remaining_quantity == 0) {
-        order->status = OrderStatus::FILLED;
-    } else if (order->remaining_quantity < order->quantity) {
-        order->status = OrderStatus::PARTIALLY_FILLED;
+    uint64_t demand = 0;
+    auction_bids.clear();
+    auction_asks.clear();
+    bids.for_each([&](const PriceLevel& level) {
+        if (level.price < low) {
+            return false;
+        }
+        auction_bids.push_back(DepthLevel{level.price, level.total_quantity, level.order_count});
+        demand += level.total_quantity;
+        return true;
+    });
+    asks.for_each([&](const PriceLevel& level) {
+        if (level.price > high) {
+            return false;
+        }
+        auction_asks.push_back(DepthLevel{level.price, level.total_quantity, level.order_count});
+        return true;
+    });
+    
+    // Bids are best first, so the lowest is last
+    uint64_t supply = 0;
+    size_t bid = auction_bids.size();
+    size_t ask = 0;
+    while (bid > 0 || ask < auction_asks.size()) {
+        uint64_t price = std::min(bid > 0 ? auction_bids[bid - 1].price : UINT64_MAX,
+                                  ask < auction_asks.size() ? auction_asks[ask].price : UINT64_MAX);
+        if (ask < auction_asks.size() && auction_asks[ask].price == price) {
+            supply += auction_asks[ask++].quantity;
+        }
+        
+        uint64_t matched = std::min(demand, supply);
+        uint64_t imbalance = (demand > supply) ? demand - supply : supply - demand;
+        // Among equal prices a higher one wins only while buyers are left over
+        if (matched > result.matched_quantity ||
+            (matched == result.matched_quantity &&
+             (imbalance < result.imbalance_quantity || (imbalance == result.imbalance_quantity && demand > supply)))) {
+            result.price = price;
+            result.matched_quantity = matched;
+            result.imbalance_quantity = imbalance;
+            result.imbalance_side = (demand > supply) ? OrderSide::BUY : OrderSide::SELL;
+        }
+        
+        if (bid > 0 && auction_bids[bid - 1].price == price) {
+            demand -= auction_bids[--bid].quantity;
+        }
     }
+    return result;
+}
+
+template<template<bool> class Levels>
+const std::vector<Fill>& BasicOrderBook<Levels>::uncross(Equilibrium& result, bool continuous) {
+    fills.clear();
+    self_trade_cancels.clear();
+    uncross_limits.clear();
     
+    // Every auction fill is at the published price. Self-trade prevention can take
+    // out orders the equilibrium counted and leave a cross at other prices, which
+    // only continuous trading may trade
+    result = find_equilibrium();
+    if (result.price != 0) {
+        execute_auction(result.price);
+    }
+    result.matched_quantity = 0;
+    for (const auto& fill : fills) {
+        result.matched_quantity += fill.quantity;
+    }
+    if (continuous) {
+        execute_auction(0);
+    }
     return fills;
 }
 
-void OrderBook::add_to_book(std::shared_ptr<Order> order) {
-    if (order->side == OrderSide::BUY) {
-        bids[order->price].push(order);
+// Pairs the best bid and ask, each in time priority, until either no longer
+// crosses price. Price 0 trades each pair as continuous trading would have: at
+// the earlier order's price, while the two still cross
+template<template<bool> class Levels>
+void BasicOrderBook<Levels>::execute_auction(uint64_t price) {
+    auto cancel = [this](Order* order) {
+        order->status = OrderStatus::CANCELLED;
+        self_trade_cancels.push_back(*order);
+        remove_resting(order);
+    };
+    
+    while (true) {
+        PriceLevel* bid = bids.best();
+        PriceLevel* ask = asks.best();
+        if (!bid || !ask || bid->price < ask->price || bid->price < price || (price && ask->price > price)) {
+            return;
+        }
+        Order* buy = bid->head;
+        Order* sell = ask->head;
+        bool buy_later = buy->order_id > sell->order_id;
+        uint64_t trade_price = price ? price : (buy_later ? sell->price : buy->price);
+        
+        if (buy->client_id == sell->client_id && self_trade_prevention != SelfTradePrevention::NONE) {
+            Order* aggressor = buy_later ? buy : sell;
+            Order* resting = buy_later ? sell : buy;
+            if (self_trade_prevention != SelfTradePrevention::CANCEL_AGGRESSOR) {
+                cancel(resting);
+            }
+            if (self_trade_prevention != SelfTradePrevention::CANCEL_RESTING) {
+                cancel(aggressor);
+            }
+            continue;
+        }
+        
+        uint64_t trade_qty = std::min(buy->remaining_quantity, sell->remaining_quantity);
+        if (fills.size() == fills.capacity()) {
+            pool.note_heap_allocation();
+        }
+        fills.emplace_back(next_fill_id++, buy->order_id, sell->order_id, symbol_id, buy->client_id,
+                           sell->client_id, buy_later ? OrderSide::BUY : OrderSide::SELL, trade_qty, trade_price);
+        fills.back().auction = true;
+        uncross_limits.push_back(UncrossLimits{buy->price, sell->price});
+        
+        for (Order* order : {buy, sell}) {
+            order->remaining_quantity -= trade_qty;
+            order->level->total_quantity -= trade_qty;
+            if (order->remaining_quantity == 0) {
+                order->status = OrderStatus::FILLED;
+                remove_resting(order);
+            } else {
+                order->status = OrderStatus::PARTIALLY_FILLED;
+            }
+        }
+    }
+}
+
+template<template<bool> class Levels>
+void BasicOrderBook<Levels>::add_to_book(const Order& order) {
+    Order* resting = new (pool.allocate(sizeof(Order))) Order(order);
+    if (order.side == OrderSide::BUY) {
+        bids.get_or_create(order.price).push_back(resting);
     } else {
-        asks[order->price].push(order);
+        asks.get_or_create(order.price).push_back(resting);
     }
+    order_map[resting->order_id] = resting;
+}
+
+// Unlinks a resting order from its level and frees it; the caller erases the level if it empties
+template<template<bool> class Levels>
+void BasicOrderBook<Levels>::remove_from_book(Order* order) {
+    order->level->unlink(order);
+    order_map.erase(order->order_id);
+    order->~Order();
+    pool.deallocate(order, sizeof(Order));
 }
 
-MarketDataSnapshot OrderBook::get_snapshot() const {
+template<template<bool> class Levels>
+MarketDataSnapshot BasicOrderBook<Levels>::get_snapshot() const {
     MarketDataSnapshot snapshot;
-    snapshot.symbol = symbol;
+    snapshot.symbol_id = symbol_id;
     snapshot.timestamp = get_current_timestamp();
     
-    if (!bids.empty()) {
-        auto& best_bid_queue = bids.begin()->second;
-        if (!best_bid_queue.empty()) {
-            snapshot.bid_price = bids.begin()->first;
-            snapshot.bid_quantity = 0;
-            auto temp_queue = best_bid_queue;
-            while (!temp_queue.empty()) {
-                snapshot.bid_quantity += temp_queue.front()->remaining_quantity;
-                temp_queue.pop();
-            }
-        }
+    if (const PriceLevel* best_bid = bids.best()) {
+        snapshot.bid_price = best_bid->price;
+        snapshot.bid_quantity = best_bid->total_quantity;
     }
     
-    if (!asks.empty()) {
-        auto& best_ask_queue = asks.begin()->second;
-        if (!best_ask_queue.empty()) {
-            snapshot.ask_price = asks.begin()->first;
-            snapshot.ask_quantity = 0;
-            auto temp_queue = best_ask_queue;
-            while (!temp_queue.empty()) {
-                snapshot.ask_quantity += temp_queue.front()->remaining_quantity;
-                temp_queue.pop();
-            }
-        }
+    if (const PriceLevel* best_ask = asks.best()) {
+        snapshot.ask_price = best_ask->price;
+        snapshot.ask_quantity = best_ask->total_quantity;
     }
     
     return snapshot;
 }
 
-bool OrderBook::cancel_order(uint64_t order_id) {
+template<template<bool> class Levels>
+void BasicOrderBook<Levels>::get_depth(size_t depth, std::vector<DepthLevel>& bid_levels, std::vector<DepthLevel>& ask_levels) const {
+    bid_levels.clear();
+    ask_levels.clear();
+    if (depth == 0) {
+        return;
+    }
+    
+    bids.for_each([&](const PriceLevel& level) {
+        bid_levels.push_back(DepthLevel{level.price, level.total_quantity, level.order_count});
+        return bid_levels.size() < depth;
+    });
+    asks.for_each([&](const PriceLevel& level) {
+        ask_levels.push_back(DepthLevel{level.price, level.total_quantity, level.order_count});
+        return ask_levels.size() < depth;
+    });
+}
+
+template<template<bool> class Levels>
+void BasicOrderBook<Levels>::collect_orders(std::vector<Order>& out) const {
+    auto append_level = [&](const PriceLevel& level) {
+        for (const Order* order = level.head; order; order = order->next) {
+            out.push_back(*order);
+        }
+        return true;
+    };
+    bids.for_each(append_level);
+    asks.for_each(append_level);
+}
+
+template<template<bool> class Levels>
+bool BasicOrderBook<Levels>::restore_order(const Order& order) {
+    bool accepted = (order.side == OrderSide::BUY) ? bids.accepts(order.price) : asks.accepts(order.price);
+    if (!accepted || order.remaining_quantity == 0 || order_map.count(order.order_id)) {
+        return false;
+    }
+    add_to_book(order);
+    return true;
+}
+
+template<template<bool> class Levels>
+bool BasicOrderBook<Levels>::cancel_order(uint64_t order_id) {
     auto it = order_map.find(order_id);
     if (it == order_map.end()) {
         return false;
     }
     
-    auto order = it->second;
+    Order* order = it->second;
     order->status = OrderStatus::CANCELLED;
-    order->remaining_quantity = 0;
+    remove_resting(order);
+    return true;
+}
+
+template<template<bool> class Levels>
+bool BasicOrderBook<Levels>::reduce_order(uint64_t order_id, uint64_t quantity) {
+    auto it = order_map.find(order_id);
+    if (it == order_map.end()) {
+        return false;
+    }
     
-    // TODO: Remove from bids/asks queues
+    Order* order = it->second;
+    if (quantity >= order->remaining_quantity) {
+        order->status = OrderStatus::CANCELLED;
+        remove_resting(order);
+        return true;
+    }
     
+    // Reducing in place keeps time priority
+    order->quantity -= quantity;
+    order->remaining_quantity -= quantity;
+    order->level->total_quantity -= quantity;
     return true;
-}
\ No newline at end of file
+}
+
+// Removes a resting order outside the match loop, erasing its level if it empties
+template<template<bool> class Levels>
+void BasicOrderBook<Levels>::remove_resting(Order* order) {
+    OrderSide side = order->side;
+    PriceLevel* level = order->level;
+    remove_from_book(order);
+    
+    if (level->empty()) {
+        if (side == OrderSide::BUY) {
+            bids.erase(*level);
+        } else {
+            asks.erase(*level);
+        }
+    }
+}
+
+template class BasicOrderBook<MapPriceLevels>;
+template class BasicOrderBook<LadderPriceLevels>;
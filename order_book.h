@@ -1,27 +1,149 @@
 #pragma once
-#include <map>
-#include <queue>
-#include <vector>
 #include <memory>
+#include <vector>
 #include <unordered_map>
 #include "matching_engine_types.h"
+#include "price_levels.h"
+
+// Fills are written into a per-book buffer that is reused across add_order calls
+constexpr size_t kFillBufferCapacity = 256;
+
+// Aggregated price level as published on the market data feed
+struct DepthLevel {
+    uint64_t price;
+    uint64_t quantity;
+    uint32_t order_count;
+};
+
+// Where a call would uncross: the price that executes the most quantity, then
+// leaves the least unmatched at it. price is 0 while the book does not cross
+struct Equilibrium {
+    uint64_t price = 0;
+    uint64_t matched_quantity = 0;
+    uint64_t imbalance_quantity = 0;
+    OrderSide imbalance_side = OrderSide::BUY;
+};
 
-// Order Book Implementation
+// Limit prices of the two orders behind one uncross fill, which their exposure
+// was opened at
+struct UncrossLimits {
+    uint64_t buy_price;
+    uint64_t sell_price;
+};
+
+// Order Book interface, one instance per symbol
 class OrderBook {
-private:
-    std::string symbol;
-    std::map<uint64_t, std::queue<std::shared_ptr<Order>>, std::greater<uint64_t>> bids;
-    std::map<uint64_t, std::queue<std::shared_ptr<Order>>> asks;
-    std::unordered_map<uint64_t, std::shared_ptr<Order>> order_map;
+protected:
+    using OrderMap = std::unordered_map<uint64_t, Order*, std::hash<uint64_t>, std::equal_to<uint64_t>,
+                                        PoolAllocator<std::pair<const uint64_t, Order*>>>;
+    
+    SymbolId symbol_id;
+    NodePool pool;
+    OrderMap order_map;
+    std::vector<Fill> fills;
+    // Resting orders cancelled by self-trade prevention during the last add_order
+    std::vector<Order> self_trade_cancels;
     uint64_t next_fill_id = 1;
+    SelfTradePrevention self_trade_prevention;
+    TradingState phase = TradingState::TRADING;
+    // Uncross scratch: the crossed levels of each side, best first
+    std::vector<DepthLevel> auction_bids;
+    std::vector<DepthLevel> auction_asks;
+    std::vector<UncrossLimits> uncross_limits;
+    
+public:
+    OrderBook(SymbolId sym, const BookConfig& config);
+    virtual ~OrderBook() = default;
+    OrderBook(const OrderBook&) = delete;
+    OrderBook& operator=(const OrderBook&) = delete;
+    
+    // Matches the order by its type and rests any limit or post-only remainder; the
+    // book keeps its own copy. Status on return: FILLED, PARTIALLY_FILLED or NEW if it
+    // rests, CANCELLED for an unfilled market/IOC remainder or an unfillable FOK, and
+    // REJECTED for a post-only that would cross or a price off the ladder. An order
+    // stopped by self-trade prevention is CANCELLED with its remainder.
+    // The returned fills stay valid until the next call into the book.
+    virtual const std::vector<Fill>& add_order(Order& order) = 0;
+    virtual bool cancel_order(uint64_t order_id) = 0;
+    // Takes quantity off the order in place, keeping its time priority; cancels it
+    // when quantity covers all that remains
+    virtual bool reduce_order(uint64_t order_id, uint64_t quantity) = 0;
+    virtual MarketDataSnapshot get_snapshot() const = 0;
+    // Fills bids and asks with up to depth levels each, best first
+    virtual void get_depth(size_t depth, std::vector<DepthLevel>& bid_levels, std::vector<DepthLevel>& ask_levels) const = 0;
+    // Checkpoint support: appends every resting order, bids then asks, each side best
+    // level first and each level in time priority; restore_order rests an order
+    // without matching it, so restoring them in that order rebuilds the book. It
+    // returns false for a price the book cannot hold
+    virtual void collect_orders(std::vector<Order>& out) const = 0;
+    virtual bool restore_order(const Order& order) = 0;
+    
+    // Outside continuous trading add_order rests limit and post-only orders without
+    // matching them and cancels the other types; uncross() then matches the book
+    void set_phase(TradingState state) { phase = state; }
+    TradingState get_phase() const { return phase; }
+    virtual Equilibrium find_equilibrium() = 0;
+    // Trades every bid and ask that cross at the equilibrium price, best price then
+    // time first on each side, at that one price. Self-trade prevention treats the
+    // later of two orders as the aggressor. Whatever still crosses after it matches
+    // as continuous trading would when continuous is set, and otherwise waits for
+    // the next uncross. Fills stay valid until the next call into the book, with
+    // get_uncross_limits() parallel to them
+    virtual const std::vector<Fill>& uncross(Equilibrium& result, bool continuous) = 0;
+    
+    const std::vector<Order>& get_self_trade_cancels() const { return self_trade_cancels; }
+    const std::vector<UncrossLimits>& get_uncross_limits() const { return uncross_limits; }
+    
+    const Order* find_order(uint64_t order_id) const {
+        auto it = order_map.find(order_id);
+        return it == order_map.end() ? nullptr : it->second;
+    }
+    
+    SymbolId get_symbol_id() const { return symbol_id; }
+    uint64_t get_next_fill_id() const { return next_fill_id; }
+    void set_next_fill_id(uint64_t id) { next_fill_id = id; }
+    const AllocationStats& get_allocation_stats() const { return pool.get_stats(); }
+};
+
+// Order Book over a pair of price level containers (see price_levels.h)
+template<template<bool> class Levels>
+class BasicOrderBook final : public OrderBook {
+private:
+    Levels<true> bids;
+    Levels<false> asks;
     
 public:
-    OrderBook(const std::string& sym);
-    std::vector<Fill> add_order(std::shared_ptr<Order> order);
-    bool cancel_order(uint64_t order_id);
-    MarketDataSnapshot get_snapshot() const;
+    BasicOrderBook(SymbolId sym, const BookConfig& config);
+    ~BasicOrderBook() override;
+    
+    const std::vector<Fill>& add_order(Order& order) override;
+    bool cancel_order(uint64_t order_id) override;
+    bool reduce_order(uint64_t order_id, uint64_t quantity) override;
+    MarketDataSnapshot get_snapshot() const override;
+    void get_depth(size_t depth, std::vector<DepthLevel>& bid_levels, std::vector<DepthLevel>& ask_levels) const override;
+    void collect_orders(std::vector<Order>& out) const override;
+    bool restore_order(const Order& order) override;
+    Equilibrium find_equilibrium() override;
+    const std::vector<Fill>& uncross(Equilibrium& result, bool continuous) override;
     
 private:
-    std::vector<Fill> match_order(std::shared_ptr<Order> order);
-    void add_to_book(std::shared_ptr<Order> order);
-};
\ No newline at end of file
+    template<OrderType Type>
+    void match_order(Order& order);
+    template<OrderType Type, typename Side>
+    void match_side(Side& side, Order& order);
+    // Returns true if self-trade prevention stopped the order
+    template<OrderType Type, typename Side>
+    bool match_against(Side& side, Order& order);
+    template<typename Side>
+    bool can_fill(const Side& side, const Order& order) const;
+    void accumulate(Order& order);
+    void execute_auction(uint64_t price);
+    void add_to_book(const Order& order);
+    void remove_from_book(Order* order);
+    void remove_resting(Order* order);
+};
+
+using MapOrderBook = BasicOrderBook<MapPriceLevels>;
+using LadderOrderBook = BasicOrderBook<LadderPriceLevels>;
+
+std::unique_ptr<OrderBook> make_order_book(SymbolId symbol_id, const BookConfig& config);
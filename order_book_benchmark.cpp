@@ -0,0 +1,347 @@
+// Order book latency and throughput benchmark.
+// Builds without TradeCoreExport: make bench
+//
+// Replays synthetic flow (or a recorded journal) against one book per symbol and
+// reports per-operation latency percentiles. --max-p99-ns and --min-mops turn it
+// into a regression gate: the exit status is 1 when a limit is missed.
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "latency_histogram.h"
+#include "order_book.h"
+#include "order_journal.h"
+
+namespace {
+    enum class OpType : uint8_t {
+        ADD = 0,            // passive limit order
+        AGGRESSIVE = 1,     // market order sweeping from the touch
+        CANCEL = 2,
+        SNAPSHOT = 3,
+        MODIFY = 4,         // quantity-down in place (journal replay only)
+        COUNT = 5
+    };
+    
+    const char* kOpNames[] = {"add", "aggressive", "cancel", "snapshot", "modify"};
+    
+    struct Op {
+        OpType type;
+        OrderSide side;
+        SymbolId symbol;
+        ClientId client;
+        uint64_t order_id;
+        uint64_t quantity;
+        uint64_t price;
+    };
+    
+    struct BenchConfig {
+        size_t orders = 1000000;
+        size_t symbols = 1;
+        size_t depth = 50;              // price levels each side of mid
+        int add_pct = 60;
+        int cancel_pct = 30;            // the rest is aggressive
+        int snapshot_every = 0;         // also time get_snapshot after every Nth op
+        std::string price_dist = "uniform";
+        BookBackend backend = BookBackend::MAP;
+        uint64_t tick = 10000000;       // $0.01 in nanos
+        uint64_t mid = 100000000000;    // $100.00
+        size_t order_capacity = 4096;
+        size_t clients = 1;
+        SelfTradePrevention self_trade_prevention = SelfTradePrevention::NONE;
+        unsigned seed = 42;
+        std::string replay_path;
+        uint64_t max_p99_ns = 0;
+        double min_mops = 0;
+    };
+    
+    void print_usage(const char* prog) {
+        printf("Usage: %s [options]\n", prog);
+        printf("  --orders N          operations to generate (default 1000000)\n");
+        printf("  --symbols N         books to spread flow across (default 1)\n");
+        printf("  --depth N           price levels each side of mid (default 50)\n");
+        printf("  --mix A:C           percent passive adds and cancels; the rest crosses (default 60:30)\n");
+        printf("  --dist uniform|near distance of passive prices from mid; near favours the touch\n");
+        printf("  --snapshot-every N  also time get_snapshot after every Nth operation\n");
+        printf("  --backend map|ladder\n");
+        printf("  --tick N            ladder tick size in nanos (default 10000000)\n");
+        printf("  --capacity N        orders preallocated per book (default 4096)\n");
+        printf("  --clients N         owners to spread synthetic orders across (default 1)\n");
+        printf("  --stp none|cancel-resting|cancel-aggressor|cancel-both  self-trade prevention\n");
+        printf("  --seed N\n");
+        printf("  --replay PATH       replay a recorded order journal instead of synthetic flow\n");
+        printf("  --max-p99-ns N      fail if any operation's p99 exceeds N ns\n");
+        printf("  --min-mops X        fail if overall throughput is below X million ops/s\n");
+    }
+    
+    bool parse_args(int argc, char** argv, BenchConfig& config) {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (i + 1 >= argc) {
+                return false;
+            }
+            const char* value = argv[++i];
+            if (arg == "--orders") {
+                config.orders = std::strtoull(value, nullptr, 10);
+            } else if (arg == "--symbols") {
+                config.symbols = std::max<size_t>(1, std::strtoull(value, nullptr, 10));
+            } else if (arg == "--depth") {
+                config.depth = std::max<size_t>(1, std::strtoull(value, nullptr, 10));
+            } else if (arg == "--mix") {
+                if (sscanf(value, "%d:%d", &config.add_pct, &config.cancel_pct) != 2 ||
+                    config.add_pct < 0 || config.cancel_pct < 0 || config.add_pct + config.cancel_pct > 100) {
+                    return false;
+                }
+            } else if (arg == "--dist") {
+                config.price_dist = value;
+            } else if (arg == "--snapshot-every") {
+                config.snapshot_every = std::atoi(value);
+            } else if (arg == "--backend") {
+                config.backend = (std::string(value) == "ladder") ? BookBackend::LADDER : BookBackend::MAP;
+            } else if (arg == "--tick") {
+                config.tick = std::max<uint64_t>(1, std::strtoull(value, nullptr, 10));
+            } else if (arg == "--capacity") {
+                config.order_capacity = std::strtoull(value, nullptr, 10);
+            } else if (arg == "--clients") {
+                config.clients = std::max<size_t>(1, std::strtoull(value, nullptr, 10));
+            } else if (arg == "--stp") {
+                std::string mode = value;
+                if (mode == "none") {
+                    config.self_trade_prevention = SelfTradePrevention::NONE;
+                } else if (mode == "cancel-resting") {
+                    config.self_trade_prevention = SelfTradePrevention::CANCEL_RESTING;
+                } else if (mode == "cancel-aggressor") {
+                    config.self_trade_prevention = SelfTradePrevention::CANCEL_AGGRESSOR;
+                } else if (mode == "cancel-both") {
+                    config.self_trade_prevention = SelfTradePrevention::CANCEL_BOTH;
+                } else {
+                    return false;
+                }
+            } else if (arg == "--seed") {
+                config.seed = static_cast<unsigned>(std::strtoul(value, nullptr, 10));
+            } else if (arg == "--replay") {
+                config.replay_path = value;
+            } else if (arg == "--max-p99-ns") {
+                config.max_p99_ns = std::strtoull(value, nullptr, 10);
+            } else if (arg == "--min-mops") {
+                config.min_mops = std::atof(value);
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+    
+    // Synthetic flow: passive adds rest within depth ticks of mid, aggressive orders
+    // are market orders up to sweep_qty, cancels pick a random order this generator placed
+    std::vector<Op> generate_flow(const BenchConfig& config) {
+        std::mt19937_64 rng(config.seed);
+        std::uniform_int_distribution<int> pct(0, 99);
+        std::uniform_int_distribution<size_t> symbol_dist(0, config.symbols - 1);
+        std::uniform_int_distribution<uint64_t> qty_dist(1, 10);
+        std::uniform_int_distribution<size_t> uniform_level(1, config.depth);
+        std::geometric_distribution<size_t> near_level(4.0 / config.depth);
+        std::uniform_int_distribution<uint64_t> sweep_qty(1, 40);
+        std::uniform_int_distribution<ClientId> client_dist(0, static_cast<ClientId>(config.clients - 1));
+        
+        std::vector<std::vector<uint64_t>> live(config.symbols);
+        std::vector<Op> ops;
+        ops.reserve(config.orders);
+        uint64_t next_id = 1;
+        bool near = (config.price_dist == "near");
+        
+        for (size_t i = 0; i < config.orders; ++i) {
+            Op op{};
+            op.symbol = static_cast<SymbolId>(symbol_dist(rng));
+            op.side = (rng() & 1) ? OrderSide::BUY : OrderSide::SELL;
+            int roll = pct(rng);
+            auto& ids = live[op.symbol];
+            
+            if (roll < config.add_pct || (roll < config.add_pct + config.cancel_pct && ids.empty())) {
+                size_t level = near ? std::min(config.depth, 1 + near_level(rng)) : uniform_level(rng);
+                op.type = OpType::ADD;
+                op.price = (op.side == OrderSide::BUY) ? config.mid - level * config.tick : config.mid + level * config.tick;
+            } else if (roll < config.add_pct + config.cancel_pct) {
+                size_t pick = std::uniform_int_distribution<size_t>(0, ids.size() - 1)(rng);
+                op.type = OpType::CANCEL;
+                op.order_id = ids[pick];
+                ids[pick] = ids.back();
+                ids.pop_back();
+                ops.push_back(op);
+                continue;
+            } else {
+                op.type = OpType::AGGRESSIVE;
+            }
+            
+            op.order_id = next_id++;
+            op.quantity = (op.type == OpType::AGGRESSIVE) ? sweep_qty(rng) : qty_dist(rng);
+            // Drawn only with several clients, so the default flow matches earlier runs
+            op.client = (config.clients > 1) ? client_dist(rng) : 0;
+            if (op.type == OpType::ADD) {
+                ids.push_back(op.order_id);
+            }
+            ops.push_back(op);
+        }
+        return ops;
+    }
+    
+    // Recorded flow from an order journal; replaces become cancel + add
+    std::vector<Op> load_journal(const std::string& path, size_t& symbol_count) {
+        std::vector<Op> ops;
+        OrderJournal journal;
+        if (!journal.open(path, 0)) {
+            return ops;
+        }
+        
+        std::unordered_map<std::string, SymbolId> symbols;
+        std::unordered_map<std::string, ClientId> clients;
+        journal.replay([&](const OrderJournal::Record& record) {
+            std::string name(symbol_view(record.symbol));
+            auto it = symbols.emplace(name, static_cast<SymbolId>(symbols.size())).first;
+            std::string client(OrderJournal::client_view(record.client));
+            auto owner = clients.emplace(client, static_cast<ClientId>(clients.size())).first;
+            OrderRequest request = OrderJournal::to_request(record);
+            
+            Op op{};
+            op.symbol = it->second;
+            op.client = owner->second;
+            op.side = request.side;
+            op.quantity = request.quantity;
+            op.price = request.price;
+            if (request.type == RequestType::MODIFY_ORDER) {
+                op.type = OpType::MODIFY;
+                op.order_id = request.orig_order_id;
+                ops.push_back(op);
+                return;
+            }
+            if (request.type != RequestType::NEW_ORDER) {
+                op.type = OpType::CANCEL;
+                op.order_id = request.orig_order_id;
+                ops.push_back(op);
+            }
+            if (request.type != RequestType::CANCEL_ORDER) {
+                op.type = OpType::ADD;
+                op.order_id = request.order_id;
+                ops.push_back(op);
+            }
+        });
+        symbol_count = std::max<size_t>(1, symbols.size());
+        return ops;
+    }
+}
+
+int main(int argc, char** argv) {
+    BenchConfig config;
+    if (!parse_args(argc, argv, config)) {
+        print_usage(argv[0]);
+        return 2;
+    }
+    
+    std::vector<Op> ops = config.replay_path.empty() ? generate_flow(config)
+                                                     : load_journal(config.replay_path, config.symbols);
+    if (ops.empty()) {
+        printf("[benchmark] No operations to run\n");
+        return 2;
+    }
+    
+    BookConfig book_config;
+    book_config.backend = config.backend;
+    book_config.tick_size = config.tick;
+    book_config.min_price = config.mid - (config.depth + 1) * config.tick;
+    book_config.max_price = config.mid + (config.depth + 1) * config.tick;
+    book_config.order_capacity = config.order_capacity;
+    book_config.self_trade_prevention = config.self_trade_prevention;
+    if (!config.replay_path.empty()) {
+        // Size the ladder to the recorded price range
+        uint64_t low = UINT64_MAX;
+        uint64_t high = 0;
+        for (const Op& op : ops) {
+            low = std::min(low, op.price);
+            high = std::max(high, op.price);
+        }
+        book_config.min_price = low - low % config.tick;
+        book_config.max_price = high;
+    }
+    
+    std::vector<std::unique_ptr<OrderBook>> books;
+    for (size_t i = 0; i < config.symbols; ++i) {
+        books.push_back(make_order_book(static_cast<SymbolId>(i), book_config));
+    }
+    
+    double tsc_per_ns = calibrate_tsc_per_ns();
+    LatencyHistogram histograms[static_cast<size_t>(OpType::COUNT)];
+    uint64_t fills = 0;
+    uint64_t cancel_misses = 0;
+    
+    uint64_t run_start = read_tsc();
+    for (size_t i = 0; i < ops.size(); ++i) {
+        const Op& op = ops[i];
+        OrderBook& book = *books[op.symbol];
+        
+        uint64_t start = read_tsc();
+        if (op.type == OpType::CANCEL) {
+            if (!book.cancel_order(op.order_id)) {
+                cancel_misses++;
+            }
+        } else if (op.type == OpType::MODIFY) {
+            const Order* order = book.find_order(op.order_id);
+            if (!order || op.quantity >= order->remaining_quantity ||
+                !book.reduce_order(op.order_id, order->remaining_quantity - op.quantity)) {
+                cancel_misses++;
+            }
+        } else {
+            OrderType type = (op.type == OpType::AGGRESSIVE) ? OrderType::MARKET : OrderType::LIMIT;
+            Order order(op.order_id, op.symbol, op.side, type, op.quantity, op.price, op.client);
+            fills += book.add_order(order).size();
+        }
+        uint64_t end = read_tsc();
+        histograms[static_cast<size_t>(op.type)].record(end - start);
+        
+        if (config.snapshot_every > 0 && i % config.snapshot_every == 0) {
+            start = read_tsc();
+            MarketDataSnapshot snapshot = book.get_snapshot();
+            end = read_tsc();
+            asm volatile("" : : "r"(&snapshot) : "memory");
+            histograms[static_cast<size_t>(OpType::SNAPSHOT)].record(end - start);
+        }
+    }
+    double run_ns = (read_tsc() - run_start) / tsc_per_ns;
+    double mops = ops.size() / run_ns * 1e3;
+    
+    printf("[benchmark] %zu ops over %zu symbols, backend %s, %.3f ms, %.2f M ops/s, %lu fills, %lu cancel misses\n",
+           ops.size(), config.symbols, config.backend == BookBackend::LADDER ? "ladder" : "map",
+           run_ns / 1e6, mops, fills, cancel_misses);
+    printf("[benchmark] %-10s %10s %8s %8s %8s %8s (ns)\n", "op", "count", "p50", "p99", "p99.9", "max");
+    
+    bool passed = true;
+    for (size_t i = 0; i < static_cast<size_t>(OpType::COUNT); ++i) {
+        const LatencyHistogram& h = histograms[i];
+        if (h.count() == 0) {
+            continue;
+        }
+        auto ns = [tsc_per_ns](uint64_t ticks) { return static_cast<uint64_t>(ticks / tsc_per_ns); };
+        uint64_t p99 = ns(h.percentile(99.0));
+        printf("[benchmark] %-10s %10lu %8lu %8lu %8lu %8lu\n", kOpNames[i], h.count(),
+               ns(h.percentile(50.0)), p99, ns(h.percentile(99.9)), ns(h.max()));
+        if (config.max_p99_ns > 0 && p99 > config.max_p99_ns) {
+            printf("[benchmark] FAIL: %s p99 %lu ns exceeds %lu ns\n", kOpNames[i], p99, config.max_p99_ns);
+            passed = false;
+        }
+    }
+    
+    uint64_t heap_allocations = 0;
+    for (const auto& book : books) {
+        heap_allocations += book->get_allocation_stats().heap_allocations;
+    }
+    printf("[benchmark] Heap allocations across books: %lu\n", heap_allocations);
+    
+    if (config.min_mops > 0 && mops < config.min_mops) {
+        printf("[benchmark] FAIL: %.2f M ops/s below %.2f\n", mops, config.min_mops);
+        passed = false;
+    }
+    return passed ? 0 : 1;
+}
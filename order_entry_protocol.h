@@ -0,0 +1,108 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+// Binary order entry protocol: fixed-layout, packed, little-endian messages.
+// Every message starts with a MsgHeader whose length covers the whole message.
+// Each message comes in two forms: one naming the symbol, and a lower-case one
+// carrying only its instrument directory id, which the engine resolves with a
+// bounds check instead of a lookup (DIRECTORY on the MD recovery port lists ids).
+enum class MsgType : uint8_t {
+    NEW_ORDER = 'N',
+    CANCEL_ORDER = 'C',
+    REPLACE_ORDER = 'R',
+    MODIFY_ORDER = 'M',
+    NEW_ORDER_BY_ID = 'n',
+    CANCEL_ORDER_BY_ID = 'c',
+    REPLACE_ORDER_BY_ID = 'r',
+    MODIFY_ORDER_BY_ID = 'm'
+};
+
+constexpr size_t kSymbolLength = 8;
+
+#pragma pack(push, 1)
+struct MsgHeader {
+    uint16_t length;
+    uint8_t msg_type;
+};
+
+struct NewOrderMsg {
+    MsgHeader header;
+    char symbol[kSymbolLength];     // space or NUL padded
+    uint8_t side;                   // OrderSide
+    uint64_t quantity;
+    uint64_t price;                 // nanos, ignored for MARKET
+    uint8_t order_type;             // OrderType; may be omitted (length stops before it) for LIMIT
+};
+
+struct CancelOrderMsg {
+    MsgHeader header;
+    char symbol[kSymbolLength];
+    uint64_t order_id;
+};
+
+// Cancel and new: the replacement gets a fresh order id and loses time priority
+struct ReplaceOrderMsg {
+    MsgHeader header;
+    char symbol[kSymbolLength];
+    uint64_t order_id;
+    uint64_t quantity;
+    uint64_t price;
+};
+
+// Reduces the order's remaining quantity to quantity in place, keeping time priority;
+// 0 cancels, and an increase is rejected (use replace)
+struct ModifyOrderMsg {
+    MsgHeader header;
+    char symbol[kSymbolLength];
+    uint64_t order_id;
+    uint64_t quantity;
+};
+
+struct NewOrderByIdMsg {
+    MsgHeader header;
+    uint32_t symbol_id;
+    uint8_t side;
+    uint64_t quantity;
+    uint64_t price;
+    uint8_t order_type;
+};
+
+struct CancelOrderByIdMsg {
+    MsgHeader header;
+    uint32_t symbol_id;
+    uint64_t order_id;
+};
+
+struct ReplaceOrderByIdMsg {
+    MsgHeader header;
+    uint32_t symbol_id;
+    uint64_t order_id;
+    uint64_t quantity;
+    uint64_t price;
+};
+
+struct ModifyOrderByIdMsg {
+    MsgHeader header;
+    uint32_t symbol_id;
+    uint64_t order_id;
+    uint64_t quantity;
+};
+#pragma pack(pop)
+
+// Views a padded symbol field without copying it
+inline std::string_view symbol_view(const char (&symbol)[kSymbolLength]) {
+    size_t len = 0;
+    while (len < kSymbolLength && symbol[len] != '\0' && symbol[len] != ' ') {
+        len++;
+    }
+    return std::string_view(symbol, len);
+}
+
+// Writes symbol into a fixed field, NUL padded and truncated to kSymbolLength
+inline void copy_symbol(char (&out)[kSymbolLength], std::string_view symbol) {
+    size_t len = symbol.size() < kSymbolLength ? symbol.size() : kSymbolLength;
+    memcpy(out, symbol.data(), len);
+    memset(out + len, 0, kSymbolLength - len);
+}
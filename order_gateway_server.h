@@ -1,18 +1,29 @@
 #pragma once
 #include <vector>
 #include <string>
+#include <string_view>
 #include <cstdio>
+#include <cstring>
 #include "../TradeCoreExport/tcp_server_socket.h"
+#include "matching_engine_types.h"
+#include "line_framing.h"
+#include "log.h"
+#include "stage_metrics.h"
 
 class MatchingEngine;
 
-// Order Gateway Server Socket
+// Longest partial line carried over between reads before the client is dropped
+constexpr size_t kMaxTextOrderLength = 1024;
+
+// Order Gateway Server Socket: newline-delimited text orders
 template<typename server_t>
 class order_gateway_socket_t : public tcp_server_socket_t {
 public:
     std::vector<uint8_t> rxbuf;
+    std::vector<OrderRequest> batch;
     server_t* parent_server;
     std::string client_id;
+    ClientId client = 0;
     
     // Constructor
     order_gateway_socket_t(int fd, sockaddr_in clientaddr, socklen_t clientlen, 
@@ -28,18 +39,30 @@ public:
 
 // Implementation
 template<typename server_t>
-size_t order_gateway_socket_t<server_t>::handle_packet(const uint8_t* buf, const size_t len, uint64_t, void*, bool&) {
-    std::string message(reinterpret_cast<const char*>(buf), len);
-    
-    // Remove newline if present
-    if (!message.empty() && message.back() == '\n') {
-        message.pop_back();
+size_t order_gateway_socket_t<server_t>::handle_packet(const uint8_t* buf, const size_t len, uint64_t ts, void*, bool& should_disconnect) {
+    // ts is the receive timestamp in nanoseconds on the get_current_timestamp() clock
+    if (ts) {
+        record_stage_ns(Stage::RECEIVE, get_current_timestamp() - ts);
     }
     
-    if (!message.empty() && parent_server) {
-        parent_server->on_order_request(client_id, message);
+    batch.clear();
+    bool framed = frame_lines(rxbuf, buf, len, kMaxTextOrderLength, [this](std::string_view line) {
+        OrderRequest request;
+        uint64_t parse_start = read_tsc();
+        if (!line.empty() && parent_server && parent_server->decode(client, line, request)) {
+            batch.push_back(request);
+        }
+        record_stage_ticks(Stage::PARSE, parse_start, read_tsc());
+    });
+    
+    if (!batch.empty() && parent_server) {
+        parent_server->on_order_batch(batch);
     }
     
+    if (!framed) {
+        LOG_WARN("[order_gateway] Client %s sent an unterminated line, disconnecting\n", client_id.c_str());
+        should_disconnect = true;
+    }
     return len;
 }
 
@@ -50,10 +73,10 @@ void order_gateway_socket_t<server_t>::gen_shm_name(const int fd, char* buf) {
 
 template<typename server_t>
 void order_gateway_socket_t<server_t>::on_add() {
-    printf("[order_gateway] Client %s connected (fd=%d)\n", client_id.c_str(), get_fd());
+    LOG_INFO("[order_gateway] Client %s connected (fd=%d)\n", client_id.c_str(), get_fd());
 }
 
 template<typename server_t>
 void order_gateway_socket_t<server_t>::on_remove() {
-    printf("[order_gateway] Client %s disconnected (fd=%d)\n", client_id.c_str(), get_fd());
+    LOG_INFO("[order_gateway] Client %s disconnected (fd=%d)\n", client_id.c_str(), get_fd());
 }
\ No newline at end of file
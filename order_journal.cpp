@@ -0,0 +1,209 @@
+#include "order_journal.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "log.h"
+
+namespace {
+    constexpr char kJournalMagic[8] = {'S', 'M', 'E', 'J', 'R', 'N', 'L', '1'};
+    
+    struct JournalHeader {
+        char magic[8];
+        uint32_t record_size;
+    };
+}
+
+OrderJournal::~OrderJournal() {
+    close();
+}
+
+bool OrderJournal::open(const std::string& path, size_t file_capacity) {
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        LOG_ERROR("[journal] Cannot open %s\n", path.c_str());
+        return false;
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close();
+        return false;
+    }
+    capacity = static_cast<size_t>(st.st_size) > file_capacity ? static_cast<size_t>(st.st_size) : file_capacity;
+    if (posix_fallocate(fd, 0, capacity) != 0) {
+        LOG_ERROR("[journal] Cannot preallocate %zu bytes for %s\n", capacity, path.c_str());
+        close();
+        return false;
+    }
+    
+    void* mapping = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        LOG_ERROR("[journal] Cannot map %s\n", path.c_str());
+        close();
+        return false;
+    }
+    base = static_cast<uint8_t*>(mapping);
+    
+    JournalHeader header;
+    memcpy(&header, base, sizeof(header));
+    if (header.record_size == 0) {
+        memcpy(header.magic, kJournalMagic, sizeof(kJournalMagic));
+        header.record_size = sizeof(Record);
+        memcpy(base, &header, sizeof(header));
+        msync(base, kHeaderSize, MS_SYNC);
+    } else if (memcmp(header.magic, kJournalMagic, sizeof(kJournalMagic)) != 0 || header.record_size != sizeof(Record)) {
+        LOG_ERROR("[journal] %s is not a journal of this format\n", path.c_str());
+        close();
+        return false;
+    }
+    
+    recover();
+    LOG_INFO("[journal] Opened %s: %zu records, %zu bytes preallocated\n", path.c_str(), record_count(), capacity);
+    return true;
+}
+
+// Stops at the first record that is unused, out of sequence or torn
+void OrderJournal::recover() {
+    write_offset = kHeaderSize;
+    next_sequence = 1;
+    while (write_offset + sizeof(Record) <= capacity) {
+        const Record* record = reinterpret_cast<const Record*>(base + write_offset);
+        if (record->sequence != next_sequence || record->checksum != checksum(*record)) {
+            break;
+        }
+        write_offset += sizeof(Record);
+        next_sequence++;
+    }
+    appended_offset.store(write_offset, std::memory_order_release);
+    synced_offset = write_offset;
+    durable_offset.store(synced_offset, std::memory_order_release);
+    
+    // Clear a torn or stale tail so new appends cannot line up with old records
+    for (size_t offset = write_offset; offset + sizeof(Record) <= capacity; offset += sizeof(Record)) {
+        Record* stale = reinterpret_cast<Record*>(base + offset);
+        if (stale->sequence == 0) {
+            break;
+        }
+        memset(stale, 0, sizeof(Record));
+    }
+}
+
+void OrderJournal::close() {
+    group_committing.store(false, std::memory_order_release);
+    if (group_commit_thread.joinable()) {
+        group_commit_thread.join();
+    }
+    if (base) {
+        sync();
+        munmap(base, capacity);
+        base = nullptr;
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+bool OrderJournal::append(const OrderRequest& request, std::string_view symbol, std::string_view client) {
+    if (write_offset + sizeof(Record) > capacity) {
+        return false;
+    }
+    
+    Record record;
+    memset(&record, 0, sizeof(record));
+    record.sequence = next_sequence;
+    record.order_id = request.order_id;
+    record.orig_order_id = request.orig_order_id;
+    record.quantity = request.quantity;
+    record.price = request.price;
+    copy_symbol(record.symbol, symbol);
+    memcpy(record.client, client.data(), client.size() < kClientLength ? client.size() : kClientLength);
+    record.type = static_cast<uint8_t>(request.type);
+    record.side = static_cast<uint8_t>(request.side);
+    record.order_type = static_cast<uint8_t>(request.order_type);
+    record.phase = static_cast<uint8_t>(request.phase);
+    record.checksum = checksum(record);
+    
+    memcpy(base + write_offset, &record, sizeof(record));
+    write_offset += sizeof(record);
+    appended_offset.store(write_offset, std::memory_order_release);
+    next_sequence++;
+    return true;
+}
+
+bool OrderJournal::append_record(const Record& record) {
+    if (write_offset + sizeof(Record) > capacity || record.sequence != next_sequence || !is_intact(record)) {
+        return false;
+    }
+    memcpy(base + write_offset, &record, sizeof(record));
+    write_offset += sizeof(record);
+    appended_offset.store(write_offset, std::memory_order_release);
+    next_sequence++;
+    return true;
+}
+
+void OrderJournal::sync() {
+    std::lock_guard<std::mutex> lock(sync_mutex);
+    size_t end = appended_offset.load(std::memory_order_acquire);
+    if (!base || synced_offset == end) {
+        return;
+    }
+    
+    static const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t start = synced_offset & ~(page_size - 1);
+    msync(base + start, end - start, MS_SYNC);
+    synced_offset = end;
+    durable_offset.store(synced_offset, std::memory_order_release);
+}
+
+void OrderJournal::start_group_commit(uint64_t interval_ns) {
+    if (!base || interval_ns == 0 || group_commit_thread.joinable()) {
+        return;
+    }
+    group_committing.store(true, std::memory_order_release);
+    group_commit_thread = std::thread(&OrderJournal::run_group_commit, this, interval_ns);
+}
+
+// At most one msync per interval however many records were appended, and none
+// while nothing is pending; the appending thread never waits on the disk
+void OrderJournal::run_group_commit(uint64_t interval_ns) {
+    while (group_committing.load(std::memory_order_acquire)) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(interval_ns));
+        sync();
+    }
+}
+
+OrderRequest OrderJournal::to_request(const Record& record) {
+    OrderRequest request;
+    request.type = static_cast<RequestType>(record.type);
+    request.side = static_cast<OrderSide>(record.side);
+    request.order_type = static_cast<OrderType>(record.order_type);
+    request.order_id = record.order_id;
+    request.orig_order_id = record.orig_order_id;
+    request.quantity = record.quantity;
+    request.price = record.price;
+    request.phase = static_cast<TradingState>(record.phase);
+    return request;
+}
+
+// FNV-1a taken eight bytes at a time, folded to 32 bits
+uint32_t OrderJournal::checksum(const Record& record) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&record);
+    constexpr size_t length = offsetof(Record, checksum);
+    uint64_t hash = 14695981039346656037ull;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        hash = (hash ^ word) * 1099511628211ull;
+    }
+    for (; i < length; ++i) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return static_cast<uint32_t>(hash ^ (hash >> 32));
+}
@@ -0,0 +1,134 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include "matching_engine_types.h"
+#include "order_entry_protocol.h"
+
+// Write-ahead journal of sequenced inbound commands.
+// The file is preallocated and memory-mapped, so append is a copy into the mapping;
+// durability comes from sync(), which a group-commit thread runs on an interval.
+// Records carry symbol and client names rather than interned ids, which are not
+// stable across restarts.
+class OrderJournal {
+public:
+    static constexpr size_t kClientLength = 16;
+
+#pragma pack(push, 1)
+    struct Record {
+        uint64_t sequence;              // 1-based, contiguous; 0 marks unused space
+        uint64_t order_id;
+        uint64_t orig_order_id;
+        uint64_t quantity;
+        uint64_t price;
+        char symbol[kSymbolLength];
+        char client[kClientLength];
+        uint8_t type;                   // RequestType
+        uint8_t side;                   // OrderSide
+        uint8_t order_type;             // OrderType
+        uint8_t phase;                  // TradingState, SESSION_PHASE only
+        uint32_t checksum;              // over the bytes before it
+    };
+#pragma pack(pop)
+
+    OrderJournal() = default;
+    ~OrderJournal();
+    OrderJournal(const OrderJournal&) = delete;
+    OrderJournal& operator=(const OrderJournal&) = delete;
+    
+    // Maps path, creating and preallocating it to capacity bytes if needed,
+    // and positions the writer after the last intact record
+    bool open(const std::string& path, size_t capacity);
+    void close();
+    bool is_open() const { return base != nullptr; }
+    
+    // Returns false when the journal is full
+    bool append(const OrderRequest& request, std::string_view symbol, std::string_view client);
+    // Appends a record sequenced elsewhere (by a replication primary) as it is;
+    // false unless it is intact, the next sequence and fits
+    bool append_record(const Record& record);
+    // Any thread: flushes appended records to disk
+    void sync();
+    // Group commit: a thread syncs every interval_ns while records are pending, so
+    // the tail of a burst is durable within one interval even when traffic stops;
+    // 0 starts none and leaves every sync to the caller. Stopped by close()
+    void start_group_commit(uint64_t interval_ns);
+    
+    // Calls f(const Record&) for every intact record after after_sequence in order;
+    // returns the count
+    template<typename F>
+    size_t replay(F&& f, uint64_t after_sequence = 0) const {
+        size_t count = 0;
+        for (size_t offset = offset_of(after_sequence + 1); offset < write_offset; offset += sizeof(Record)) {
+            f(*reinterpret_cast<const Record*>(base + offset));
+            count++;
+        }
+        return count;
+    }
+    
+    // Any thread while the journal is open: calls f(const Record&) for the records
+    // after after_sequence that sync() has made durable, which are never written
+    // again; returns the last sequence passed to f, or after_sequence if none
+    template<typename F>
+    uint64_t replay_durable(uint64_t after_sequence, F&& f) const {
+        size_t end = durable_offset.load(std::memory_order_acquire);
+        for (size_t offset = offset_of(after_sequence + 1); offset < end; offset += sizeof(Record)) {
+            const Record& record = *reinterpret_cast<const Record*>(base + offset);
+            f(record);
+            after_sequence = record.sequence;
+        }
+        return after_sequence;
+    }
+    
+    // The appended records from first_sequence on, as they lie in the file; empty
+    // when there are none. Valid until the journal is closed
+    std::string_view records_from(uint64_t first_sequence) const {
+        size_t offset = offset_of(first_sequence);
+        if (!base || first_sequence == 0 || offset >= write_offset) {
+            return std::string_view();
+        }
+        return std::string_view(reinterpret_cast<const char*>(base + offset), write_offset - offset);
+    }
+    
+    size_t record_count() const { return (write_offset - kHeaderSize) / sizeof(Record); }
+    uint64_t last_sequence() const { return next_sequence - 1; }
+    
+    static OrderRequest to_request(const Record& record);
+    static bool is_intact(const Record& record) { return record.checksum == checksum(record); }
+    
+    static std::string_view client_view(const char (&client)[kClientLength]) {
+        size_t len = 0;
+        while (len < kClientLength && client[len] != '\0') {
+            len++;
+        }
+        return std::string_view(client, len);
+    }
+    
+private:
+    static constexpr size_t kHeaderSize = 64;
+    
+    int fd = -1;
+    uint8_t* base = nullptr;
+    size_t capacity = 0;
+    size_t write_offset = kHeaderSize;
+    // write_offset published to the group-commit thread after each append
+    std::atomic<size_t> appended_offset{kHeaderSize};
+    // Guards synced_offset between the group-commit thread and direct sync() calls
+    std::mutex sync_mutex;
+    size_t synced_offset = kHeaderSize;
+    // synced_offset published to replay_durable readers
+    std::atomic<size_t> durable_offset{kHeaderSize};
+    uint64_t next_sequence = 1;
+    
+    std::thread group_commit_thread;
+    std::atomic<bool> group_committing{false};
+
+    static size_t offset_of(uint64_t sequence) { return kHeaderSize + (sequence - 1) * sizeof(Record); }
+    static uint32_t checksum(const Record& record);
+    void recover();
+    void run_group_commit(uint64_t interval_ns);
+};
@@ -0,0 +1,179 @@
+#pragma once
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+// What to do with a subscriber whose backlog outgrows its queue
+enum class SlowConsumerPolicy : uint8_t {
+    DISCONNECT,     // cut the subscriber off; it reconnects and recovers
+    CONFLATE        // replace stale keyed messages with newer ones, disconnect if still full
+};
+
+struct OutputQueueStats {
+    uint64_t sent_bytes = 0;
+    uint64_t sent_messages = 0;
+    uint64_t conflated = 0;
+    size_t high_water_bytes = 0;
+};
+
+// Immutable bytes shared by every queue a message was fanned out to
+using SharedBuffer = std::shared_ptr<const std::string>;
+
+// Bounded per-subscriber output buffer. push() only takes a reference to the
+// message bytes; drain() writes as much as the socket takes without blocking,
+// batching queued messages into one sendmsg, and keeps the rest, including the
+// unsent tail of a partial write.
+// Not thread safe; the owning server serializes access.
+class OutputQueue {
+public:
+    static constexpr size_t kMaxBatch = 64;
+    
+    enum class PushResult {
+        QUEUED,
+        CONFLATED,
+        OVERFLOW        // over capacity; the caller applies the slow consumer policy
+    };
+    
+private:
+    struct Entry {
+        SharedBuffer buffer;
+        uint32_t offset;
+        uint32_t length;
+        uint64_t key;
+    };
+    
+    std::deque<Entry> entries;
+    uint64_t front_sequence = 0;        // sequence of entries.front()
+    uint64_t drained_sequence = 0;      // entries before this survived a drain
+    size_t front_offset = 0;            // bytes of the front entry already sent
+    size_t backlog = 0;
+    size_t capacity = 8 << 20;
+    SlowConsumerPolicy policy = SlowConsumerPolicy::DISCONNECT;
+    std::unordered_map<uint64_t, uint64_t> latest_by_key;
+    OutputQueueStats stats;
+    
+public:
+    void configure(size_t capacity_bytes, SlowConsumerPolicy slow_policy) {
+        capacity = capacity_bytes;
+        policy = slow_policy;
+    }
+    
+    // key != 0 marks a message a newer one with the same key supersedes (e.g. an
+    // order's status); it is only conflated with entries a drain could not send.
+    // The stale entry is emptied and the newer one queued at the tail, so messages
+    // still go out in the order they were pushed, less the superseded ones
+    PushResult push(const SharedBuffer& buffer, size_t offset, size_t length, uint64_t key = 0) {
+        bool conflated = false;
+        if (policy == SlowConsumerPolicy::CONFLATE && key != 0) {
+            auto it = latest_by_key.find(key);
+            if (it != latest_by_key.end() && it->second < drained_sequence &&
+                (it->second > front_sequence || front_offset == 0)) {
+                Entry& stale = entries[it->second - front_sequence];
+                backlog -= stale.length;
+                stale = Entry{nullptr, 0, 0, 0};
+                stats.conflated++;
+                conflated = true;
+            }
+        }
+        
+        entries.push_back(Entry{buffer, static_cast<uint32_t>(offset), static_cast<uint32_t>(length), key});
+        if (key != 0) {
+            latest_by_key[key] = front_sequence + entries.size() - 1;
+        }
+        backlog += length;
+        if (backlog > stats.high_water_bytes) {
+            stats.high_water_bytes = backlog;
+        }
+        if (backlog > capacity) {
+            return PushResult::OVERFLOW;
+        }
+        return conflated ? PushResult::CONFLATED : PushResult::QUEUED;
+    }
+    
+    // Copies a message only this queue sends
+    PushResult push(const char* data, size_t length, uint64_t key = 0) {
+        return push(std::make_shared<const std::string>(data, length), 0, length, key);
+    }
+    
+    // Returns false if the socket failed; would-block just leaves the backlog queued
+    bool drain(int fd) {
+        while (!entries.empty()) {
+            iovec iov[kMaxBatch];
+            size_t count = 0;
+            for (size_t i = 0; i < entries.size() && count < kMaxBatch; ++i, ++count) {
+                const Entry& entry = entries[i];
+                size_t skip = i == 0 ? front_offset : 0;
+                // Conflated entries are left empty, with no buffer
+                iov[count].iov_base = entry.buffer ? const_cast<char*>(entry.buffer->data() + entry.offset + skip) : nullptr;
+                iov[count].iov_len = entry.length - skip;
+            }
+            
+            msghdr msg = {};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = count;
+            ssize_t sent = ::sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (sent < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                mark_drained();
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+            consume(static_cast<size_t>(sent));
+            stats.sent_bytes += static_cast<size_t>(sent);
+        }
+        mark_drained();
+        return true;
+    }
+    
+    bool empty() const { return entries.empty(); }
+    size_t backlog_bytes() const { return backlog; }
+    size_t backlog_messages() const { return entries.size(); }
+    const OutputQueueStats& get_stats() const { return stats; }
+    
+private:
+    void consume(size_t sent) {
+        backlog -= sent;
+        while (sent > 0) {
+            Entry& front = entries.front();
+            size_t remaining = front.length - front_offset;
+            if (sent < remaining) {
+                front_offset += sent;
+                return;
+            }
+            sent -= remaining;
+            pop_front();
+        }
+        // A fully sent batch can end exactly on an empty entry
+        while (!entries.empty() && entries.front().length == front_offset) {
+            pop_front();
+        }
+    }
+    
+    void pop_front() {
+        Entry& front = entries.front();
+        if (front.key != 0) {
+            auto it = latest_by_key.find(front.key);
+            if (it != latest_by_key.end() && it->second == front_sequence) {
+                latest_by_key.erase(it);
+            }
+        }
+        if (front.buffer) {
+            stats.sent_messages++;
+        }
+        entries.pop_front();
+        front_sequence++;
+        front_offset = 0;
+    }
+    
+    // Whatever is still queued now has waited on the socket and may be conflated
+    void mark_drained() {
+        drained_sequence = front_sequence + entries.size();
+    }
+};
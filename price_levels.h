@@ -0,0 +1,231 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <type_traits>
+#include <vector>
+#include "matching_engine_types.h"
+#include "node_pool.h"
+
+// Book backend selection, set per symbol
+enum class BookBackend : uint8_t {
+    MAP = 1,
+    LADDER = 2
+};
+
+// What the match loop does when an order would trade against one of the same client's
+enum class SelfTradePrevention : uint8_t {
+    NONE = 0,                       // let it trade
+    CANCEL_RESTING = 1,             // cancel the resting order and keep matching
+    CANCEL_AGGRESSOR = 2,           // stop matching and cancel the incoming remainder
+    CANCEL_BOTH = 3
+};
+
+struct BookConfig {
+    BookBackend backend = BookBackend::MAP;
+    SelfTradePrevention self_trade_prevention = SelfTradePrevention::NONE;
+    // Ladder only: levels cover [min_price, max_price] in steps of tick_size
+    uint64_t tick_size = 0;
+    uint64_t min_price = 0;
+    uint64_t max_price = 0;
+    // Resting orders preallocated in the book's pool
+    size_t order_capacity = 4096;
+};
+
+// Price level with an intrusive FIFO of resting orders
+struct PriceLevel {
+    uint64_t price = 0;
+    uint64_t total_quantity = 0;
+    uint32_t order_count = 0;
+    Order* head = nullptr;
+    Order* tail = nullptr;
+    
+    bool empty() const { return head == nullptr; }
+    
+    void push_back(Order* order) {
+        order->level = this;
+        order->prev = tail;
+        order->next = nullptr;
+        if (tail) {
+            tail->next = order;
+        } else {
+            head = order;
+        }
+        tail = order;
+        total_quantity += order->remaining_quantity;
+        order_count++;
+    }
+    
+    void unlink(Order* order) {
+        if (order->prev) {
+            order->prev->next = order->next;
+        } else {
+            head = order->next;
+        }
+        if (order->next) {
+            order->next->prev = order->prev;
+        } else {
+            tail = order->prev;
+        }
+        total_quantity -= order->remaining_quantity;
+        order_count--;
+        order->prev = nullptr;
+        order->next = nullptr;
+        order->level = nullptr;
+    }
+};
+
+// True if a level at price on this side would trade against a limit at reference
+template<bool IsBid>
+inline bool crosses(uint64_t price, uint64_t reference) {
+    return IsBid ? price >= reference : price <= reference;
+}
+
+// Tree-backed side: any price, O(log n) level insert
+template<bool IsBid>
+class MapPriceLevels {
+    using Compare = std::conditional_t<IsBid, std::greater<uint64_t>, std::less<uint64_t>>;
+    using Allocator = PoolAllocator<std::pair<const uint64_t, PriceLevel>>;
+    std::map<uint64_t, PriceLevel, Compare, Allocator> levels;
+    
+public:
+    static constexpr bool is_bid = IsBid;
+    
+    MapPriceLevels(const BookConfig&, NodePool& pool) : levels(Compare(), Allocator(pool)) {}
+    
+    bool accepts(uint64_t) const { return true; }
+    
+    PriceLevel* best() {
+        return levels.empty() ? nullptr : &levels.begin()->second;
+    }
+    
+    const PriceLevel* best() const {
+        return levels.empty() ? nullptr : &levels.begin()->second;
+    }
+    
+    PriceLevel& get_or_create(uint64_t price) {
+        auto& level = levels[price];
+        level.price = price;
+        return level;
+    }
+    
+    void erase(PriceLevel& level) {
+        levels.erase(level.price);
+    }
+    
+    // Visits non-empty levels from best to worst until f returns false
+    template<typename F>
+    void for_each(F&& f) const {
+        for (const auto& entry : levels) {
+            if (!f(entry.second)) {
+                return;
+            }
+        }
+    }
+};
+
+// Dense array side for tick-bounded symbols: O(1) level access, bitmap scan for the next best
+template<bool IsBid>
+class LadderPriceLevels {
+    static constexpr size_t npos = static_cast<size_t>(-1);
+    
+    uint64_t min_price;
+    uint64_t max_price;
+    uint64_t tick_size;
+    std::vector<PriceLevel> levels;
+    std::vector<uint64_t> occupied;
+    size_t best_index = npos;
+    
+public:
+    static constexpr bool is_bid = IsBid;
+    
+    LadderPriceLevels(const BookConfig& config, NodePool&)
+        : min_price(config.min_price), max_price(config.max_price), tick_size(config.tick_size) {
+        size_t count = static_cast<size_t>((max_price - min_price) / tick_size) + 1;
+        levels.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            levels[i].price = min_price + i * tick_size;
+        }
+        occupied.assign((count + 63) / 64, 0);
+    }
+    
+    bool accepts(uint64_t price) const {
+        return price >= min_price && price <= max_price && (price - min_price) % tick_size == 0;
+    }
+    
+    PriceLevel* best() {
+        return best_index == npos ? nullptr : &levels[best_index];
+    }
+    
+    const PriceLevel* best() const {
+        return best_index == npos ? nullptr : &levels[best_index];
+    }
+    
+    PriceLevel& get_or_create(uint64_t price) {
+        size_t index = static_cast<size_t>((price - min_price) / tick_size);
+        uint64_t bit = 1ULL << (index & 63);
+        if (!(occupied[index >> 6] & bit)) {
+            occupied[index >> 6] |= bit;
+            if (best_index == npos || (IsBid ? index > best_index : index < best_index)) {
+                best_index = index;
+            }
+        }
+        return levels[index];
+    }
+    
+    void erase(PriceLevel& level) {
+        size_t index = static_cast<size_t>(&level - levels.data());
+        occupied[index >> 6] &= ~(1ULL << (index & 63));
+        if (index == best_index) {
+            best_index = next_occupied(index);
+        }
+    }
+    
+    template<typename F>
+    void for_each(F&& f) const {
+        for (size_t index = best_index; index != npos; index = next_occupied(index)) {
+            if (!f(levels[index])) {
+                return;
+            }
+        }
+    }
+    
+private:
+    // Next occupied index after `index` in priority order (down for bids, up for asks)
+    size_t next_occupied(size_t index) const {
+        if (IsBid) {
+            if (index == 0) {
+                return npos;
+            }
+            --index;
+            size_t word = index >> 6;
+            uint64_t bits = occupied[word] & (~0ULL >> (63 - (index & 63)));
+            while (true) {
+                if (bits) {
+                    return (word << 6) + 63 - __builtin_clzll(bits);
+                }
+                if (word == 0) {
+                    return npos;
+                }
+                bits = occupied[--word];
+            }
+        } else {
+            ++index;
+            if (index >= levels.size()) {
+                return npos;
+            }
+            size_t word = index >> 6;
+            uint64_t bits = occupied[word] & (~0ULL << (index & 63));
+            while (true) {
+                if (bits) {
+                    return (word << 6) + __builtin_ctzll(bits);
+                }
+                if (++word == occupied.size()) {
+                    return npos;
+                }
+                bits = occupied[word];
+            }
+        }
+    }
+};
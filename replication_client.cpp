@@ -0,0 +1,144 @@
+#include "replication_client.h"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "log.h"
+#include "replication_protocol.h"
+
+ReplicationClient::ReplicationClient(const std::string& primary_host, uint16_t primary_port)
+    : host(primary_host), port(primary_port), rxbuf(kReceiveBytes) {}
+
+ReplicationClient::~ReplicationClient() {
+    close();
+}
+
+bool ReplicationClient::connect(uint64_t sequence) {
+    close();
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+        LOG_ERROR("[replication] Bad primary address %s\n", host.c_str());
+        return false;
+    }
+    fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        close();
+        return false;
+    }
+    
+    synchronized = false;
+    last_sequence = sequence;
+    ReplicationHelloMsg hello;
+    hello.header.length = sizeof(hello);
+    hello.header.msg_type = static_cast<uint8_t>(ReplicationMsgType::HELLO);
+    hello.last_sequence = sequence;
+    if (!send_all(&hello, sizeof(hello))) {
+        close();
+        return false;
+    }
+    LOG_INFO("[replication] Connected to primary %s:%u from sequence %lu\n", host.c_str(), port, sequence);
+    return true;
+}
+
+void ReplicationClient::close() {
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    rx_length = 0;
+}
+
+ReplicationClient::Status ReplicationClient::receive(std::vector<OrderJournal::Record>& records, int timeout_ms) {
+    pollfd pfd{fd, POLLIN, 0};
+    int ready = ::poll(&pfd, 1, timeout_ms);
+    if (ready == 0 || (ready < 0 && errno == EINTR)) {
+        return Status::IDLE;
+    }
+    ssize_t received = ready < 0 ? -1 : ::recv(fd, rxbuf.data() + rx_length, rxbuf.size() - rx_length, 0);
+    if (received <= 0) {
+        if (received < 0 && errno == EINTR) {
+            return Status::IDLE;
+        }
+        LOG_WARN("[replication] Lost primary %s:%u at sequence %lu\n", host.c_str(), port, last_sequence);
+        close();
+        return Status::LOST;
+    }
+    rx_length += static_cast<size_t>(received);
+    
+    size_t offset = 0;
+    if (!synchronized) {
+        if (rx_length < sizeof(ReplicationStartMsg)) {
+            return Status::IDLE;
+        }
+        ReplicationStartMsg start;
+        memcpy(&start, rxbuf.data(), sizeof(start));
+        if (start.header.msg_type != static_cast<uint8_t>(ReplicationMsgType::START) ||
+            start.header.length != sizeof(start) || start.record_size != sizeof(OrderJournal::Record)) {
+            LOG_ERROR("[replication] Primary %s:%u does not speak this replication format\n", host.c_str(), port);
+            close();
+            return Status::FAILED;
+        }
+        if (start.last_sequence < last_sequence) {
+            LOG_ERROR("[replication] Primary %s:%u ends at sequence %lu, before this backup's %lu; refusing to follow\n",
+                      host.c_str(), port, start.last_sequence, last_sequence);
+            close();
+            return Status::FAILED;
+        }
+        LOG_INFO("[replication] Following primary %s:%u, %lu records behind\n", host.c_str(), port,
+                 start.last_sequence - last_sequence);
+        synchronized = true;
+        offset = sizeof(start);
+    }
+    
+    size_t first = records.size();
+    while (rx_length - offset >= sizeof(OrderJournal::Record)) {
+        OrderJournal::Record record;
+        memcpy(&record, rxbuf.data() + offset, sizeof(record));
+        if (record.sequence != last_sequence + 1 || !OrderJournal::is_intact(record)) {
+            LOG_ERROR("[replication] Bad record from primary after sequence %lu\n", last_sequence);
+            close();
+            return Status::FAILED;
+        }
+        records.push_back(record);
+        last_sequence = record.sequence;
+        offset += sizeof(record);
+    }
+    memmove(rxbuf.data(), rxbuf.data() + offset, rx_length - offset);
+    rx_length -= offset;
+    return records.size() > first ? Status::RECORDS : Status::IDLE;
+}
+
+bool ReplicationClient::ack(uint64_t sequence) {
+    ReplicationAckMsg ack;
+    ack.header.length = sizeof(ack);
+    ack.header.msg_type = static_cast<uint8_t>(ReplicationMsgType::ACK);
+    ack.sequence = sequence;
+    return send_all(&ack, sizeof(ack));
+}
+
+bool ReplicationClient::send_all(const void* data, size_t length) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    while (length > 0) {
+        ssize_t sent = ::send(fd, bytes, length, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        bytes += sent;
+        length -= static_cast<size_t>(sent);
+    }
+    return true;
+}
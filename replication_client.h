@@ -0,0 +1,51 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "order_journal.h"
+
+// Backup end of replication (see replication_protocol.h): a plain blocking socket
+// to the primary, driven by the engine's standby loop. Every record is checked for
+// sequence and checksum before it is handed out, so the caller only ever applies
+// an unbroken, intact prefix of the primary's journal.
+class ReplicationClient {
+public:
+    enum class Status {
+        RECORDS,        // records were appended
+        IDLE,           // nothing arrived within the timeout
+        LOST,           // the connection dropped
+        FAILED          // the primary refused this backup or sent a bad stream
+    };
+    
+    ReplicationClient(const std::string& host, uint16_t port);
+    ~ReplicationClient();
+    ReplicationClient(const ReplicationClient&) = delete;
+    ReplicationClient& operator=(const ReplicationClient&) = delete;
+    
+    // Connects and sends HELLO; false if the primary cannot be reached
+    bool connect(uint64_t last_sequence);
+    void close();
+    bool is_connected() const { return fd >= 0; }
+    // True from the primary's START until the next connect; only a connection lost
+    // after START is a failure of the primary
+    bool is_synchronized() const { return synchronized; }
+    
+    // Waits up to timeout_ms and appends the complete records that arrived
+    Status receive(std::vector<OrderJournal::Record>& records, int timeout_ms);
+    // Acknowledges every record up to sequence
+    bool ack(uint64_t sequence);
+    
+private:
+    static constexpr size_t kReceiveBytes = 1 << 20;
+    
+    std::string host;
+    uint16_t port;
+    int fd = -1;
+    bool synchronized = false;
+    uint64_t last_sequence = 0;
+    std::vector<uint8_t> rxbuf;
+    size_t rx_length = 0;
+    
+    bool send_all(const void* data, size_t length);
+};
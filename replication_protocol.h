@@ -0,0 +1,42 @@
+#pragma once
+#include <cstdint>
+#include "order_entry_protocol.h"
+
+// Primary/backup replication of the sequenced inbound stream. A backup connects
+// to the primary's replication port and sends HELLO with the last journal sequence
+// it holds (0 for none). The primary answers with START, then streams its journal
+// records (OrderJournal::Record, unframed, exactly as they lie in the file) from
+// the next sequence on, without waiting for acknowledgements. The backup runs each
+// record through its books with output suppressed and sends a cumulative ACK of the
+// last sequence it has applied after every batch it receives.
+//
+// Records are fixed-size and each carries its sequence and checksum, so the backup
+// validates the stream as it goes. A primary configured for synchronous
+// replication matches a command only once enough caught-up backups have
+// acknowledged it; otherwise it matches first and backups trail by the batches in
+// flight. When the connection to the primary drops after START, the backup takes
+// over from the state it already holds.
+enum class ReplicationMsgType : uint8_t {
+    HELLO = 'H',        // backup -> primary
+    ACK = 'A',          // backup -> primary
+    START = 'S'         // primary -> backup, before the first record
+};
+
+#pragma pack(push, 1)
+struct ReplicationHelloMsg {
+    MsgHeader header;
+    uint64_t last_sequence;
+};
+
+struct ReplicationAckMsg {
+    MsgHeader header;
+    uint64_t sequence;                  // every record up to it is applied
+};
+
+struct ReplicationStartMsg {
+    MsgHeader header;
+    uint32_t record_size;               // sizeof(OrderJournal::Record)
+    uint64_t last_sequence;             // primary's last journaled sequence; a backup
+                                        // past it has diverged and must not follow
+};
+#pragma pack(pop)
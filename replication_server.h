@@ -0,0 +1,164 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include <sys/socket.h>
+#include "../TradeCoreExport/tcp_server_socket.h"
+#include "log.h"
+#include "order_journal.h"
+#include "replication_protocol.h"
+
+// Replication Server Socket: one backup (see replication_protocol.h). Records are
+// sent straight from the journal mapping, so there is no per-backup copy of the
+// stream; a backup the socket cannot keep up with simply falls behind in the
+// journal and catches up as its acknowledgements come back. Event loop only.
+template<typename server_t>
+class replication_socket_t : public tcp_server_socket_t {
+public:
+    // Most bytes handed to one send; acknowledgements pace the rest of a catch-up
+    static constexpr size_t kMaxSendBytes = 1 << 20;
+    
+    server_t* parent_server;
+    std::string backup_id;
+    std::vector<uint8_t> rxbuf;
+    // START, ahead of the records
+    std::string preamble;
+    // Set by HELLO: records go out from next_sequence on, sent_bytes of it already sent
+    bool streaming = false;
+    uint64_t next_sequence = 0;
+    size_t sent_bytes = 0;
+    uint64_t acked_sequence = 0;
+    // Journal sequence when the backup joined; it counts towards synchronous
+    // replication once it has acknowledged that far
+    uint64_t catch_up_sequence = 0;
+    bool in_sync = false;
+    bool disconnecting = false;
+    
+    // Constructor
+    replication_socket_t(int fd, sockaddr_in clientaddr, socklen_t clientlen,
+                         sockaddr_in local_addr, uint16_t local_port_, tcp_server_t* parent)
+        : tcp_server_socket_t(fd, clientaddr, clientlen, local_addr, local_port_, parent),
+          parent_server(nullptr), backup_id("backup_" + std::to_string(fd)) {}
+    
+    size_t handle_packet(const uint8_t* buf, const size_t len, uint64_t ts, void* sock, bool& should_disconnect) override;
+    void gen_shm_name(const int fd, char* buf) override;
+    void on_add() override;
+    void on_remove() override;
+    
+    // Never blocks: whatever the socket does not take is sent on a later call
+    void send_records(const OrderJournal& journal);
+    void disconnect(const char* reason);
+};
+
+// Implementation
+// Backups send HELLO once, then ACKs
+template<typename server_t>
+size_t replication_socket_t<server_t>::handle_packet(const uint8_t* buf, const size_t len, uint64_t, void*,
+                                                     bool& should_disconnect) {
+    rxbuf.insert(rxbuf.end(), buf, buf + len);
+    size_t offset = 0;
+    while (rxbuf.size() - offset >= sizeof(MsgHeader)) {
+        MsgHeader header;
+        memcpy(&header, rxbuf.data() + offset, sizeof(header));
+        if (rxbuf.size() - offset < header.length) {
+            break;
+        }
+        if (header.msg_type == static_cast<uint8_t>(ReplicationMsgType::HELLO) &&
+            header.length == sizeof(ReplicationHelloMsg) && !streaming) {
+            ReplicationHelloMsg hello;
+            memcpy(&hello, rxbuf.data() + offset, sizeof(hello));
+            if (parent_server) {
+                parent_server->on_hello(this, hello.last_sequence);
+            }
+        } else if (header.msg_type == static_cast<uint8_t>(ReplicationMsgType::ACK) &&
+                   header.length == sizeof(ReplicationAckMsg) && streaming) {
+            ReplicationAckMsg ack;
+            memcpy(&ack, rxbuf.data() + offset, sizeof(ack));
+            if (parent_server) {
+                parent_server->on_ack(this, ack.sequence);
+            }
+        } else {
+            LOG_WARN("[replication] Unexpected message type %u length %u from %s\n", header.msg_type,
+                     header.length, backup_id.c_str());
+            rxbuf.clear();
+            should_disconnect = true;
+            return len;
+        }
+        offset += header.length;
+    }
+    rxbuf.erase(rxbuf.begin(), rxbuf.begin() + offset);
+    return len;
+}
+
+template<typename server_t>
+void replication_socket_t<server_t>::gen_shm_name(const int fd, char* buf) {
+    snprintf(buf, 256, "replication_%d_%d", getpid(), fd);
+}
+
+template<typename server_t>
+void replication_socket_t<server_t>::on_add() {
+    LOG_INFO("[replication] Backup %s connected (fd=%d)\n", backup_id.c_str(), get_fd());
+}
+
+template<typename server_t>
+void replication_socket_t<server_t>::on_remove() {
+    LOG_INFO("[replication] Backup %s disconnected at sequence %lu (fd=%d)\n", backup_id.c_str(), acked_sequence,
+             get_fd());
+    if (parent_server) {
+        auto& backups = parent_server->backups;
+        backups.erase(std::remove(backups.begin(), backups.end(), this), backups.end());
+        parent_server->on_backup_lost();
+    }
+}
+
+template<typename server_t>
+void replication_socket_t<server_t>::send_records(const OrderJournal& journal) {
+    if (disconnecting) {
+        return;
+    }
+    while (!preamble.empty()) {
+        ssize_t sent = ::send(get_fd(), preamble.data(), preamble.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                disconnect("send failed");
+            }
+            return;
+        }
+        preamble.erase(0, static_cast<size_t>(sent));
+    }
+    if (!streaming) {
+        return;
+    }
+    
+    std::string_view records = journal.records_from(next_sequence);
+    if (records.size() <= sent_bytes) {
+        return;
+    }
+    size_t length = std::min(records.size() - sent_bytes, kMaxSendBytes);
+    ssize_t sent = ::send(get_fd(), records.data() + sent_bytes, length, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (sent < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            disconnect("send failed");
+        }
+        return;
+    }
+    size_t total = sent_bytes + static_cast<size_t>(sent);
+    next_sequence += total / sizeof(OrderJournal::Record);
+    sent_bytes = total % sizeof(OrderJournal::Record);
+}
+
+// Shut down rather than closed: on_remove() then drops the backup from the sync
+// replication count, and the backup reconnects and resumes from its acked sequence
+template<typename server_t>
+void replication_socket_t<server_t>::disconnect(const char* reason) {
+    if (disconnecting) {
+        return;
+    }
+    LOG_WARN("[replication] Disconnecting %s: %s\n", backup_id.c_str(), reason);
+    disconnecting = true;
+    ::shutdown(get_fd(), SHUT_RDWR);
+}
@@ -0,0 +1,271 @@
+#include "risk_manager.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+    constexpr uint64_t kThrottleWindowNs = 1000000000ULL;
+    
+    // Saturates instead of wrapping, so an absurd order still fails the limit
+    uint64_t notional(uint64_t quantity, uint64_t price) {
+        unsigned __int128 product = static_cast<unsigned __int128>(quantity) * price;
+        return product > UINT64_MAX ? UINT64_MAX : static_cast<uint64_t>(product);
+    }
+    
+    uint64_t add_saturating(uint64_t a, uint64_t b) {
+        return a > UINT64_MAX - b ? UINT64_MAX : a + b;
+    }
+    
+    // Value-initialized array of count T in slot, allocated by whichever thread
+    // gets there first; the others free theirs and use the winner's
+    template<typename T>
+    T* get_or_allocate(std::atomic<T*>& slot, size_t count) {
+        T* current = slot.load(std::memory_order_acquire);
+        if (current) {
+            return current;
+        }
+        T* allocated = new T[count]();
+        if (slot.compare_exchange_strong(current, allocated, std::memory_order_acq_rel, std::memory_order_acquire)) {
+            return allocated;
+        }
+        delete[] allocated;
+        return current;
+    }
+}
+
+const char* reject_reason_name(RejectReason reason) {
+    switch (reason) {
+        case RejectReason::NONE: return "none";
+        case RejectReason::QUANTITY: return "quantity";
+        case RejectReason::NOTIONAL: return "notional";
+        case RejectReason::PRICE_BAND: return "price_band";
+        case RejectReason::OPEN_NOTIONAL: return "open_notional";
+        case RejectReason::POSITION: return "position";
+        case RejectReason::THROTTLE: return "throttle";
+        case RejectReason::CAPACITY: return "capacity";
+        case RejectReason::TICK_SIZE: return "tick_size";
+        case RejectReason::LOT_SIZE: return "lot_size";
+        case RejectReason::HALTED: return "halted";
+        case RejectReason::SESSION: return "session";
+        case RejectReason::JOURNAL: return "journal";
+    }
+    return "unknown";
+}
+
+RiskManager::RiskManager(const RiskLimits& risk_limits, size_t client_capacity, size_t symbol_capacity)
+    : limits(risk_limits), max_clients(client_capacity), max_symbols(symbol_capacity),
+      clients(new ClientState[client_capacity]), symbols(new SymbolState[symbol_capacity]) {
+    if (limits.max_position > 0) {
+        position_rows.reset(new std::atomic<std::atomic<PositionState*>*>[max_clients]());
+    }
+}
+
+RiskManager::~RiskManager() {
+    if (!position_rows) {
+        return;
+    }
+    for (size_t client = 0; client < max_clients; ++client) {
+        std::atomic<PositionState*>* row = position_rows[client].load(std::memory_order_acquire);
+        if (!row) {
+            continue;
+        }
+        for (size_t chunk = 0; chunk < chunks_per_row(); ++chunk) {
+            delete[] row[chunk].load(std::memory_order_acquire);
+        }
+        delete[] row;
+    }
+}
+
+// Any thread; null when positions are not tracked
+RiskManager::PositionState* RiskManager::position_of(ClientId client, SymbolId symbol) {
+    if (!position_rows) {
+        return nullptr;
+    }
+    std::atomic<PositionState*>* row = get_or_allocate(position_rows[client], chunks_per_row());
+    PositionState* chunk = get_or_allocate(row[symbol / kPositionChunk], kPositionChunk);
+    return &chunk[symbol % kPositionChunk];
+}
+
+uint64_t RiskManager::reference_price(SymbolId symbol) const {
+    uint64_t last = symbols[symbol].last_trade.load(std::memory_order_relaxed);
+    return last ? last : symbols[symbol].mid.load(std::memory_order_relaxed);
+}
+
+// A market order is valued at the reference price; with none it has no notional
+uint64_t RiskManager::valuation_price(const OrderRequest& request) const {
+    return request.order_type == OrderType::MARKET ? reference_price(request.symbol_id) : request.price;
+}
+
+// Cancels and modifies only ever reduce exposure and always pass. A replace is
+// checked like a new order except for position: its side is that of the order it
+// replaces, which only the shard knows.
+RejectReason RiskManager::check(OrderRequest& request, uint64_t now) {
+    if (request.type != RequestType::NEW_ORDER && request.type != RequestType::REPLACE_ORDER) {
+        return RejectReason::NONE;
+    }
+    RejectReason reason = evaluate(request, now);
+    if (reason == RejectReason::NONE) {
+        reserve(request);
+    } else {
+        rejects[static_cast<size_t>(reason)]++;
+    }
+    return reason;
+}
+
+RejectReason RiskManager::evaluate(OrderRequest& request, uint64_t now) {
+    if (!in_range(request.client_id, request.symbol_id)) {
+        return RejectReason::CAPACITY;
+    }
+    ClientState& client = clients[request.client_id];
+    
+    if (limits.max_orders_per_second > 0) {
+        if (now - client.window_start >= kThrottleWindowNs) {
+            client.window_start = now;
+            client.window_orders = 0;
+        }
+        if (client.window_orders >= limits.max_orders_per_second) {
+            return RejectReason::THROTTLE;
+        }
+        client.window_orders++;
+    }
+    
+    if (limits.max_order_quantity > 0 && request.quantity > limits.max_order_quantity) {
+        return RejectReason::QUANTITY;
+    }
+    
+    // Valued once, so a reference price that moves meanwhile cannot make the
+    // reservation differ from what settle() takes back
+    uint64_t reference = reference_price(request.symbol_id);
+    bool is_market = request.order_type == OrderType::MARKET;
+    uint64_t price = is_market ? reference : request.price;
+    request.risk_price = price;
+if (limits.max_order_notional > 0 && notional(request.quantity, price) > limits.max_order_notional) {
+        return RejectReason::NOTIONAL;
+    }
+    
+    if (limits.price_band_bps > 0 && !is_market && reference > 0) {
+        uint64_t distance = price > reference ? price - reference : reference - price;
+        if (static_cast<unsigned __int128>(distance) * 10000 >
+            static_cast<unsigned __int128>(reference) * limits.price_band_bps) {
+            return RejectReason::PRICE_BAND;
+        }
+    }
+    
+    if (limits.max_open_notional > 0) {
+        uint64_t open = client.open_notional.load(std::memory_order_relaxed);
+        if (add_saturating(open, notional(request.quantity, price)) > limits.max_open_notional) {
+            return RejectReason::OPEN_NOTIONAL;
+        }
+    }
+    
+    if (limits.max_position > 0 && request.type == RequestType::NEW_ORDER) {
+        const PositionState* state = position_of(request.client_id, request.symbol_id);
+        int64_t position = state->position.load(std::memory_order_relaxed);
+        // Worst case on the order's side: everything open on it fills, then this order
+        int64_t exposed = (request.side == OrderSide::BUY) ? position : -position;
+        uint64_t open = (request.side == OrderSide::BUY) ? state->open_buy.load(std::memory_order_relaxed)
+                                                         : state->open_sell.load(std::memory_order_relaxed);
+        __int128 worst = static_cast<__int128>(exposed) + open + request.quantity;
+        if (worst > static_cast<__int128>(limits.max_position)) {
+            return RejectReason::POSITION;
+        }
+    }
+    return RejectReason::NONE;
+}
+
+void RiskManager::reserve(const OrderRequest& request) {
+    if (!in_range(request.client_id, request.symbol_id)) {
+        return;
+    }
+    clients[request.client_id].open_notional.fetch_add(notional(request.quantity, request.risk_price),
+                                                       std::memory_order_relaxed);
+    if (PositionState* state = position_of(request.client_id, request.symbol_id);
+        state && request.type == RequestType::NEW_ORDER) {
+        auto& open = (request.side == OrderSide::BUY) ? state->open_buy : state->open_sell;
+        open.fetch_add(request.quantity, std::memory_order_relaxed);
+    }
+}
+
+// Drops the gateway's reservation once the shard takes the request over; what
+// rests is then added back by open()
+void RiskManager::settle(const OrderRequest& request) {
+    if (!in_range(request.client_id, request.symbol_id)) {
+        return;
+    }
+    clients[request.client_id].open_notional.fetch_sub(notional(request.quantity, request.risk_price),
+                                                       std::memory_order_relaxed);
+    if (PositionState* state = position_of(request.client_id, request.symbol_id);
+        state && request.type == RequestType::NEW_ORDER) {
+        auto& open = (request.side == OrderSide::BUY) ? state->open_buy : state->open_sell;
+        open.fetch_sub(request.quantity, std::memory_order_relaxed);
+    }
+}
+
+void RiskManager::open(ClientId client, SymbolId symbol, OrderSide side, uint64_t quantity, uint64_t price) {
+    if (!in_range(client, symbol)) {
+        return;
+    }
+    clients[client].open_notional.fetch_add(notional(quantity, price), std::memory_order_relaxed);
+    if (PositionState* state = position_of(client, symbol)) {
+        auto& open = (side == OrderSide::BUY) ? state->open_buy : state->open_sell;
+        open.fetch_add(quantity, std::memory_order_relaxed);
+    }
+}
+
+void RiskManager::close(ClientId client, SymbolId symbol, OrderSide side, uint64_t quantity, uint64_t price) {
+    if (!in_range(client, symbol)) {
+        return;
+    }
+    clients[client].open_notional.fetch_sub(notional(quantity, price), std::memory_order_relaxed);
+    if (PositionState* state = position_of(client, symbol)) {
+        auto& open = (side == OrderSide::BUY) ? state->open_buy : state->open_sell;
+        open.fetch_sub(quantity, std::memory_order_relaxed);
+    }
+}
+
+void RiskManager::on_fill(const Fill& fill) {
+    if (fill.symbol_id >= max_symbols) {
+        return;
+    }
+    symbols[fill.symbol_id].last_trade.store(fill.price, std::memory_order_relaxed);
+    if (!position_rows) {
+        return;
+    }
+    int64_t quantity = static_cast<int64_t>(fill.quantity);
+    if (fill.buy_client_id < max_clients) {
+        position_of(fill.buy_client_id, fill.symbol_id)->position.fetch_add(quantity, std::memory_order_relaxed);
+    }
+    if (fill.sell_client_id < max_clients) {
+        position_of(fill.sell_client_id, fill.symbol_id)->position.fetch_sub(quantity, std::memory_order_relaxed);
+    }
+}
+
+void RiskManager::restore_position(ClientId client, SymbolId symbol, int64_t position) {
+    if (PositionState* state = in_range(client, symbol) ? position_of(client, symbol) : nullptr) {
+        state->position.store(position, std::memory_order_relaxed);
+    }
+}
+
+void RiskManager::restore_last_trade(SymbolId symbol, uint64_t price) {
+    if (symbol < max_symbols) {
+        symbols[symbol].last_trade.store(price, std::memory_order_relaxed);
+    }
+}
+
+void RiskManager::on_top(const MarketDataSnapshot& top) {
+    if (top.symbol_id >= max_symbols) {
+        return;
+    }
+    uint64_t mid = (top.bid_price && top.ask_price) ? top.bid_price / 2 + top.ask_price / 2 : 0;
+    symbols[top.symbol_id].mid.store(mid, std::memory_order_relaxed);
+}
+
+void RiskManager::append_report(std::string& out) const {
+    char line[256];
+    int len = snprintf(line, sizeof(line), "RISK");
+    for (size_t i = 1; i < kReasonCount && len < static_cast<int>(sizeof(line)); ++i) {
+        len += snprintf(line + len, sizeof(line) - len, ":%s=%lu",
+                        reject_reason_name(static_cast<RejectReason>(i)), rejects[i]);
+    }
+    out.append(line, std::min<size_t>(len, sizeof(line) - 1));
+    out.push_back('\n');
+}
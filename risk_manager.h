@@ -0,0 +1,112 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "matching_engine_types.h"
+
+// Pre-trade limits; 0 turns a limit off. Notionals are quantity * price in nanos.
+struct RiskLimits {
+    uint64_t max_order_quantity = 0;
+    uint64_t max_order_notional = 0;
+    // Limit prices further than this from the last trade (or the mid before any) are rejected
+    uint64_t price_band_bps = 0;
+    // Per client: notional of its resting orders plus those on their way to a shard
+    uint64_t max_open_notional = 0;
+    // Per client and symbol: net position if every open order on the order's side filled
+    uint64_t max_position = 0;
+    // Per client: new and replace orders in any one second
+    uint64_t max_orders_per_second = 0;
+    
+    bool enabled() const {
+        return max_order_quantity || max_order_notional || price_band_bps || max_open_notional ||
+               max_position || max_orders_per_second;
+    }
+};
+
+// Checks run on the gateway thread before a request is journaled, so a rejected
+// request never reaches the journal or a book. Exposure is not recomputed: the
+// gateway reserves an accepted order's notional and quantity, and the matching
+// thread of the symbol settles the reservation and applies each rest, fill and
+// cancel as it happens. Every check is a few array lookups on preallocated state.
+// Counters shared between the two threads are relaxed atomics; the gateway may
+// see a fill a little late, never an order it has not accounted for.
+class RiskManager {
+public:
+    // Client and symbol ids run below max_clients and max_symbols, the capacities of
+    // the interners that hand them out, so every id has state
+    RiskManager(const RiskLimits& limits, size_t max_clients, size_t max_symbols);
+    ~RiskManager();
+    RiskManager(const RiskManager&) = delete;
+    RiskManager& operator=(const RiskManager&) = delete;
+    
+    // Gateway thread. On acceptance the order is reserved until settle(), at the
+    // price check() stores in request.risk_price
+    RejectReason check(OrderRequest& request, uint64_t now);
+    // Reserves without checking, for journal replay; request.risk_price must be set
+    void reserve(const OrderRequest& request);
+    // Price an order's notional is checked and reserved at
+    uint64_t valuation_price(const OrderRequest& request) const;
+    
+    // Matching thread of the request's symbol
+    void settle(const OrderRequest& request);
+    void open(ClientId client, SymbolId symbol, OrderSide side, uint64_t quantity, uint64_t price);
+    void close(ClientId client, SymbolId symbol, OrderSide side, uint64_t quantity, uint64_t price);
+    void on_fill(const Fill& fill);
+    void on_top(const MarketDataSnapshot& top);
+    
+    // Startup, before any request: state carried over from a checkpoint. Open
+    // exposure is not carried; restoring the resting orders reopens it
+    void restore_position(ClientId client, SymbolId symbol, int64_t position);
+    void restore_last_trade(SymbolId symbol, uint64_t price);
+    
+    // RISK:<reason>=<count>... line for the STATS reply; gateway thread
+    void append_report(std::string& out) const;
+    
+private:
+    struct alignas(64) ClientState {
+        std::atomic<uint64_t> open_notional{0};
+        // Throttle window, touched by the gateway thread only
+        uint64_t window_start = 0;
+        uint64_t window_orders = 0;
+    };
+    
+    struct PositionState {
+        std::atomic<int64_t> position{0};
+        std::atomic<uint64_t> open_buy{0};
+        std::atomic<uint64_t> open_sell{0};
+    };
+    
+    struct alignas(64) SymbolState {
+        std::atomic<uint64_t> last_trade{0};
+        std::atomic<uint64_t> mid{0};
+    };
+    
+    // The reasons check() returns; the instrument reasons after CAPACITY are the engine's
+    static constexpr size_t kReasonCount = static_cast<size_t>(RejectReason::CAPACITY) + 1;
+    
+    // Symbols per lazily allocated block of positions
+    static constexpr size_t kPositionChunk = 64;
+    
+    RiskLimits limits;
+    size_t max_clients;
+    size_t max_symbols;
+    std::unique_ptr<ClientState[]> clients;
+    std::unique_ptr<SymbolState[]> symbols;
+    // Only allocated when max_position is set: per client a row of chunk pointers,
+    // each covering kPositionChunk symbols. Rows and chunks are allocated by the
+    // first thread to touch them, so memory follows the pairs that actually trade
+    std::unique_ptr<std::atomic<std::atomic<PositionState*>*>[]> position_rows;
+    uint64_t rejects[kReasonCount] = {};
+    
+    bool in_range(ClientId client, SymbolId symbol) const {
+        return client < max_clients && symbol < max_symbols;
+    }
+    size_t chunks_per_row() const { return (max_symbols + kPositionChunk - 1) / kPositionChunk; }
+    PositionState* position_of(ClientId client, SymbolId symbol);
+    uint64_t reference_price(SymbolId symbol) const;
+    RejectReason evaluate(OrderRequest& request, uint64_t now);
+};
+
+const char* reject_reason_name(RejectReason reason);
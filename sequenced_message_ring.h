@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Bounded history of the most recent sequenced feed messages, kept for retransmission.
+// Slot i holds sequence i modulo capacity; older messages are overwritten in place.
+class SequencedMessageRing {
+public:
+    static constexpr size_t kMaxMessageSize = 64;
+    
+private:
+    struct Slot {
+        uint64_t sequence = 0;
+        uint16_t length = 0;
+        uint8_t data[kMaxMessageSize];
+    };
+    
+    std::vector<Slot> slots;
+    uint64_t newest = 0;
+    
+public:
+    explicit SequencedMessageRing(size_t capacity) : slots(capacity > 0 ? capacity : 1) {}
+    
+    // Sequences must be appended in order starting at 1
+    void append(uint64_t sequence, const void* msg, size_t length) {
+        Slot& slot = slots[sequence % slots.size()];
+        slot.sequence = sequence;
+        slot.length = static_cast<uint16_t>(length < kMaxMessageSize ? length : kMaxMessageSize);
+        memcpy(slot.data, msg, slot.length);
+        newest = sequence;
+    }
+    
+    // True if every message in [first, first + count) is still held
+    bool contains(uint64_t first, uint64_t count) const {
+        if (first == 0 || count == 0 || count > newest || first > newest - count + 1) {
+            return false;
+        }
+        return newest - first < slots.size();
+    }
+    
+    // Calls f(sequence, data, length) for each message in [first, first + count); check contains() first
+    template<typename F>
+    void for_range(uint64_t first, uint64_t count, F&& f) const {
+        for (uint64_t sequence = first; sequence < first + count; ++sequence) {
+            const Slot& slot = slots[sequence % slots.size()];
+            f(sequence, slot.data, slot.length);
+        }
+    }
+    
+    uint64_t last_sequence() const { return newest; }
+};
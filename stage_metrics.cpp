@@ -0,0 +1,73 @@
+#include "stage_metrics.h"
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+    const char* kStageNames[kStageCount] = {"receive", "parse", "match", "drop_copy", "multicast"};
+    
+    struct StageHistograms {
+        SharedLatencyHistogram stages[kStageCount];
+    };
+    
+    // Histograms outlive their threads so a report after shutdown still sees them
+    std::mutex registry_mutex;
+    std::vector<std::unique_ptr<StageHistograms>> registry;
+    
+    double ns_per_tick = 1.0;
+    
+    StageHistograms& thread_histograms() {
+        thread_local StageHistograms* histograms = nullptr;
+        if (!histograms) {
+            auto owned = std::make_unique<StageHistograms>();
+            histograms = owned.get();
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            registry.push_back(std::move(owned));
+        }
+        return *histograms;
+    }
+}
+
+void init_stage_metrics() {
+    ns_per_tick = 1.0 / calibrate_tsc_per_ns(std::chrono::milliseconds(50));
+}
+
+void record_stage_ticks(Stage stage, uint64_t start_tsc, uint64_t end_tsc) {
+    record_stage_ns(stage, static_cast<uint64_t>((end_tsc - start_tsc) * ns_per_tick));
+}
+
+void record_stage_ns(Stage stage, uint64_t ns) {
+    thread_histograms().stages[static_cast<size_t>(stage)].record(ns);
+}
+
+std::string format_stage_report() {
+    LatencyHistogram merged[kStageCount];
+    size_t threads;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        threads = registry.size();
+        for (const auto& histograms : registry) {
+            for (size_t i = 0; i < kStageCount; ++i) {
+                histograms->stages[i].copy_to(merged[i]);
+            }
+        }
+    }
+    
+    std::string report;
+    char line[256];
+    for (size_t i = 0; i < kStageCount; ++i) {
+        const LatencyHistogram& h = merged[i];
+        if (h.count() == 0) {
+            continue;
+        }
+        int len = snprintf(line, sizeof(line), "STATS:%s:count=%lu:p50=%lu:p99=%lu:p99.9=%lu:max=%lu:threads=%zu\n",
+                           kStageNames[i], h.count(), h.percentile(50.0), h.percentile(99.0),
+                           h.percentile(99.9), h.max(), threads);
+        report.append(line, std::min<size_t>(len, sizeof(line) - 1));
+    }
+    if (report.empty()) {
+        report = "STATS:empty\n";
+    }
+    return report;
+}
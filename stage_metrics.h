@@ -0,0 +1,28 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "latency_histogram.h"
+
+// Hot-path stages timed with the TSC and recorded in nanoseconds
+enum class Stage : uint8_t {
+    RECEIVE = 0,    // socket receive timestamp to the gateway handling the read
+    PARSE,          // decoding one inbound message
+    MATCH,          // executing one request against its book
+    DROP_COPY,      // one drop copy flush to all subscribers
+    MULTICAST,      // one multicast flush (sendmmsg)
+    COUNT
+};
+
+constexpr size_t kStageCount = static_cast<size_t>(Stage::COUNT);
+
+// Calibrates the TSC rate used to convert ticks; call once before threads record
+void init_stage_metrics();
+
+// Records a duration measured with read_tsc() into the calling thread's histograms.
+// Each thread owns its histograms, so recording is lock-free.
+void record_stage_ticks(Stage stage, uint64_t start_tsc, uint64_t end_tsc);
+void record_stage_ns(Stage stage, uint64_t ns);
+
+// Merges every thread's histograms: one STATS line per stage that has samples
+std::string format_stage_report();
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Maps strings (symbols, client ids) to dense integer ids.
+// Lookups take a string_view and never allocate; only interning a new string does.
+// The name table never reallocates, so name() of an id published to another
+// thread stays safe to read while new strings are interned.
+class StringInterner {
+    std::deque<std::string> storage;
+    std::unordered_map<std::string_view, uint32_t> ids;
+    std::vector<const std::string*> names;
+    
+public:
+    static constexpr uint32_t kInvalidId = UINT32_MAX;
+    
+    explicit StringInterner(size_t capacity = 65536) {
+        names.reserve(capacity);
+    }
+    
+    // Returns kInvalidId once capacity is exhausted
+    uint32_t intern(std::string_view str) {
+        auto it = ids.find(str);
+        if (it != ids.end()) {
+            return it->second;
+        }
+        if (names.size() == names.capacity()) {
+            return kInvalidId;
+        }
+        storage.emplace_back(str);
+        uint32_t id = static_cast<uint32_t>(names.size());
+        names.push_back(&storage.back());
+        ids.emplace(storage.back(), id);
+        return id;
+    }
+    
+    uint32_t find(std::string_view str) const {
+        auto it = ids.find(str);
+        return it == ids.end() ? kInvalidId : it->second;
+    }
+    
+    const std::string& name(uint32_t id) const { return *names[id]; }
+    size_t size() const { return names.size(); }
+    // Ids handed out are always below this
+    size_t capacity() const { return names.capacity(); }
+};
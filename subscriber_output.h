@@ -0,0 +1,62 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <sys/socket.h>
+#include "log.h"
+#include "output_queue.h"
+
+// A subscriber connection's OutputQueue and what happens to a subscriber that
+// cannot keep up: once its queue overflows or its socket fails it is shut down,
+// which the event loop sees as a disconnect and removes it. Not thread safe; the
+// owning server serializes access, as for the queue.
+class SubscriberOutput {
+public:
+    // component and name only label the log lines; name must outlive this
+    SubscriberOutput(int socket_fd, const char* log_component, const std::string& subscriber_name)
+        : fd(socket_fd), component(log_component), name(subscriber_name) {}
+    
+    void configure(size_t capacity_bytes, SlowConsumerPolicy slow_policy) {
+        queue.configure(capacity_bytes, slow_policy);
+    }
+    
+    // Queues without sending; nothing is queued once the subscriber is being cut off
+    void push(const SharedBuffer& buffer, size_t offset, size_t length, uint64_t key = 0) {
+        if (!disconnecting && queue.push(buffer, offset, length, key) == OutputQueue::PushResult::OVERFLOW) {
+            disconnect("output queue full");
+        }
+    }
+    
+    // Copies a message only this subscriber sends
+    void push(const char* data, size_t length) {
+        if (!disconnecting && queue.push(data, length) == OutputQueue::PushResult::OVERFLOW) {
+            disconnect("output queue full");
+        }
+    }
+    
+    // Never blocks: whatever the socket does not take stays queued for the next flush
+    void flush() {
+        if (!disconnecting && !queue.drain(fd)) {
+            disconnect("send failed");
+        }
+    }
+    
+    bool empty() const { return queue.empty(); }
+    size_t backlog_bytes() const { return queue.backlog_bytes(); }
+    bool is_disconnecting() const { return disconnecting; }
+    const OutputQueue& get_queue() const { return queue; }
+    
+private:
+    int fd;
+    const char* component;
+    const std::string& name;
+    OutputQueue queue;
+    bool disconnecting = false;
+    
+    void disconnect(const char* reason) {
+        LOG_WARN("[%s] Disconnecting %s: %s with %zu bytes backlogged\n", component, name.c_str(), reason,
+                 queue.backlog_bytes());
+        disconnecting = true;
+        ::shutdown(fd, SHUT_RDWR);
+    }
+};
@@ -0,0 +1,102 @@
+#include "trading_session.h"
+#include <charconv>
+#include <ctime>
+#include <string>
+#include "log.h"
+
+namespace {
+    constexpr uint32_t kSecondsPerDay = 24 * 60 * 60;
+    
+    bool parse_clock_field(std::string_view field, uint32_t limit, uint32_t& value) {
+        if (field.size() != 2) {
+            return false;
+        }
+        auto result = std::from_chars(field.data(), field.data() + field.size(), value);
+        return result.ec == std::errc() && result.ptr == field.data() + field.size() && value < limit;
+    }
+    
+    // HH:MM or HH:MM:SS
+    bool parse_time_of_day(std::string_view text, uint32_t& seconds) {
+        uint32_t hours = 0;
+        uint32_t minutes = 0;
+        uint32_t secs = 0;
+        if (text.size() != 5 && text.size() != 8) {
+            return false;
+        }
+        if (text[2] != ':' || !parse_clock_field(text.substr(0, 2), 24, hours) ||
+            !parse_clock_field(text.substr(3, 2), 60, minutes)) {
+            return false;
+        }
+        if (text.size() == 8 && (text[5] != ':' || !parse_clock_field(text.substr(6, 2), 60, secs))) {
+            return false;
+        }
+        seconds = hours * 3600 + minutes * 60 + secs;
+        return true;
+    }
+}
+
+const char* TradingSession::state_name(TradingState state) {
+    switch (state) {
+        case TradingState::TRADING: return "TRADING";
+        case TradingState::HALTED: return "HALTED";
+        case TradingState::PRE_OPEN: return "PRE_OPEN";
+        case TradingState::OPENING_AUCTION: return "OPENING_AUCTION";
+        case TradingState::CLOSING_AUCTION: return "CLOSING_AUCTION";
+        case TradingState::CLOSED: return "CLOSED";
+    }
+    return "UNKNOWN";
+}
+
+bool TradingSession::parse_state(std::string_view name, TradingState& state) {
+    for (TradingState candidate : {TradingState::TRADING, TradingState::HALTED, TradingState::PRE_OPEN,
+                                   TradingState::OPENING_AUCTION, TradingState::CLOSING_AUCTION,
+                                   TradingState::CLOSED}) {
+        if (name == state_name(candidate)) {
+            state = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TradingSession::parse_schedule(std::string_view text, std::vector<SessionTransition>& schedule) {
+    schedule.clear();
+    while (!text.empty()) {
+        size_t end = text.find(',');
+        std::string_view entry = text.substr(0, end);
+        text = (end == std::string_view::npos) ? std::string_view() : text.substr(end + 1);
+        
+        size_t at = entry.find('@');
+        SessionTransition transition{0, TradingState::TRADING};
+        // A halt is an admin decision per symbol, never scheduled
+        bool valid = at != std::string_view::npos && parse_state(entry.substr(0, at), transition.phase) &&
+                     transition.phase != TradingState::HALTED &&
+                     parse_time_of_day(entry.substr(at + 1), transition.start) &&
+                     (schedule.empty() || transition.start > schedule.back().start);
+        if (!valid) {
+            LOG_ERROR("[session] Invalid schedule entry '%s'\n", std::string(entry).c_str());
+            schedule.clear();
+            return false;
+        }
+        schedule.push_back(transition);
+    }
+    return true;
+}
+
+TradingState TradingSession::phase_at(const std::vector<SessionTransition>& schedule, uint64_t timestamp,
+                                      uint64_t& next_change) {
+    time_t seconds = static_cast<time_t>(timestamp / 1000000000);
+    tm local;
+    localtime_r(&seconds, &local);
+    uint32_t time_of_day = static_cast<uint32_t>(local.tm_hour * 3600 + local.tm_min * 60 + local.tm_sec);
+    uint64_t midnight = timestamp - timestamp % 1000000000 - time_of_day * 1000000000ULL;
+    
+    size_t next = 0;
+    while (next < schedule.size() && schedule[next].start <= time_of_day) {
+        next++;
+    }
+    TradingState phase = schedule[next == 0 ? schedule.size() - 1 : next - 1].phase;
+    uint32_t next_start = (next < schedule.size()) ? schedule[next].start : schedule[0].start + kSecondsPerDay;
+    next_change = midnight + next_start * 1000000000ULL;
+    return phase;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "matching_engine_types.h"
+
+// One scheduled phase change: from start (seconds after local midnight) on,
+// every symbol that is not halted is in phase
+struct SessionTransition {
+    uint32_t start;
+    TradingState phase;
+};
+
+// The trading day. Outside continuous trading a book only accumulates orders;
+// a call (OPENING_AUCTION, CLOSING_AUCTION) also publishes where the book would
+// uncross, and leaving pre-open or a call for TRADING or CLOSED uncrosses it at
+// the price that executes the most quantity, then leaves the least unmatched.
+//
+// A schedule is given as PHASE@HH:MM[:SS] entries in time order, for example
+//   PRE_OPEN@07:00,OPENING_AUCTION@09:25,TRADING@09:30,CLOSING_AUCTION@15:55,CLOSED@16:00
+// Before the first entry of a day the last one's phase holds.
+class TradingSession {
+public:
+    // Phase changes are journaled as commands from this client
+    static constexpr const char* kClient = "session";
+    
+    static const char* state_name(TradingState state);
+    static bool parse_state(std::string_view name, TradingState& state);
+    static bool is_call(TradingState state) {
+        return state == TradingState::OPENING_AUCTION || state == TradingState::CLOSING_AUCTION;
+    }
+    
+    // False, with the offending entry logged, unless every entry is valid
+    static bool parse_schedule(std::string_view text, std::vector<SessionTransition>& schedule);
+    // Phase at timestamp (nanoseconds since the epoch) and when the next change is due
+    static TradingState phase_at(const std::vector<SessionTransition>& schedule, uint64_t timestamp,
+                                 uint64_t& next_change);
+};